@@ -1,13 +1,23 @@
 #pragma once
+#include "ScriptCacheListener.h"
 
 namespace Ogre {
 	
-	typedef CategorisedAllocPolicy<Ogre::MEMCATEGORY_SCRIPTING> ScriptSerializerAllocPolicy;
-	typedef AllocatedObject<ScriptSerializerAllocPolicy> ScriptSerializerAllocatedObject;
-	typedef ScriptSerializerAllocatedObject	ScriptSerializerAlloc;
+	typedef CategorisedAllocPolicy<Ogre::MEMCATEGORY_SCRIPTING> ScriptProfilerAllocPolicy;
+	typedef AllocatedObject<ScriptProfilerAllocPolicy> ScriptProfilerAllocatedObject;
+	typedef ScriptProfilerAllocatedObject	ScriptProfilerAlloc;
 
-	/** Plugin instance for Script Serializer */
-	class ScriptSerializerProfiler : public ScriptSerializerAlloc, public ResourceGroupListener
+	/** 
+	 * Plugin instance for Script Serializer.
+	 * When a trace file is set in the [Profiler] section of ScriptCache.cfg, the resource groups, scripts and script cache stages
+	 * are also recorded as nested spans and written in the Chrome trace format, which chrome://tracing and Perfetto open.
+	 * The depths of the script cache pipeline's queues are recorded as counters, and the log reports the throughput of
+	 * each pipeline stage at the end of every resource group.
+	 * With compareParse set, every text script is also parsed and decoded from the binary format, and the log reports the
+	 * speedup of each script and of each script type.
+	 * The memory the serializer holds is logged at the end of every resource group
+	 */
+	class ScriptSerializerProfiler : public ScriptProfilerAlloc, public ResourceGroupListener, public ScriptCacheListener
 	{
 	public:
 		ScriptSerializerProfiler();
@@ -15,8 +25,8 @@ namespace Ogre {
 		
 
 		/// Interface ResourceGroupListener
-		virtual void scriptParseStarted(const String& scriptName, bool& skipThisScript) { }
-		virtual void scriptParseEnded(const String& scriptName, bool skipped) { }
+		virtual void scriptParseStarted(const String& scriptName, bool& skipThisScript);
+		virtual void scriptParseEnded(const String& scriptName, bool skipped);
 		virtual void resourceGroupScriptingStarted(const String& groupName, size_t scriptCount);
 		virtual void resourceGroupScriptingEnded(const String& groupName);
 		virtual void resourceGroupLoadStarted(const String& groupName, size_t resourceCount) { }
@@ -26,12 +36,65 @@ namespace Ogre {
         virtual void worldGeometryStageEnded(void) { }
         virtual void resourceGroupLoadEnded(const String& groupName) { }
 
+		/// Interface ScriptCacheListener
+		virtual void scriptStarted(const String& scriptName);
+		virtual void scriptSuspended(const String& scriptName);
+		virtual void stageStarted(const char* stage, const String& detail, size_t thread);
+		virtual void stageEnded(const char* stage, size_t thread);
+		virtual bool isComparingScripts() const { return compareParsing; }
+		virtual void scriptCompared(const ScriptComparison& comparison);
+		virtual void queueChanged(const char* queue, size_t depth);
+		virtual void pipelineFinished(const String& groupName, const ScriptPipelineStats& stats);
+
 	private:
+		struct TraceEvent {
+			char phase;			// 'B' begins a span, 'E' ends the last one open on the thread, 'C' sets a counter to the detail
+			String name;
+			String category;
+			String detail;
+			unsigned long time;
+			size_t thread;
+		};
+		typedef vector<TraceEvent>::type TraceEventList;
+
+		struct ComparisonTotals {
+			ComparisonTotals() : scripts(0), textSize(0), binarySize(0), nodeCount(0), textTime(0), binaryTime(0) { }
+			size_t scripts;
+			size_t textSize;
+			size_t binarySize;
+			size_t nodeCount;
+			unsigned long textTime;
+			unsigned long binaryTime;
+		};
+		typedef map<String, ComparisonTotals>::type ComparisonTotalsMap;		// By script extension
+
 		void loadStats();
 		void logMessage(const String& message);
 
+		void loadConfig();
+		void attachToScriptCache();
+		void addTraceEvent(char phase, const String& name, const char* category, const String& detail, size_t thread);
+		void saveTrace();
+		void logComparisonTotals(const String& groupName);
+		void logMemoryStats(const String& groupName);
+		static String formatSpeedup(unsigned long textTime, unsigned long binaryTime);
+
 	private:
 		clock_t scriptCompileStartTime;
 		int scriptCount;
+
+		String traceFileName;
+		ScriptSerializerPlugin* serializerPlugin;
+		bool attachPending;
+		bool scriptOpen;
+		Timer traceTimer;
+		TraceEventList traceEvents;
+		OGRE_MUTEX(traceMutex)
+
+		bool compareParsing;
+		bool comparisonPending;
+		ScriptComparison lastComparison;
+		ComparisonTotalsMap comparisonTotals;
+		StringVector slowerScripts;
 	};
 }
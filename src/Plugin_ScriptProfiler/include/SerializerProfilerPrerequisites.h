@@ -7,6 +7,7 @@ namespace Ogre
 	// Predefine classes
 	class ScriptSerializerProfiler;
 	class SerializerProfilerPlugin;
+	class ScriptSerializerPlugin;
 
 	//-------------------------------------------
 	// Windows setttings
@@ -1,25 +1,69 @@
 #include "SerializerProfilerPreCompiled.h"
 #include "SerializerProfiler.h"
+#include "ScriptSerializerPrerequisites.h"
+#include "ScriptSerializerPlugin.h"
+#include "ScriptSerializerManager.h"
+#include "ScriptCacheJson.h"
 #include <sstream>
+#include <fstream>
 using namespace std;
 
 namespace Ogre {
 
-	const String serializerLogName = "SerialzierProfiler.log"; 
+	const String serializerLogName = "SerialzierProfiler.log";
+	const String serializerPluginName = "ScriptSerializer";
+	const String profilerConfigFileName = "ScriptCache.cfg";
 
-	ScriptSerializerProfiler::ScriptSerializerProfiler() : scriptCompileStartTime(0), scriptCount(0) {
+	ScriptSerializerProfiler::ScriptSerializerProfiler() : scriptCompileStartTime(0), scriptCount(0),
+		serializerPlugin(0), attachPending(true), scriptOpen(false), compareParsing(false), comparisonPending(false) {
 		LogManager::getSingleton().createLog(serializerLogName);
 		ResourceGroupManager::getSingleton().addResourceGroupListener(this);
+		loadConfig();
 	}
-	
+
 	ScriptSerializerProfiler::~ScriptSerializerProfiler(void) {
+		// The serializer plugin drops its manager when it is shut down before this one
+		if (serializerPlugin && serializerPlugin->getSerializerManager()) {
+			serializerPlugin->getSerializerManager()->setCacheListener(0);
+		}
+		if (!traceFileName.empty()) {
+			saveTrace();
+		}
+
 		LogManager::getSingleton().getSingleton().destroyLog(serializerLogName);
 		Ogre::ResourceGroupManager::getSingleton().removeResourceGroupListener(this);
 	}
 
+	void ScriptSerializerProfiler::scriptParseStarted(const String& scriptName, bool& skipThisScript) {
+		// The script cache may have reported the script already, depending on which listener was registered first
+		scriptStarted(scriptName);
+	}
+
+	void ScriptSerializerProfiler::scriptParseEnded(const String& scriptName, bool skipped) {
+		if (comparisonPending && lastComparison.scriptName == scriptName) {
+			stringstream ss;
+			ss << "[compare] " << scriptName << ": text " << lastComparison.textTime << " us, binary " << lastComparison.binaryTime << " us, speedup "
+				<< formatSpeedup(lastComparison.textTime, lastComparison.binaryTime) << ", " << lastComparison.textSize << " -> " 
+				<< lastComparison.binarySize << " bytes, " << lastComparison.nodeCount << " nodes, " << (skipped ? "served from cache" : "parsed as text");
+			logMessage(ss.str());
+		}
+		comparisonPending = false;
+
+		if (scriptOpen) {
+			addTraceEvent('E', scriptName, "script", StringUtil::BLANK, 0);
+			scriptOpen = false;
+		}
+	}
+
 	void ScriptSerializerProfiler::resourceGroupScriptingStarted(const String& groupName, size_t scriptCount) {
 		this->scriptCount = scriptCount;
 		scriptCompileStartTime = clock();
+
+		// The script cache is created by its own plugin, which may be installed after this one
+		if (attachPending) {
+			attachToScriptCache();
+		}
+		addTraceEvent('B', groupName, "group", StringConverter::toString(scriptCount) + " scripts", 0);
 	}
 
 	void ScriptSerializerProfiler::resourceGroupScriptingEnded(const String& groupName) {
@@ -27,11 +71,209 @@ namespace Ogre {
 		double elapsedTime = (clock() - scriptCompileStartTime) / 1000.0;
 		ss << "[" << groupName << "] " << scriptCount << " scripts parsed in " << elapsedTime << " seconds.";
 		logMessage(ss.str());
+		addTraceEvent('E', groupName, "group", StringUtil::BLANK, 0);
+
+		if (!comparisonTotals.empty()) {
+			logComparisonTotals(groupName);
+		}
+		if (serializerPlugin && serializerPlugin->getSerializerManager()) {
+			logMemoryStats(groupName);
+		}
+	}
+
+	void ScriptSerializerProfiler::scriptStarted(const String& scriptName) {
+		if (!scriptOpen) {
+			addTraceEvent('B', scriptName, "script", StringUtil::BLANK, 0);
+			scriptOpen = true;
+		}
+	}
+
+	void ScriptSerializerProfiler::scriptSuspended(const String& scriptName) {
+		if (scriptOpen) {
+			addTraceEvent('E', scriptName, "script", StringUtil::BLANK, 0);
+			scriptOpen = false;
+		}
+	}
+
+	void ScriptSerializerProfiler::stageStarted(const char* stage, const String& detail, size_t thread) {
+		addTraceEvent('B', stage, "stage", detail, thread);
+	}
+
+	void ScriptSerializerProfiler::stageEnded(const char* stage, size_t thread) {
+		addTraceEvent('E', stage, "stage", StringUtil::BLANK, thread);
 	}
 
 
+	void ScriptSerializerProfiler::scriptCompared(const ScriptComparison& comparison) {
+		lastComparison = comparison;
+		comparisonPending = true;
+
+		size_t extensionIndex = comparison.scriptName.find_last_of(".");
+		String extension = (extensionIndex != String::npos) ? comparison.scriptName.substr(extensionIndex) : comparison.scriptName;
+		ComparisonTotals& totals = comparisonTotals[extension];
+		totals.scripts++;
+		totals.textSize += comparison.textSize;
+		totals.binarySize += comparison.binarySize;
+		totals.nodeCount += comparison.nodeCount;
+		totals.textTime += comparison.textTime;
+		totals.binaryTime += comparison.binaryTime;
+
+		if (comparison.binaryTime > comparison.textTime) {
+			slowerScripts.push_back(comparison.scriptName + " (" + formatSpeedup(comparison.textTime, comparison.binaryTime) + ")");
+		}
+	}
+
+	void ScriptSerializerProfiler::logComparisonTotals(const String& groupName) {
+		ComparisonTotals all;
+		for (ComparisonTotalsMap::const_iterator it = comparisonTotals.begin(); it != comparisonTotals.end(); ++it) {
+			const ComparisonTotals& totals = it->second;
+			stringstream ss;
+			ss << "[compare] [" << groupName << "] " << it->first << ": " << totals.scripts << " scripts, text " << totals.textTime << " us, binary "
+				<< totals.binaryTime << " us, speedup " << formatSpeedup(totals.textTime, totals.binaryTime) << ", " << totals.textSize << " -> "
+				<< totals.binarySize << " bytes, " << totals.nodeCount << " nodes";
+			logMessage(ss.str());
+
+			all.scripts += totals.scripts;
+			all.textSize += totals.textSize;
+			all.binarySize += totals.binarySize;
+			all.nodeCount += totals.nodeCount;
+			all.textTime += totals.textTime;
+			all.binaryTime += totals.binaryTime;
+		}
+
+		stringstream ss;
+		ss << "[compare] [" << groupName << "] all: " << all.scripts << " scripts, text " << all.textTime << " us, binary " << all.binaryTime 
+			<< " us, speedup " << formatSpeedup(all.textTime, all.binaryTime) << ", " << all.textSize << " -> " << all.binarySize << " bytes";
+		logMessage(ss.str());
+
+		if (!slowerScripts.empty()) {
+			logMessage("[compare] [" + groupName + "] binary slower than text: " + StringConverter::toString(slowerScripts));
+		}
+		comparisonTotals.clear();
+		slowerScripts.clear();
+	}
+
+	void ScriptSerializerProfiler::queueChanged(const char* queue, size_t depth) {
+		addTraceEvent('C', String(queue) + " queue", "pipeline", StringConverter::toString(depth), 0);
+	}
+
+	void ScriptSerializerProfiler::pipelineFinished(const String& groupName, const ScriptPipelineStats& stats) {
+		for (size_t i = 0; i < ScriptPipelineStats::PS_Count; i++) {
+			const ScriptPipelineStage& stage = stats.stages[i];
+			double rate = stage.busyTime ? stage.scripts * 1000000.0 / stage.busyTime : 0;
+			stringstream ss;
+			ss << "[pipeline] [" << groupName << "] " << ScriptPipelineStats::getStageName(i) << ": " << stage.scripts << " scripts, busy " << stage.busyTime
+				<< " us (" << static_cast<unsigned long>(rate) << " scripts/s), waited " << stage.waitTime << " us, queue up to " << stage.maxQueueDepth;
+			logMessage(ss.str());
+		}
+		stringstream ss;
+		ss << "[pipeline] [" << groupName << "] " << stats.elapsedTime << " us, " << stats.dropped << " scripts read ahead and not asked for";
+		logMessage(ss.str());
+	}
+
+	void ScriptSerializerProfiler::logMemoryStats(const String& groupName) {
+		ScriptSerializerMemoryStats stats = serializerPlugin->getSerializerManager()->getMemoryStats();
+		stringstream ss;
+		ss << "[memory] [" << groupName << "] serializer holds " << stats.currentBytes / 1024 << " KB, peak " << stats.peakBytes / 1024 
+			<< " KB, " << stats.allocationCount << " allocations.  By size:";
+		for (size_t i = 0; i < ScriptSerializerMemoryStats::HistogramBuckets; i++) {
+			bool last = (i + 1 == ScriptSerializerMemoryStats::HistogramBuckets);
+			ss << " " << (last ? ">" : "<=") << (16 << (last ? i - 1 : i)) << ": " << stats.histogram[i];
+		}
+		logMessage(ss.str());
+	}
+
+	String ScriptSerializerProfiler::formatSpeedup(unsigned long textTime, unsigned long binaryTime) {
+		// Scripts small enough to decode within the timer resolution count as one microsecond
+		double speedup = static_cast<double>(std::max(textTime, 1UL)) / std::max(binaryTime, 1UL);
+		return StringConverter::toString(static_cast<Real>(speedup), 3) + "x";
+	}
+
 	void ScriptSerializerProfiler::logMessage(const String& message) {
 		LogManager::getSingleton().getLog(serializerLogName)->logMessage("SERAILIZER LOG: " + message);
 	}
 
-}
\ No newline at end of file
+	void ScriptSerializerProfiler::loadConfig() {
+		// The archive is shared with any resource location on the working directory, so it stays loaded
+		ConfigFile configFile;
+		Archive* workingDirectory =  ArchiveManager::getSingleton().load(".", "FileSystem");
+		if (workingDirectory->exists(profilerConfigFileName)) {
+			DataStreamPtr configStream = workingDirectory->open(profilerConfigFileName);
+			configFile.load(configStream);
+			configStream->close();
+		}
+
+		traceFileName = configFile.getSetting("traceFile", "Profiler", "");
+		compareParsing = StringConverter::parseBool(configFile.getSetting("compareParse", "Profiler", "false"));
+		traceTimer.reset();
+	}
+
+	void ScriptSerializerProfiler::attachToScriptCache() {
+		attachPending = false;
+		const Root::PluginInstanceList& plugins = Root::getSingleton().getInstalledPlugins();
+		for (Root::PluginInstanceList::const_iterator it = plugins.begin(); it != plugins.end(); ++it) {
+			if ((*it)->getName() == serializerPluginName) {
+				serializerPlugin = static_cast<ScriptSerializerPlugin*>(*it);
+				break;
+			}
+		}
+
+		if (!serializerPlugin || !serializerPlugin->getSerializerManager()) {
+			logMessage("Script cache not found. Only groups and scripts are traced, and scripts are not compared");
+			serializerPlugin = 0;
+		}
+		else if (!traceFileName.empty() || compareParsing) {
+			// Listening costs a call per stage, so the cache is only listened to when something uses the calls
+			serializerPlugin->getSerializerManager()->setCacheListener(this);
+		}
+	}
+
+	void ScriptSerializerProfiler::addTraceEvent(char phase, const String& name, const char* category, const String& detail, size_t thread) {
+		if (traceFileName.empty()) {
+			return;
+		}
+
+		TraceEvent event;
+		event.phase = phase;
+		event.name = name;
+		event.category = category;
+		event.detail = detail;
+		event.thread = thread;
+
+		OGRE_LOCK_MUTEX(traceMutex)
+		event.time = traceTimer.getMicroseconds();
+		traceEvents.push_back(event);
+	}
+
+	void ScriptSerializerProfiler::saveTrace() {
+		ofstream file(traceFileName.c_str(), ios::binary);
+		if (!file) {
+			logMessage("Cannot write the trace file " + traceFileName);
+			return;
+		}
+
+		// Thread ids start at 1 so the thread firing the resource group events comes first in the viewers
+		OGRE_LOCK_MUTEX(traceMutex)
+		file << "{\"traceEvents\":[\n";
+		for (TraceEventList::const_iterator it = traceEvents.begin(); it != traceEvents.end(); ++it) {
+			if (it != traceEvents.begin()) {
+				file << ",\n";
+			}
+			file << "{\"ph\":\"" << it->phase << "\",\"pid\":1,\"tid\":" << (it->thread + 1) << ",\"ts\":" << it->time;
+			file << ",\"cat\":\"" << it->category << "\",\"name\":";
+			writeJsonString(file, it->name);
+			if (it->phase == 'C') {
+				file << ",\"args\":{\"depth\":" << it->detail << "}";
+			}
+			else if (!it->detail.empty()) {
+				file << ",\"args\":{\"detail\":";
+				writeJsonString(file, it->detail);
+				file << "}";
+			}
+			file << "}";
+		}
+		file << "\n]}\n";
+		logMessage(StringConverter::toString(traceEvents.size()) + " trace events written to " + traceFileName);
+	}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "OgreMaterial.h"
+
+namespace Ogre {
+
+	/**
+	 * Saves the materials of a script in the state the translators left them, and creates them again from that state
+	 * without running the translators.  Fixed function and programmable passes are covered, programs through the named
+	 * parameters that differ from the program's defaults only, so a restored pass picks up defaults changed since.
+	 * Materials using shadow programs, shared parameters, projective textures or textures created in code, such as the
+	 * ones of a texture_source, are not saveable.
+	 *
+	 * Restored materials never reach the translators, so ScriptCompilerListener::handleEvent sees no
+	 * CreateMaterialScriptCompilerEvent or other event for them.  Applications that create their own material
+	 * subclasses or change materials in those events must leave the material state off
+	 */
+	class MaterialStateSerializer : public ScriptSerializerAlloc
+	{
+	public:
+		typedef vector<MaterialPtr>::type MaterialList;
+
+		MaterialStateSerializer();
+
+		/// Checks that every state of the material is covered.  Otherwise tells why in reason
+		static bool isSaveable(const MaterialPtr& material, String& reason);
+
+		void save(const DataStreamPtr& stream, const MaterialList& materials, size_t scriptTimestamp);
+
+		/**
+		 * Creates the saved materials in the group.  Returns false, leaving none of them behind, if one of the materials
+		 * already exists or cannot be restored.  The number of materials created is returned in count
+		 */
+		bool load(const DataStreamPtr& stream, const String& groupName, const String& origin, size_t& count);
+
+		/// Reads the timestamp of the script the state was saved from.  False if the stream holds no state this serializer reads
+		static bool readTimestamp(const DataStreamPtr& stream, time_t& timestamp);
+
+	private:
+		void writeMaterial(const MaterialPtr& material);
+		void writeTechnique(Technique* technique);
+		void writePass(Pass* pass);
+		void writeProgram(const GpuProgramPtr& program, const GpuProgramParametersSharedPtr& params);
+		void writeTextureUnit(TextureUnitState* unit);
+		void writeString(const String& value);
+		void writeColour(const ColourValue& colour);
+
+		void readMaterial(Material* material);
+		void readTechnique(Technique* technique);
+		void readPass(Pass* pass);
+		void readProgram(Pass* pass, void (Pass::*setProgram)(const String&, bool), GpuProgramParametersSharedPtr (Pass::*getParameters)() const);
+		void readTextureUnit(TextureUnitState* unit);
+		String readString();
+		void readBytes(void* data, size_t size);
+		ColourValue readColour();
+
+		static bool isSaveable(const GpuProgramParametersSharedPtr& params);
+		static bool isCoveredByNames(const GpuLogicalBufferStructPtr& buffer, const GpuConstantDefinitionMap& constants, bool isFloat);
+		static bool isDefault(const GpuConstantDefinition& definition, const GpuProgramParametersSharedPtr& params, const GpuProgramParametersSharedPtr& defaults);
+
+		template<typename T>
+		void writeValue(const T& value);
+
+		template<typename T>
+		T readValue();
+
+	private:
+		DataStreamPtr mStream;
+	};
+
+}
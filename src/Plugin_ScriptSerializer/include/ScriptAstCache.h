@@ -0,0 +1,59 @@
+#pragma once
+#include "OgreScriptCompiler.h"
+#include <list>
+
+namespace Ogre {
+
+	/**
+	 * Keeps the decoded trees of cached scripts in memory, so reloading a resource group skips both the disk and the decoding.
+	 * Entries are keyed by script name along with the timestamp of the script they were made from.  The least recently
+	 * used trees are dropped once the approximate memory held by all trees exceeds the budget.
+	 * The compiler takes the trees apart, so the cache only ever hands out copies of its own trees
+	 */
+	class ScriptAstCache : public ScriptSerializerAlloc
+	{
+	public:
+		ScriptAstCache(size_t budget);
+
+		/// Returns a copy of the named tree, or a null pointer if it is not cached or was made from an older script
+		AbstractNodeListPtr find(const String& name, time_t timestamp);
+
+		/// Stores a copy of the tree, replacing any earlier one of the same name
+		void insert(const String& name, time_t timestamp, const AbstractNodeListPtr& ast);
+
+		/// Whether find() would return the tree, without counting a hit or a miss
+		bool contains(const String& name, time_t timestamp) const;
+
+		void remove(const String& name);
+		void clear();
+
+		/// Copies the trees, so the compiler can take the copy apart
+		static AbstractNodeListPtr copyTrees(const AbstractNodeList& trees);
+
+		size_t getMemoryUsage() const { return mMemoryUsage; }
+		size_t getHitCount() const { return mHits; }
+		size_t getMissCount() const { return mMisses; }
+
+	private:
+		typedef std::list<String> UsageList;		// Most recently used first
+
+		struct Entry {
+			time_t timestamp;
+			AbstractNodeListPtr ast;
+			size_t size;
+			UsageList::iterator usage;
+		};
+		typedef map<String, Entry>::type EntryMap;
+
+		static size_t estimateSize(const AbstractNode* node);
+
+	private:
+		EntryMap mEntries;
+		UsageList mUsage;
+		size_t mBudget;
+		size_t mMemoryUsage;
+		size_t mHits;
+		size_t mMisses;
+	};
+
+}
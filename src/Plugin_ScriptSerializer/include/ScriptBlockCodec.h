@@ -0,0 +1,410 @@
+#pragma once
+#include "ScriptSerializer.h"
+
+namespace Ogre {
+
+	/**
+	 * Encoders and decoders of the blocks of a binary script, generated from a list of fields per block type.
+	 * Each field names its member, how it is stored and when.  The largest encoded size of a block is known at compile
+	 * time, so a block is written or read with a single bounds check.  Adding a field to a block means adding it to
+	 * the block's struct and to its schema below; writer and reader cannot disagree on the layout
+	 */
+	namespace ScriptBlock {
+
+		/// How a field is stored
+		enum FieldEncoding {
+			FE_Fixed,		// The bytes of the field as they are in memory
+			FE_Varint,		// Seven bits per byte, low bits first.  Values below 128 take a single byte
+			FE_String,		// A string id, encoded in 32 bits and patched once the string tables of the segments are merged.  A varint in scripts flagged SF_CompactStrings
+			FE_Offset		// A 64 bit stream offset.  Patched once the segments are laid out
+		};
+
+		/// When a field is stored
+		enum FieldPresence {
+			FP_Always,
+			FP_Debug,		// Left out in the release profile
+			FP_Lists		// Left out of object blocks flagged BF_NoLists
+		};
+
+		/// Decides which of the optional fields of a block are stored
+		struct CodecContext {
+			CodecContext(bool release, uint8 blockFlags, bool compactStrings = false) : release(release), blockFlags(blockFlags), compactStrings(compactStrings) { }
+
+			bool release;
+			uint8 blockFlags;
+			bool compactStrings;		// String ids are read as varints
+		};
+
+		/// Receives the position of the fields patched after encoding.  Blocks written outside of segments have none
+		struct NullSink {
+			void stringField(uint8* at, ResourceID id) { }
+			void offsetField(uint8* at) { }
+		};
+
+		template<typename T, int Encoding>
+		struct FieldCodec;
+
+		template<typename T>
+		struct FieldCodec<T, FE_Fixed> {
+			enum { maxSize = sizeof(T) };
+
+			template<typename Sink>
+			static uint8* encode(const T& value, uint8* out, Sink& sink) {
+				memcpy(out, &value, sizeof(T));
+				return out + sizeof(T);
+			}
+
+			static const uint8* decode(T& value, const uint8* in, const CodecContext& context) {
+				memcpy(&value, in, sizeof(T));
+				return in + sizeof(T);
+			}
+		};
+
+		template<typename T>
+		struct FieldCodec<T, FE_Varint> {
+			enum { maxSize = (sizeof(T) * 8 + 6) / 7 };
+
+			template<typename Sink>
+			static uint8* encode(const T& value, uint8* out, Sink& sink) {
+				uint64 remaining = value;
+				while (remaining >= 0x80) {
+					*out++ = static_cast<uint8>(remaining | 0x80);
+					remaining >>= 7;
+				}
+				*out++ = static_cast<uint8>(remaining);
+				return out;
+			}
+
+			static const uint8* decode(T& value, const uint8* in, const CodecContext& context) {
+				// Stops after maxSize bytes, so a corrupt value cannot run past the block
+				uint64 result = 0;
+				for (size_t shift = 0; shift < maxSize * 7; shift += 7) {
+					uint8 byte = *in++;
+					result |= static_cast<uint64>(byte & 0x7f) << shift;
+					if (!(byte & 0x80)) {
+						break;
+					}
+				}
+				value = static_cast<T>(result);
+				return in;
+			}
+		};
+
+		template<typename T>
+		struct FieldCodec<T, FE_String> {
+			enum { maxSize = FieldCodec<T, FE_Varint>::maxSize };
+
+			/// Written in 32 bits whatever the context, as the final id is not known yet
+			template<typename Sink>
+			static uint8* encode(const T& value, uint8* out, Sink& sink) {
+				sink.stringField(out, value);
+				return FieldCodec<T, FE_Fixed>::encode(value, out, sink);
+			}
+
+			static const uint8* decode(T& value, const uint8* in, const CodecContext& context) {
+				if (context.compactStrings) {
+					return FieldCodec<T, FE_Varint>::decode(value, in, context);
+				}
+				return FieldCodec<T, FE_Fixed>::decode(value, in, context);
+			}
+		};
+
+		template<typename T>
+		struct FieldCodec<T, FE_Offset> {
+			enum { maxSize = sizeof(uint64) };
+
+			template<typename Sink>
+			static uint8* encode(const T& value, uint8* out, Sink& sink) {
+				sink.offsetField(out);
+				return FieldCodec<T, FE_Fixed>::encode(value, out, sink);
+			}
+
+			static const uint8* decode(T& value, const uint8* in, const CodecContext& context) {
+				return FieldCodec<T, FE_Fixed>::decode(value, in, context);
+			}
+		};
+
+		/// A member of Block, stored with the given FieldEncoding when the FieldPresence allows
+		template<typename Block, typename T, T Block::*Member, int Encoding, int Presence = FP_Always>
+		struct Field {
+			typedef FieldCodec<T, Encoding> Codec;
+			enum { maxSize = Codec::maxSize };
+
+			static bool isStored(const CodecContext& context) {
+				return Presence == FP_Always ||
+					(Presence == FP_Debug && !context.release) ||
+					(Presence == FP_Lists && !(context.blockFlags & BF_NoLists));
+			}
+
+			template<typename Sink>
+			static uint8* encode(const Block& block, uint8* out, const CodecContext& context, Sink& sink) {
+				return isStored(context) ? Codec::encode(block.*Member, out, sink) : out;
+			}
+
+			static const uint8* decode(Block& block, const uint8* in, const CodecContext& context) {
+				return isStored(context) ? Codec::decode(block.*Member, in, context) : in;
+			}
+		};
+
+		/// A struct member of Block, stored through the struct's own schema
+		template<typename Block, typename T, T Block::*Member, typename MemberSchema>
+		struct Nested {
+			enum { maxSize = MemberSchema::maxSize };
+
+			template<typename Sink>
+			static uint8* encode(const Block& block, uint8* out, const CodecContext& context, Sink& sink) {
+				return MemberSchema::encode(block.*Member, out, context, sink);
+			}
+
+			static const uint8* decode(Block& block, const uint8* in, const CodecContext& context) {
+				return MemberSchema::decode(block.*Member, in, context);
+			}
+		};
+
+		struct EndOfSchema { };
+
+		/// The fields of a block in the order they are stored
+		template<typename F1, typename F2 = EndOfSchema, typename F3 = EndOfSchema, typename F4 = EndOfSchema,
+			typename F5 = EndOfSchema, typename F6 = EndOfSchema, typename F7 = EndOfSchema>
+		struct Schema {
+			typedef Schema<F2, F3, F4, F5, F6, F7> Rest;
+			enum { maxSize = F1::maxSize + Rest::maxSize };
+
+			template<typename Block, typename Sink>
+			static uint8* encode(const Block& block, uint8* out, const CodecContext& context, Sink& sink) {
+				return Rest::encode(block, F1::encode(block, out, context, sink), context, sink);
+			}
+
+			template<typename Block>
+			static const uint8* decode(Block& block, const uint8* in, const CodecContext& context) {
+				return Rest::decode(block, F1::decode(block, in, context), context);
+			}
+		};
+
+		template<>
+		struct Schema<EndOfSchema, EndOfSchema, EndOfSchema, EndOfSchema, EndOfSchema, EndOfSchema, EndOfSchema> {
+			enum { maxSize = 0 };
+
+			template<typename Block, typename Sink>
+			static uint8* encode(const Block& block, uint8* out, const CodecContext& context, Sink& sink) {
+				return out;
+			}
+
+			template<typename Block>
+			static const uint8* decode(Block& block, const uint8* in, const CodecContext& context) {
+				return in;
+			}
+		};
+
+		/// The schema of each block type
+		template<typename Block>
+		struct BlockSchema;
+
+		template<>
+		struct BlockSchema<ScriptBlockHeader> {
+			typedef Schema<
+				Field<ScriptBlockHeader, uint8, &ScriptBlockHeader::blockClass, FE_Fixed>,
+				Field<ScriptBlockHeader, uint8, &ScriptBlockHeader::flags, FE_Fixed>,
+				Field<ScriptBlockHeader, uint32, &ScriptBlockHeader::blockType, FE_Varint>,
+				Field<ScriptBlockHeader, uint32, &ScriptBlockHeader::blockID, FE_Varint>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<TransitionBlock> {
+			typedef Schema<
+				Field<TransitionBlock, uint32, &TransitionBlock::direction, FE_Varint>,
+				Field<TransitionBlock, uint32, &TransitionBlock::userData, FE_Varint>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<AbstractNodeBlock> {
+			typedef Schema<
+				Field<AbstractNodeBlock, uint32, &AbstractNodeBlock::lineNumber, FE_Varint, FP_Debug>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<ResourceArrayHeader> {
+			typedef Schema<
+				Field<ResourceArrayHeader, uint64, &ResourceArrayHeader::count, FE_Varint, FP_Lists>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<AtomAbstractNodeBlock> {
+			typedef Schema<
+				Nested<AtomAbstractNodeBlock, AbstractNodeBlock, &AtomAbstractNodeBlock::nodeInfo, BlockSchema<AbstractNodeBlock>::Type>,
+				Field<AtomAbstractNodeBlock, uint32, &AtomAbstractNodeBlock::id, FE_Varint>,
+				Field<AtomAbstractNodeBlock, ResourceID, &AtomAbstractNodeBlock::value, FE_String>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<PropertyAbstractNodeBlock> {
+			typedef Schema<
+				Nested<PropertyAbstractNodeBlock, AbstractNodeBlock, &PropertyAbstractNodeBlock::nodeInfo, BlockSchema<AbstractNodeBlock>::Type>,
+				Field<PropertyAbstractNodeBlock, ResourceID, &PropertyAbstractNodeBlock::name, FE_String>,
+				Field<PropertyAbstractNodeBlock, uint32, &PropertyAbstractNodeBlock::id, FE_Varint>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<ReferenceBlock> {
+			typedef Schema<
+				Nested<ReferenceBlock, AbstractNodeBlock, &ReferenceBlock::nodeInfo, BlockSchema<AbstractNodeBlock>::Type>,
+				Field<ReferenceBlock, uint64, &ReferenceBlock::target, FE_Offset>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<ObjectAbstractNodeBlock> {
+			typedef Schema<
+				Nested<ObjectAbstractNodeBlock, AbstractNodeBlock, &ObjectAbstractNodeBlock::nodeInfo, BlockSchema<AbstractNodeBlock>::Type>,
+				Field<ObjectAbstractNodeBlock, ResourceID, &ObjectAbstractNodeBlock::name, FE_String>,
+				Field<ObjectAbstractNodeBlock, ResourceID, &ObjectAbstractNodeBlock::cls, FE_String>,
+				Field<ObjectAbstractNodeBlock, uint32, &ObjectAbstractNodeBlock::id, FE_Varint>,
+				Field<ObjectAbstractNodeBlock, bool, &ObjectAbstractNodeBlock::abstract, FE_Fixed>,
+				Nested<ObjectAbstractNodeBlock, ResourceArrayHeader, &ObjectAbstractNodeBlock::bases, BlockSchema<ResourceArrayHeader>::Type>,
+				Nested<ObjectAbstractNodeBlock, ResourceArrayHeader, &ObjectAbstractNodeBlock::environmentVars, BlockSchema<ResourceArrayHeader>::Type>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<ColumnsBlock> {
+			typedef Schema<
+				Field<ColumnsBlock, uint32, &ColumnsBlock::nodeCount, FE_Varint>,
+				Field<ColumnsBlock, uint32, &ColumnsBlock::objectCount, FE_Varint>,
+				Field<ColumnsBlock, uint32, &ColumnsBlock::listCount, FE_Varint>,
+				Field<ColumnsBlock, uint32, &ColumnsBlock::shapeCount, FE_Varint>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<StringTableBlock> {
+			typedef Schema<
+				Field<StringTableBlock, uint64, &StringTableBlock::count, FE_Varint>
+			> Type;
+		};
+
+		template<>
+		struct BlockSchema<SegmentTableBlock> {
+			typedef Schema<
+				Field<SegmentTableBlock, uint64, &SegmentTableBlock::count, FE_Varint>,
+				Field<SegmentTableBlock, uint64, &SegmentTableBlock::dependencyCount, FE_Varint>
+			> Type;
+		};
+
+		/// Encodes and decodes a block through its schema
+		template<typename Block>
+		struct BlockCodec {
+			typedef typename BlockSchema<Block>::Type Type;
+			enum { maxSize = Type::maxSize };
+
+			template<typename Sink>
+			static uint8* encode(const Block& block, uint8* out, const CodecContext& context, Sink& sink) {
+				return Type::encode(block, out, context, sink);
+			}
+
+			/// Fields that are not stored read as zero
+			static const uint8* decode(Block& block, const uint8* in, const CodecContext& context) {
+				block = Block();
+				return Type::decode(block, in, context);
+			}
+		};
+
+		/// Decodes the blocks of a buffer holding part of a binary script
+		class BlockReader {
+		public:
+			/// base is the stream offset of the buffer's first byte
+			BlockReader(const uint8* begin, const uint8* end, size_t base) : begin(begin), end(end), pos(begin), base(base) { }
+
+			/// Stream offset of the next block
+			size_t tell() const { return base + (pos - begin); }
+
+			/// Moves to a stream offset within the buffer
+			void seek(size_t offset) {
+				if (offset < base || offset - base > static_cast<size_t>(end - begin)) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Block offset outside of the script", "BlockReader::seek");
+				}
+				pos = begin + (offset - base);
+			}
+
+			bool atEnd() const { return pos == end; }
+
+			size_t remaining() const { return end - pos; }
+
+			template<typename Block>
+			void read(Block& block, const CodecContext& context) {
+				if (static_cast<size_t>(end - pos) >= static_cast<size_t>(BlockCodec<Block>::maxSize)) {
+					pos = BlockCodec<Block>::decode(block, pos, context);
+					return;
+				}
+
+				// Close to the end of the buffer.  Decode a padded copy, so a truncated block cannot be read past the end
+				uint8 padded[BlockCodec<Block>::maxSize];
+				size_t available = end - pos;
+				memset(padded, 0, sizeof(padded));
+				memcpy(padded, pos, available);
+				size_t used = BlockCodec<Block>::decode(block, padded, context) - padded;
+				if (used > available) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Block runs past the end of the script", "BlockReader::read");
+				}
+				pos += used;
+			}
+
+			/// Reads values stored as they are in memory
+			void readBytes(void* destination, size_t size) {
+				if (size > static_cast<size_t>(end - pos)) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Block runs past the end of the script", "BlockReader::readBytes");
+				}
+				memcpy(destination, pos, size);
+				pos += size;
+			}
+
+			template<typename T>
+			void readValue(T& value) {
+				readBytes(&value, sizeof(T));
+			}
+
+			/// Reads a string id written outside of a block, such as those of the object lists
+			ResourceID readString(const CodecContext& context) {
+				ResourceID id;
+				if (!context.compactStrings) {
+					readValue(id);
+					return id;
+				}
+				typedef FieldCodec<ResourceID, FE_Varint> Codec;
+				size_t available = std::min<size_t>(end - pos, Codec::maxSize);
+				size_t length = 0;
+				while (length < available && (pos[length] & 0x80)) {
+					length++;
+				}
+				if (length == available && available < static_cast<size_t>(Codec::maxSize)) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "String id runs past the end of the script", "BlockReader::readString");
+				}
+				pos = Codec::decode(id, pos, context);
+				return id;
+			}
+
+			/// The smallest number of bytes a string id written outside of a block takes
+			static size_t minStringSize(const CodecContext& context) {
+				return context.compactStrings ? 1 : sizeof(ResourceID);
+			}
+
+			void skip(size_t size) {
+				if (size > static_cast<size_t>(end - pos)) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Block runs past the end of the script", "BlockReader::skip");
+				}
+				pos += size;
+			}
+
+		private:
+			const uint8* begin;
+			const uint8* end;
+			const uint8* pos;
+			size_t base;
+		};
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "OgrePrerequisites.h"
+
+namespace Ogre {
+
+	/**
+	 * The modification times of a set of files, read with one directory listing per folder instead of a stat per file.
+	 * Files are requested first, then scan() lists each of their folders once.  Windows returns the times with the listing,
+	 * elsewhere only the requested files found in the listing are stat'ed, relative to the open folder
+	 */
+	class ScriptCacheFileTimes : public ScriptSerializerAlloc
+	{
+	public:
+		/// Queues a file of the folder for the next scan.  The name has no path.  Its time is later found by key
+		void request(const String& folder, const String& filename, const String& key);
+
+		/// Reads the times of the requested files
+		void scan();
+
+		/// False if the file was never requested.  Otherwise tells whether the scan found it, and when it was modified
+		bool find(const String& key, bool& exists, time_t& timestamp) const;
+
+		/// Records a change made to a file after the scan
+		void update(const String& key, bool exists, time_t timestamp);
+
+		void clear();
+
+	private:
+		struct FileTime {
+			bool exists;
+			time_t timestamp;
+		};
+		typedef map<String, FileTime>::type FileTimeMap;
+		FileTimeMap mTimes;
+
+		/// The requested files of each folder, by name within the folder, with their keys
+		typedef map<String, String>::type FileKeyMap;
+		typedef map<String, FileKeyMap>::type FolderMap;
+		FolderMap mRequests;
+
+		void scanFolder(const String& folder, const FileKeyMap& files);
+		static String foldName(const String& filename);
+	};
+
+}
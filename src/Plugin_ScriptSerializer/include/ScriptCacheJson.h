@@ -0,0 +1,28 @@
+#pragma once
+#include "OgrePrerequisites.h"
+#include <ostream>
+#include <cstdio>
+
+namespace Ogre {
+
+	/// Writes the string as a JSON string literal.  Inline, so the profiler and the inspector need not link the plugin
+	inline void writeJsonString(std::ostream& out, const String& value) {
+		out << '"';
+		for (String::const_iterator it = value.begin(); it != value.end(); ++it) {
+			unsigned char c = *it;
+			if (c == '"' || c == '\\') {
+				out << '\\' << c;
+			}
+			else if (c < 0x20) {
+				char escaped[8];
+				sprintf(escaped, "\\u%04x", c);
+				out << escaped;
+			}
+			else {
+				out << c;
+			}
+		}
+		out << '"';
+	}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "OgrePrerequisites.h"
+
+namespace Ogre {
+
+	/// The text parser and the binary decoder timed on the same script.  Times are the best of a few runs, in microseconds
+	struct ScriptComparison
+	{
+		String scriptName;
+		size_t textSize;
+		size_t binarySize;
+		size_t nodeCount;
+		unsigned long textTime;
+		unsigned long binaryTime;
+	};
+
+	/// One stage of the script cache pipeline over a resource group, see ScriptCachePipeline
+	struct ScriptPipelineStage
+	{
+		size_t scripts;				// Scripts the stage finished
+		unsigned long busyTime;		// Microseconds spent on them
+		unsigned long waitTime;		// Microseconds blocked on a full queue, or waiting for the next tree on the compile stage
+		size_t maxQueueDepth;		// Most scripts waiting in front of the stage at once
+	};
+
+	struct ScriptPipelineStats
+	{
+		enum Stage { PS_Read, PS_Decode, PS_Compile, PS_Write, PS_Count };
+
+		static const char* getStageName(size_t stage) {
+			static const char* names[PS_Count] = { "read", "decode", "compile", "write" };
+			return names[stage];
+		}
+
+		ScriptPipelineStage stages[PS_Count];
+		size_t dropped;				// Scripts read ahead that Ogre did not ask for in the expected order
+		unsigned long elapsedTime;	// Microseconds from the start of the group's scripting to its end
+	};
+
+	/**
+	 * Receives the stages the script cache goes through, for profiling.  Stages nest on each thread.
+	 * The thread is 0 for the thread firing the resource group events, otherwise the number of the worker thread,
+	 * and calls for different threads may arrive at the same time
+	 */
+	class ScriptCacheListener
+	{
+	public:
+		virtual ~ScriptCacheListener() { }
+
+		/// The cache starts handling a script, before choosing between its binary and its text version
+		virtual void scriptStarted(const String& scriptName) { }
+
+		/// The cache sets the script aside to compile the batched scripts before it.  scriptStarted follows once it carries on
+		virtual void scriptSuspended(const String& scriptName) { }
+
+		virtual void stageStarted(const char* stage, const String& detail, size_t thread) { }
+		virtual void stageEnded(const char* stage, size_t thread) { }
+
+		/// Return true to have each text script parsed and decoded both ways before it is handled normally.  Slow
+		virtual bool isComparingScripts() const { return false; }
+		virtual void scriptCompared(const ScriptComparison& comparison) { }
+
+		/// The number of scripts waiting in a queue of the pipeline changed.  Called from any thread
+		virtual void queueChanged(const char* queue, size_t depth) { }
+
+		/// The pipeline is done with the group's scripts.  The cache leaves logging the stats to the listener
+		virtual void pipelineFinished(const String& groupName, const ScriptPipelineStats& stats) { }
+	};
+
+	/// Reports a stage to the listener for the lifetime of the object.  Does nothing without a listener
+	class ScriptCacheStage
+	{
+	public:
+		ScriptCacheStage(ScriptCacheListener* listener, const char* stage, const String& detail, size_t thread = 0)
+			: listener(listener), stage(stage), thread(thread) {
+			if (listener) listener->stageStarted(stage, detail, thread);
+		}
+
+		~ScriptCacheStage() {
+			if (listener) listener->stageEnded(stage, thread);
+		}
+
+	private:
+		ScriptCacheListener* listener;
+		const char* stage;
+		size_t thread;
+	};
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "OgreDataStream.h"
+#include <map>
+
+namespace Ogre {
+
+	/** 
+	 * A single read-only file holding many binary scripts back to back.
+	 * The file is memory mapped, so every process that opens the same pack shares one copy
+	 * of its pages, and the streams returned by open() read straight from the mapping without copying.
+	 * The pack is never modified once built.  build() writes a new file and swaps it in place,
+	 * so processes that still map the old one keep working
+	 */
+	class ScriptCachePack : public ScriptSerializerAlloc
+	{
+	public:
+		ScriptCachePack();
+		~ScriptCachePack();
+
+		/// Maps the pack file into memory.  Returns false if the file does not exist or is not a valid pack
+		bool load(const String& filename);
+		void unload();
+		bool isLoaded() const { return mData != 0; }
+
+		bool exists(const String& name) const;
+
+		/// Names of every entry, in name order
+		StringVector getNames() const;
+
+		/// Names of every entry, in the order they are stored in the file
+		StringVector getLayout() const;
+
+		/** Returns a read-only stream over the named entry, or a null pointer if the pack does not contain it.
+		 * The stream references the mapping and must not outlive this pack
+		 */
+		DataStreamPtr open(const String& name) const;
+
+		/// Asks the OS to start paging in the named entry.  Returns false if the pack does not contain it
+		bool prefetch(const String& name) const;
+
+		/** Writes the given files of the archive into a new pack at filename.  Entries are stored in the order given */
+		static bool build(const String& filename, Archive* archive, const StringVector& names);
+
+	private:
+		struct PackEntry {
+			uint64 offset;
+			uint64 size;
+		};
+		typedef std::map<String, PackEntry> PackIndex;
+
+		bool readIndex();
+
+	private:
+		PackIndex mIndex;
+		uint8* mData;
+		size_t mSize;
+		void* mFileHandle;
+		void* mMappingHandle;
+	};
+
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "OgreScriptCompiler.h"
+#include "ScriptCacheListener.h"
+#include <deque>
+#include <set>
+
+namespace Ogre {
+
+	/**
+	 * Loads the cached scripts of a resource group in stages that run on threads of their own, so the stages of different
+	 * scripts overlap.  A read thread reads the cached files into memory and a decode thread turns them into trees, while
+	 * the thread firing the resource group events compiles the trees in script order.  Trees of newly parsed scripts go
+	 * the other way, to a write thread that serializes them behind the compiler.
+	 * The queues between the stages are bounded.  A stage that gets ahead waits for room, so the memory held by the
+	 * scripts in flight stays bounded however large the group is
+	 */
+	class ScriptCachePipeline : public ScriptSerializerAlloc
+	{
+	public:
+		/// The work of each stage.  Each function is called on its stage's thread only
+		class Stages
+		{
+		public:
+			virtual ~Stages() { }
+
+			/// Returns the cached script in memory, or a null pointer if it is missing or older than the script
+			virtual DataStreamPtr readScript(const String& binaryFilename, time_t scriptTimestamp, bool cached) = 0;
+			virtual AbstractNodeListPtr decodeScript(const DataStreamPtr& stream) = 0;
+			virtual void writeScript(const String& binaryFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) = 0;
+		};
+
+		/// The listener hears the stages of the read, decode and write threads under these thread numbers
+		enum { ReadThread = 100, DecodeThread, WriteThread };
+
+		ScriptCachePipeline(Stages* stages, size_t queueSize);
+		~ScriptCachePipeline();
+
+		void setListener(ScriptCacheListener* listener);
+
+		/// Queues a cached script to be read and decoded.  Scripts should be added in the order Ogre asks for them
+		void add(const String& binaryFilename, time_t scriptTimestamp, bool cached);
+
+		/**
+		 * Waits for the decoded tree of a script added before.  Returns a null pointer if the script was not added, its
+		 * cached version is stale or it failed to decode.  The scripts added before it and not taken yet are dropped
+		 */
+		AbstractNodeListPtr take(const String& binaryFilename);
+
+		/// Counts the time the caller spent compiling a tree it took
+		void compiled(unsigned long time);
+
+		/// Queues the tree of a newly parsed script to be written.  The tree must not be shared.  Waits while the queue is full
+		void write(const String& binaryFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast);
+
+		/// Returns the scripts written since the last call
+		StringVector takeWritten();
+
+		/// Drops the scripts not taken yet and waits until every queued tree is written.  The counters start again after this
+		void finish(ScriptPipelineStats& stats);
+
+	private:
+		struct ReadJob {
+			String binaryFilename;
+			time_t scriptTimestamp;
+			bool cached;
+		};
+
+		struct DecodeJob {
+			String binaryFilename;
+			DataStreamPtr stream;
+		};
+
+		struct DecodedScript {
+			String binaryFilename;
+			AbstractNodeListPtr ast;
+		};
+
+		struct WriteJob {
+			String binaryFilename;
+			size_t scriptTimestamp;
+			AbstractNodeListPtr ast;
+		};
+
+		struct ReadWorker;
+		struct DecodeWorker;
+		struct WriteWorker;
+
+		void runReader();
+		void runDecoder();
+		void runWriter();
+		void resetStats();
+		void queueChanged(const char* queue, size_t depth, size_t stage);
+
+	private:
+		Stages* mStages;
+		ScriptCacheListener* mListener;
+		size_t mQueueSize;
+		bool mStopping;
+
+		std::deque<ReadJob> mReadQueue;
+		std::deque<DecodeJob> mDecodeQueue;
+		std::deque<DecodedScript> mDecodedQueue;
+		std::deque<WriteJob> mWriteQueue;
+		StringVector mWritten;
+
+		/// Scripts added and not taken or dropped yet, so take() knows whether to wait
+		std::multiset<String> mPending;
+
+		/// Jobs a thread took off its queue and is still working on.  finish() waits for them
+		size_t mActiveJobs;
+		/// Bumped by finish().  A job read or decoded for an earlier group is dropped when its thread is done with it
+		size_t mGeneration;
+
+		ScriptPipelineStats mStats;
+		Timer mTimer;			// Started by the first script queued after finish()
+		bool mIdle;
+
+		OGRE_MUTEX(mMutex)
+		OGRE_THREAD_SYNCHRONISER(mCondition)
+#if OGRE_THREAD_SUPPORT
+		std::vector<OGRE_THREAD_TYPE*> mThreads;
+#endif
+	};
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "OgrePrerequisites.h"
+
+namespace Ogre {
+
+	/**
+	 * Gets the cached scripts of a resource group into memory ahead of the parser asking for them.
+	 * Where the OS takes read-ahead hints (posix_fadvise) the files are only hinted and the kernel reads them
+	 * in the background.  Elsewhere a background thread reads the files once so they end up in the file cache.
+	 * Without either, start() does nothing
+	 */
+	class ScriptCacheReadAhead : public ScriptSerializerAlloc
+	{
+	public:
+		ScriptCacheReadAhead();
+		~ScriptCacheReadAhead();
+
+		/// Starts reading the files in the background.  Waits for the files of the previous call first
+		void start(const StringVector& paths);
+
+		/// Waits until the background thread, if any, has read every file
+		void wait();
+
+	private:
+		struct Worker;
+
+		static void readFile(const String& path);
+
+	private:
+		StringVector mPaths;
+#if OGRE_THREAD_SUPPORT
+		OGRE_THREAD_TYPE* mThread;
+#endif
+	};
+
+}
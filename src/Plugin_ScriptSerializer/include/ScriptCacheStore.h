@@ -0,0 +1,40 @@
+#pragma once
+#include "OgrePrerequisites.h"
+
+namespace Ogre {
+
+	/**
+	 * A folder of cached scripts shared by every working copy of a user, or by a team when the folder is on a network share.
+	 * Entries are named after a hash of the script's name and text and of the binary format, so a script that is the same
+	 * on two branches finds the entry the other branch wrote.  Scripts that import are not shared, their tree depends on
+ * more than their text.  Entries are never modified.  They are written to a
+	 * temporary file first and renamed into place, so readers never see a partial entry
+	 */
+	class ScriptCacheStore : public ScriptSerializerAlloc
+	{
+	public:
+		ScriptCacheStore(const String& location);
+
+		/// The name of the entry for the script's name and text, cached in the given profile
+		static String makeKey(const String& scriptName, const String& text, bool releaseProfile);
+
+		/**
+		 * Copies the entry to the file at path, with the script's timestamp in its header so the copy is fresh
+		 * in the local cache.  Returns false if the store has no readable entry under the key
+		 */
+		bool fetch(const String& key, const String& path, size_t scriptTimestamp);
+
+		/// Adds the binary script at path under the key, unless the store has it already
+		void publish(const String& key, const String& path);
+
+		const String& getLocation() const { return mLocation; }
+
+	private:
+		String getEntryPath(const String& key) const;
+		static bool copyFile(const String& source, const String& destination);
+
+	private:
+		String mLocation;
+	};
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "OgrePrerequisites.h"
+
+namespace Ogre {
+
+	/**
+	 * Loops over the columns of a columnar segment, used to validate a segment before its tree is rebuilt.
+	 * Each kernel has a scalar version and, on x86, SSE2 and AVX2 versions.  The widest instruction set
+	 * the compiler and the processor both support is picked when the plugin is loaded
+	 */
+	namespace ColumnKernels {
+
+		enum InstructionSet {
+			IS_Scalar,
+			IS_SSE2,
+			IS_AVX2
+		};
+
+		/// Instruction set the kernels currently run with
+		InstructionSet getInstructionSet();
+
+		/// Restricts the kernels to the given instruction set, or the widest supported one below it
+		void setInstructionSet(InstructionSet set);
+
+		/// Checks if any of the values is equal to or above the limit
+		bool anyAtLeast(const uint32* values, size_t count, uint32 limit);
+
+		/// Counts the values equal to the given one
+		size_t countEqual(const uint8* values, size_t count, uint8 value);
+
+		/// Checks if every value lies within [low, high]
+		bool allInRange(const uint8* values, size_t count, uint8 low, uint8 high);
+
+		/// Adds up the values without overflowing
+		uint64 sum(const uint32* values, size_t count);
+	}
+
+}
@@ -7,13 +7,49 @@ namespace Ogre {
 	namespace ScriptBlock {
 		class StringTable;
 		struct BlockEntry;
+		struct NodeBlockEntry;
 		typedef std::list<BlockEntry*> BlockEntryList;
 		typedef std::stack<BlockEntry*> SerializeStack;
+		struct ScriptHeader;
+		struct SegmentEntry;
+		typedef std::vector<SegmentEntry> SegmentTable;
+		typedef std::vector<uint64> SegmentDependencies;
+		typedef std::vector<SegmentDependencies> SegmentDependencyList;
+		struct SharedSubtree;
+		struct SegmentWriter;
+		typedef std::vector<SegmentWriter*> SegmentWriterList;
+		struct ColumnView;
+		struct ScriptLayout;
+		struct ScriptBlockHeader;
+		struct CodecContext;
+		class BlockReader;
+
+		// The buffers sized by the script are counted as serializer memory
+		typedef vector<uint8, STLAllocator<uint8, ScriptSerializerAllocPolicy> >::type ByteBuffer;
+		typedef vector<uint32, STLAllocator<uint32, ScriptSerializerAllocPolicy> >::type ColumnBuffer;
 	}
+
+	class ScriptSerializerVisitor;
 	
 
 	class ScriptSerializer : public ScriptSerializerAlloc
 	{
+	public:
+		/// Counters describing the last serialize, deserialize or visit call
+		struct Statistics {
+			size_t stringCount;		// Unique strings in the string table
+			size_t stringBytes;		// Bytes of string data written to or read from the string table
+			size_t stringCopies;	// Strings copied out of the table or a shared subtree into nodes.  A string is moved into its last node instead of copied.  Visiting copies none
+			size_t segmentsWritten;	// Top level nodes encoded by the last serialize or update
+			size_t segmentsReused;	// Top level nodes left untouched in the file by the last update
+			size_t nodeBlocks;		// Node blocks written or read
+			size_t nodesShared;		// Nodes stored as, or restored from, a reference to an identical subtree
+			float dedupRatio;		// Fraction of all nodes covered by references
+			size_t referenceBytes;	// Bytes taken by the string references of the written segments
+			size_t referenceBytesSaved;	// Bytes of varint references saved by ordering the string ids by frequency
+			size_t fileSize;		// Bytes of the script after the last serialize or update.  An updated file is cut to this size by the caller
+		};
+
 	public:
 		ScriptSerializer(void);
 		~ScriptSerializer(void);
@@ -21,14 +57,121 @@ namespace Ogre {
 		void serialize(const DataStreamPtr& stream, const AbstractNodeListPtr& ast, size_t lastModifiedDate);
 		AbstractNodeListPtr deserialize(const DataStreamPtr& stream);
 
+		/**
+		 * Updates a binary script previously written by serialize. Every top level node is stored as a separate segment.
+		 * Segments whose subtrees did not change are left where they are, changed ones are appended and 
+		 * only the string and segment tables are written again.  The stream needs to be readable and writable, and
+		 * the file may end up shorter than before, so the caller cuts it to Statistics::fileSize.
+		 * Returns false when the stream does not hold a script this serializer can update, when most of the file 
+		 * would be left unused or a quarter of the string table would be strings no segment uses.  The script
+		 * should then be written again with serialize
+		 */
+		bool update(const DataStreamPtr& stream, const AbstractNodeListPtr& ast, size_t lastModifiedDate);
+
+		/**
+		 * Walks the binary script and reports its nodes to the visitor in depth-first order
+		 * without building an AST.  The strings handed to the visitor reference the string table
+		 * and stay valid until the next call on this serializer
+		 */
+		void visit(const DataStreamPtr& stream, ScriptSerializerVisitor& visitor);
+
+		/**
+		 * Reports where the bytes of a binary script go: the blocks by class and node type along with their sizes,
+		 * and every string of the string table with its reference count.  No node is decoded
+		 */
+		void describe(const DataStreamPtr& stream, ScriptBlock::ScriptLayout& layout);
+
+		const Statistics& getStatistics() const { return stats; }
+
+		/**
+		 * Sets the number of threads encoding the top level nodes of a script in serialize and update.
+		 * Zero uses every hardware thread.  The output is the same whatever the thread count.
+		 * Without thread support in Ogre the nodes are always encoded on the calling thread
+		 */
+		void setThreadCount(size_t count);
+
+		/**
+		 * Writes the segments of serialize and update column by column: the shape of the tree apart from columns of
+		 * node types, lines, ids and string ids.  The columns are validated with vector instructions when read, and the
+		 * tree is rebuilt in a single pass over the shape.  Repeated subtrees are not shared in this layout.
+		 * Scripts holding either layout are read whatever the setting
+		 */
+		void setColumnarLayout(bool enable) { columnarLayout = enable; }
+
+		/**
+		 * Writes scripts in the release profile of serialize and update: node lines are left out, and so are the base and
+		 * variable counts of objects without any.  Nodes read from such a script have no file name and line zero, so
+		 * errors found by the translators cannot point at the script text.  Scripts of either profile are read whatever the setting
+		 */
+		void setReleaseProfile(bool enable) { releaseProfile = enable; }
+
+		/**
+		 * Hands out the string ids of serialize by reference count once every segment is encoded, so the most referenced
+		 * strings get the smallest ids and lead the string table, and stores the string references as varints.
+		 * update keeps the ids of the file it continues, and writes the script again when the file was stored the other way.
+		 * The statistics report the bytes the string references take and how many the order saves.
+		 * Columnar segments keep their 32 bit string columns, so the setting has no effect with that layout
+		 */
+		void setFrequencyOrderedStrings(bool enable) { frequencyOrder = enable; }
+
+		/// Reports the work of each encoding thread to the listener.  May be null
+		void setListener(ScriptCacheListener* listener) { this->listener = listener; }
+
+		/// Checks if the header belongs to a binary script this serializer is able to read
+		static bool isSupported(const ScriptBlock::ScriptHeader& header);
+
+		/// The version of the binary format written by this serializer
+		static uint16 getFormatVersion();
 
 	private:
-		void writeBlock(const DataStreamPtr& stream, ScriptBlock::BlockEntry* entry);
-		void writeStackChildren(ScriptBlock::SerializeStack& s, AbstractNodeList& children, int transitionUserdata = 0);
+		typedef map<const AbstractNode*, uint64>::type NodeValueMap;
+		typedef map<const AbstractNode*, const AbstractNode*>::type NodeLinkMap;
+		typedef map<uint64, std::pair<const AbstractNode*, size_t> >::type HashedNodeMap;
+		typedef map<uint64, AbstractNode*>::type SharedNodeMap;
+		typedef map<const AbstractNode*, ScriptBlock::SharedSubtree>::type SharedSubtreeMap;
+
+		struct EncodeWorker;
+		friend struct EncodeWorker;
+
+		void writeBlock(ScriptBlock::SegmentWriter& writer, ScriptBlock::BlockEntry* entry);
+		void writeStackChildren(ScriptBlock::SerializeStack& s, AbstractNodeList& children, uint32 parentLine, int transitionUserdata = 0);
+		void writeSegments(const DataStreamPtr& stream, ScriptBlock::SegmentWriterList& writers, ScriptBlock::SegmentTable& segments, ScriptBlock::SegmentDependencyList& dependencies, bool reorderStrings, bool compactStrings);
+		void encodeSegments(ScriptBlock::SegmentWriterList& writers);
+		static void deleteWriters(ScriptBlock::SegmentWriterList& writers);
+		void encodeSegment(ScriptBlock::SegmentWriter& writer);
+		void encodeColumns(ScriptBlock::SegmentWriter& writer);
+		void writeTables(const DataStreamPtr& stream, ScriptBlock::ScriptHeader& header, ScriptBlock::SegmentTable& segments, const ScriptBlock::SegmentDependencyList& dependencies);
 		void writeStringTable(const DataStreamPtr& stream);
+		void writeSegmentTable(const DataStreamPtr& stream, const ScriptBlock::SegmentTable& segments, const ScriptBlock::SegmentDependencyList& dependencies);
 
-		ScriptBlock::BlockEntry* readBlock(const DataStreamPtr& stream);
+		void readHeader(const DataStreamPtr& stream, ScriptBlock::ScriptHeader& header);
 		void readStringTable(const DataStreamPtr& stream);
+		void readSegmentTable(const DataStreamPtr& stream, ScriptBlock::SegmentTable& segments, ScriptBlock::SegmentDependencies& dependencies);
+		void readSegment(const DataStreamPtr& stream, const ScriptBlock::SegmentEntry& segment, ScriptBlock::ByteBuffer& buffer, AbstractNodeList& trees, SharedNodeMap& sharedNodes);
+		void readColumnSegment(ScriptBlock::BlockReader& reader, const ScriptBlock::SegmentEntry& segment, const String& file, AbstractNodeList& trees);
+		void readColumns(ScriptBlock::BlockReader& reader, ScriptBlock::ColumnBuffer& buffer, ScriptBlock::ColumnView& view);
+		static void attachNode(AbstractNode* parent, int listType, const AbstractNodePtr& node, AbstractNodeList& trees);
+
+		/// Reads the given bytes of the stream into the buffer, so their blocks can be decoded from memory
+		ScriptBlock::BlockReader loadBlocks(const DataStreamPtr& stream, uint64 offset, uint64 size, ScriptBlock::ByteBuffer& buffer);
+
+		void writeReference(ScriptBlock::SegmentWriter& writer, ScriptBlock::NodeBlockEntry* entry, const AbstractNode* target);
+		void findSharedSubtrees(const AbstractNodePtr& node, size_t segment);
+		AbstractNode* cloneTree(const AbstractNode* node, AbstractNode* parent, int lineOffset);
+		void adjustClone(const AbstractNode* node, AbstractNode* clone, int lineOffset);
+		void visitNodes(ScriptBlock::BlockReader reader, size_t offset, uint32 baseLine, ScriptSerializerVisitor& visitor, bool singleNode);
+		void visitColumnSegment(ScriptBlock::BlockReader& reader, uint32 baseLine, ScriptSerializerVisitor& visitor);
+		void describeSegment(ScriptBlock::BlockReader& reader, const ScriptBlock::SegmentEntry& segment, ScriptBlock::ScriptLayout& layout);
+		void updateDedupRatio();
+
+		/**
+		 * Hashes the node's subtree.  The node's own line is left out and every line below it is taken
+		 * relative to its parent, so identical subtrees hash the same wherever they are in the script
+		 */
+		uint64 hashTree(const AbstractNodePtr& node);
+		static bool equalTrees(const AbstractNode* a, const AbstractNode* b, bool compareLines = true);
+		static bool equalLists(const AbstractNodeList& a, const AbstractNode* parentA, const AbstractNodeList& b, const AbstractNode* parentB, bool compareLines);
+		static size_t countNodes(const AbstractNode* node);
 
 		template<typename T> 
 		void writeToStream(const DataStreamPtr& stream, T& t);
@@ -36,9 +179,32 @@ namespace Ogre {
 		template<typename T> 
 		void readFromStream(const DataStreamPtr& stream, T& t);
 
+		/// Writes a block header and its block through their schemas, see ScriptBlockCodec.h
+		template<typename Block>
+		void writeBlockToStream(const DataStreamPtr& stream, const ScriptBlock::ScriptBlockHeader& header, const Block& block);
+
+		template<typename Block>
+		void readBlockFromStream(const DataStreamPtr& stream, Block& block);
+
+		/// The optional fields of the blocks of the script being read, for a block with the given flags
+		ScriptBlock::CodecContext readContext(uint8 blockFlags) const;
+
 	private:
 		uint32 blockIdCounter;
 		ScriptBlock::StringTable* stringTable;
+		Statistics stats;
+		size_t threadCount;
+		bool columnarLayout;
+		bool releaseProfile;
+		bool frequencyOrder;
+		bool debugInfo;			// Whether the script being read holds lines and file names
+		bool compactStrings;	// Whether the script being read stores its string references as varints
+		ScriptCacheListener* listener;
+
+		NodeValueMap subtreeHashes;		// Memoized results of hashTree
+		HashedNodeMap firstOccurrences;	// First object or property written with a given hash, along with its segment
+		NodeLinkMap duplicates;			// Subtrees written as references, mapped to the subtree they repeat
+		SharedSubtreeMap sharedSubtrees;	// Subtrees that are referenced, along with where they were written
 	};
 
 
@@ -47,7 +213,20 @@ namespace Ogre {
 		enum ScriptBlockType {
 			BC_Node			= 0x01,		// Block type containing the node data
 			BC_Transition	= 0x02,		// Block type containing the tree transition data
-			BC_StringTable	= 0x03
+			BC_StringTable	= 0x03,
+			BC_SegmentTable	= 0x04,		// Block type listing the top level segments of the script
+			BC_Reference	= 0x05,		// Block type repeating an earlier subtree.  The block type holds the node type
+			BC_Columns		= 0x06		// Block type holding a whole segment column by column.  See ColumnsBlock
+		};
+
+		enum ScriptBlockFlags {
+			BF_Shared		= 0x01,		// The node's subtree is repeated by reference blocks further on
+			BF_NoLists		= 0x02		// The object has no bases or variables.  Its block ends before their counts
+		};
+
+		enum ScriptFlags {
+			SF_Release			= 0x01,		// Written in the release profile.  Fields marked FP_Debug are left out of the blocks
+			SF_CompactStrings	= 0x02		// String references are stored as varints, see ScriptSerializer::setFrequencyOrderedStrings
 		};
 
 		enum TreeTransitionDirection {
@@ -60,12 +239,17 @@ namespace Ogre {
 		struct ScriptHeader {
 			uint32 magic;
 			uint16 version;
+			uint16 flags;			// ScriptFlags
 			size_t lastModifiedTime;
 			uint64 stringTableOffset;
+			uint64 segmentTableOffset;
 		};
 
 		struct ScriptBlockHeader {
+			ScriptBlockHeader() { memset(this, 0, sizeof(*this)); }
+
 			uint8 blockClass;
+			uint8 flags;
 			uint32 blockType;
 			uint32 blockID;
 		};
@@ -76,7 +260,7 @@ namespace Ogre {
 		};
 
 		struct AbstractNodeBlock {
-			uint32 lineNumber;
+			uint32 lineNumber;		// Stored relative to the parent node's line
 		};
 
 		struct AtomAbstractNodeBlock {
@@ -91,6 +275,11 @@ namespace Ogre {
 			uint32 id;
 		};
 		
+		struct ReferenceBlock {
+			AbstractNodeBlock nodeInfo;
+			uint64 target;			// Stream offset of the block header of the repeated node
+		};
+
 		struct StringTableBlock {
 			uint64 count;
 		};
@@ -99,6 +288,25 @@ namespace Ogre {
 			uint64 count;
 		};
 
+		struct SegmentTableBlock {
+			uint64 count;
+			uint64 dependencyCount;		// Segment offsets following the entries, listing what each segment references
+		};
+
+		/// A top level node and its subtree, stored contiguously in the file
+		struct SegmentEntry {
+			uint64 offset;
+			uint64 size;
+			uint64 hash;		// Hash of the subtree, independent of where it starts in the script
+			uint32 baseLine;	// Line of the top level node
+			uint32 dependencyCount;	// Number of other segments this one references subtrees from
+		};
+
+		struct SharedSubtree {
+			uint64 offset;		// Offset of the subtree's first block within its segment
+			uint64 segment;		// Index of the top level node holding it
+		};
+
 		struct ObjectAbstractNodeBlock {
 			AbstractNodeBlock nodeInfo;
 			ResourceID name;
@@ -115,16 +323,81 @@ namespace Ogre {
 			OATT_Overrides	= 0x03
 		};
 
-		struct BlockEntry : public ScriptCompilerAlloc {
+		/// Entries of the shape column of a columnar segment
+		enum ShapeCode {
+			SC_Node		= 0x00,		// The next node of the current list
+			SC_Up		= 0x01,		// Closes the current list
+			SC_Down		= 0x10		// Opens a list.  The low two bits hold the list's ObjectASNTransitionType
+		};
+
+		/**
+		 * A segment stored column by column in place of its node and transition blocks.  The columns follow the block:
+		 * the uint32 line (relative to the parent), id and string id of each node, where the string is the atom's value,
+		 * the property's name or the object's name; the uint32 class, base count and variable count of each object; 
+		 * the uint32 string ids of all bases and variable pairs; then the uint8 shape codes, node types and abstract flags
+		 */
+		struct ColumnsBlock {
+			uint32 nodeCount;
+			uint32 objectCount;
+			uint32 listCount;		// String ids of all bases and variables
+			uint32 shapeCount;
+		};
+
+		/// Columns of a segment being encoded
+		struct ColumnSet {
+			std::vector<uint32> lines;
+			std::vector<uint32> ids;
+			std::vector<ResourceID> strings;
+			std::vector<ResourceID> classes;
+			std::vector<uint32> baseCounts;
+			std::vector<uint32> variableCounts;
+			std::vector<ResourceID> lists;
+			std::vector<uint8> shape;
+			std::vector<uint8> types;
+			std::vector<uint8> abstract;
+		};
+
+		/// Columns of a segment read from disk, pointing into the read buffer
+		struct ColumnView {
+			ColumnsBlock counts;
+			const uint32* lines;
+			const uint32* ids;
+			const ResourceID* strings;		// Directly followed by the classes
+			const ResourceID* classes;
+			const uint32* baseCounts;
+			const uint32* variableCounts;
+			const ResourceID* lists;
+			const uint8* shape;
+			const uint8* types;
+			const uint8* abstract;
+		};
+
+		/// Where the bytes of a binary script go.  Block sizes include the block headers
+		struct ScriptLayout {
+			enum { BlockClassCount = BC_Columns + 1, NodeTypeCount = ANT_VARIABLE_ACCESS + 1 };
+
+			ScriptHeader header;
+			size_t fileSize;
+			size_t segmentCount;
+			size_t columnSegments;					// Segments stored column by column
+			size_t blockCounts[BlockClassCount];	// By ScriptBlockType
+			size_t blockBytes[BlockClassCount];
+			size_t nodeCounts[NodeTypeCount];		// Stored nodes by AbstractNodeType.  Nodes repeated by references are not counted again
+			size_t nodeBytes[NodeTypeCount];		// Node blocks only.  The nodes of columnar segments share the columns
+			std::vector<std::pair<String, uint32> > strings;	// Indexed by string id
+		};
+
+		struct BlockEntry : public ScriptSerializerAlloc {
 			int blockClass;
 		};
 
 		struct NodeBlockEntry : BlockEntry {
-			NodeBlockEntry(const AbstractNodePtr& node) : node(node) { 
+			NodeBlockEntry(const AbstractNodePtr& node, uint32 parentLine) : node(node), parentLine(parentLine) { 
 				blockClass = BC_Node;
 			}
 
 			const AbstractNodePtr& node;
+			uint32 parentLine;
 		};
 
 		struct TransitionBlockEntry : BlockEntry {
@@ -135,23 +408,165 @@ namespace Ogre {
 			uint32 userData;
 		};
 
-		class StringTable : public ScriptCompilerAlloc {
+		class StringTable : public ScriptSerializerAlloc {
 		public:
 			StringTable();
 			ResourceID registerString(const String& data);
-			void setKeyValue(ResourceID id, const String& data);
-			String getString(ResourceID id);
+			const String& getString(ResourceID id);
+
+			/// Every id below this one refers to a slot of the table
+			size_t getIdLimit() const { return strings.size(); }
+			uint32 getReferenceCount(ResourceID id);
+
+			/// Returns the empty slot for a string read from disk, so it can be filled in place
+			String& loadString(ResourceID id, uint32 references);
+
+			/// Rebuilds the lookup from strings to ids after loading, so more strings can be registered
+			void indexStrings();
+
+			/// Adds the strings and reference counts of another table.  remap receives the new id of each of its ids
+			void mergeStrings(const StringTable& other, std::vector<ResourceID>& remap);
+
+			/// Gives the most referenced strings the smallest ids, keeping the order of equally referenced ones.  remap receives the new id of each id
+			void orderByReferences(std::vector<ResourceID>& remap);
+
+			/** 
+			 * Hands the string over to one of the nodes referencing it.  The last reference receives the
+			 * table's own copy by swapping, every other reference gets a copy.  Returns true if the string was copied
+			 */
+			bool takeString(ResourceID id, String& destination);
 			void clear();
 
-			typedef std::map<ResourceID, String> ReverseLookupTable;
 			typedef std::map<String, ResourceID> ResourceTable;
 			ResourceTable& getTable() { return table; }
 
 		private:
-			ReverseLookupTable reverseLookup;
+			struct StringEntry {
+				String value;
+				uint32 references;
+			};
+			typedef std::vector<StringEntry> StringList;
+
+			StringEntry& getEntry(ResourceID id);
+
+		private:
+			StringList strings;		// Indexed by resource id
 			ResourceTable table;
 			int idCounter;
 		};
 
+		/**
+		 * Encodes one top level node into its own buffer, so several can be encoded at the same time.
+		 * Strings get ids from the writer's own table, which are swapped for the final ones when the segments are merged
+		 */
+		struct SegmentWriter : public ScriptSerializerAlloc {
+			struct StringFixup {
+				size_t position;
+				ResourceID id;
+			};
+			struct ReferenceFixup {
+				size_t position;
+				const AbstractNode* target;
+			};
+			typedef std::vector<StringFixup> StringFixupList;
+			typedef std::vector<ReferenceFixup> ReferenceFixupList;
+
+			SegmentWriter(const AbstractNodePtr& node, size_t index, uint64 hash, bool release) 
+				: node(node), index(index), blockIdCounter(0), nodeBlocks(0), nodesShared(0), release(release), offsetPosition(0) {
+				memset(&segment, 0, sizeof(segment));
+				segment.hash = hash;
+				segment.baseLine = node->line;
+			}
+
+			template<typename T>
+			void write(const T& t) {
+				const uint8* bytes = reinterpret_cast<const uint8*>(&t);
+				data.insert(data.end(), bytes, bytes + sizeof(T));
+			}
+
+			size_t tell() const { return data.size(); }
+
+			/// Writes a block header and its block through their schemas, see ScriptBlockCodec.h
+			template<typename Block>
+			void writeBlock(const ScriptBlockHeader& header, const Block& block);
+
+			/// Records a string id written by writeBlock, to be remapped once the segments are merged
+			void stringField(uint8* at, ResourceID id) {
+				StringFixup fixup = { static_cast<size_t>(at - &data[0]), id };
+				stringFixups.push_back(fixup);
+			}
+
+			/// Records the position of the offset written by writeBlock
+			void offsetField(uint8* at) { offsetPosition = at - &data[0]; }
+
+			template<typename T>
+			void writeColumn(const std::vector<T>& column) {
+				if (!column.empty()) {
+					const uint8* bytes = reinterpret_cast<const uint8*>(&column[0]);
+					data.insert(data.end(), bytes, bytes + column.size() * sizeof(T));
+				}
+			}
+
+			/// Writes a column of ids from the writer's string table, recording each one to be remapped
+			void writeStringColumn(const std::vector<ResourceID>& column) {
+				for (size_t i = 0; i < column.size(); i++) {
+					StringFixup fixup = { data.size() + i * sizeof(ResourceID), column[i] };
+					stringFixups.push_back(fixup);
+				}
+				writeColumn(column);
+			}
+
+			ResourceID registerString(const String& value, size_t position) {
+				StringFixup fixup = { position, strings.registerString(value) };
+				stringFixups.push_back(fixup);
+				return fixup.id;
+			}
+
+			/**
+			 * Stores the string ids of the fixups, once they hold the final ones, as varints.  The data shrinks, so the
+			 * positions recorded so far are moved along with their bytes
+			 */
+			void compactStrings();
+
+			/// Where a position taken before compactStrings lies now
+			size_t compactedPosition(size_t position) const;
+
+			AbstractNodePtr node;
+			size_t index;					// Position of the node in the script's root list
+			SegmentEntry segment;
+			ByteBuffer data;
+			StringTable strings;
+			StringFixupList stringFixups;
+			ReferenceFixupList referenceFixups;
+			std::set<size_t> referencedSegments;
+			uint32 blockIdCounter;
+			size_t nodeBlocks;
+			size_t nodesShared;
+			bool release;					// Leaves out the fields of the blocks marked FP_Debug
+			size_t offsetPosition;			// Position of the last offset field written
+			std::vector<std::pair<size_t, size_t> > compactedEnds;		// End of each string id before and after compactStrings
+		};
 	}
+
+
+	/** 
+	 * Receives the nodes of a binary script from ScriptSerializer::visit.
+	 * Returning false from enterObject or enterProperty skips the rest of that node's subtree;
+	 * the matching exit call is not made for a skipped node
+	 */
+	class ScriptSerializerVisitor
+	{
+	public:
+		virtual ~ScriptSerializerVisitor() { }
+
+		virtual bool enterObject(const String& cls, const String& name, const ScriptBlock::ObjectAbstractNodeBlock& block) { return true; }
+		virtual void objectBase(const String& base) { }
+		virtual void objectVariable(const String& key, const String& value) { }
+		virtual void exitObject() { }
+
+		virtual bool enterProperty(const String& name, const ScriptBlock::PropertyAbstractNodeBlock& block) { return true; }
+		virtual void exitProperty() { }
+
+		virtual void atom(const String& value, const ScriptBlock::AtomAbstractNodeBlock& block) { }
+	};
 }
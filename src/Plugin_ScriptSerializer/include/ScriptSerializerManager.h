@@ -26,31 +26,86 @@ namespace Ogre {
 
 		/// Interface ResourceGroupListener
 		virtual void scriptParseStarted(const String& scriptName, bool& skipThisScript);
-		virtual void scriptParseEnded(const String& scriptName, bool skipped) { }
+		virtual void scriptParseEnded(const String& scriptName, bool skipped);
 		virtual void resourceGroupScriptingStarted(const String& groupName, size_t scriptCount);
 		virtual void resourceGroupScriptingEnded(const String& groupName);
-		virtual void resourceGroupLoadStarted(const String& groupName, size_t resourceCount) { }
+		virtual void resourceGroupLoadStarted(const String& groupName, size_t resourceCount);
 		virtual void resourceLoadStarted(const ResourcePtr& resource) { }
         virtual void resourceLoadEnded(void) { }
         virtual void worldGeometryStageStarted(const String& description) { }
         virtual void worldGeometryStageEnded(void) { }
-        virtual void resourceGroupLoadEnded(const String& groupName) { }
+        virtual void resourceGroupLoadEnded(const String& groupName);
 
 
 		/// Interface ScriptCompilerListener
 		virtual bool postConversion(ScriptCompiler *compiler, const AbstractNodeListPtr&);
 		virtual void handleError(ScriptCompiler *compiler, uint32 code, const String &file, int line, const String &msg);
 		
+		/**
+		 * Removes the cached scripts whose text script is gone from the resource location it was last seen in, then the
+		 * least recently used ones until the cache folder fits the configured size.  Scripts whose location is not
+		 * registered at the time are not taken for gone.  Cached scripts that are resources themselves are always kept
+		 */
+		void collectGarbage();
+
+		/**
+		 * Reports the stages each script goes through to the listener.  May be null.
+		 * Virtual, so the profiler plugin can call it without linking against this one
+		 */
+		virtual void setCacheListener(ScriptCacheListener* listener);
+
+		/// The memory the serializer holds through its allocation policy, as of the call.  Virtual like setCacheListener
+		virtual ScriptSerializerMemoryStats getMemoryStats() const;
 
 	private:
+		struct ConversionCapture;
+		struct ParseJob;
+		struct ParseWorker;
+		struct PipelineStages;
+		struct MaterialCapture;
+		typedef vector<ParseJob>::type ParseJobList;
+
 		bool initializeArchive(const String& archiveName);
 		void initializeConfig(const String& configFileName);
 		void initializeShaderCache();
 		void saveShaderCache();
+		void initializePack();
+		void savePack();
+		void recordAccess(const String& filename);
+		void readAheadGroup(const String& groupName);
+		void scanFileTimes(const String& groupName);
+		time_t getScriptTimestamp(const String& scriptName);
+		bool cachedScriptExists(const String& filename);
+		void parseMissesAhead(const String& groupName);
+		void initializeStore();
+		const String& getStoreKey(const String& scriptName);
+		bool fetchFromStore(const String& scriptName, const String& binaryFilename, time_t scriptTimestamp);
+		void cacheParsedScript(const String& scriptName, size_t scriptTimestamp, const AbstractNodeListPtr& ast);
+		void scriptCached(const String& scriptName);
+		void startPipeline(const String& groupName);
+		void finishPipeline(const String& groupName);
+		void completeWrites();
+		DataStreamPtr readFreshScript(const String& filename, time_t scriptTimestamp, bool cached);
+		void loadUsage();
+		void saveUsage();
+		void touchScript(const String& filename);
+		void removeCachedScript(const String& filename);
 		bool isBinaryScript(const String& filename);
-		void saveAstToDisk(const String& filename, size_t scriptTimestamp, const AbstractNodeListPtr& ast);
-		AbstractNodeListPtr loadAstFromDisk(const String& filename);
-		time_t getBinaryTimeStamp(const String& filename);
+		bool isLocationRegistered(const String& filename);
+		void saveAstToDisk(const String& filename, size_t scriptTimestamp, const AbstractNodeListPtr& ast, size_t thread);
+		bool updateAstOnDisk(ScriptSerializer* serializer, const String& filename, size_t scriptTimestamp, const AbstractNodeListPtr& ast);
+		AbstractNodeListPtr loadAstFromDisk(const DataStreamPtr& stream);
+		DataStreamPtr openBinaryScript(const String& filename);
+		DataStreamPtr openFreshBinaryScript(const String& filename, time_t scriptTimestamp);
+		bool getBinaryTimeStamp(const DataStreamPtr& stream, time_t& timestamp);
+		void compileAst(const AbstractNodeListPtr& ast);
+		void compileCachedScript(const String& scriptName, const String& binaryFilename, time_t scriptTimestamp, const AbstractNodeListPtr& ast);
+		bool restoreMaterials(const String& scriptName, const String& stateFilename, time_t scriptTimestamp);
+		void queueMaterialCapture(const String& scriptName, const String& stateFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast);
+		void saveMaterialState(const MaterialCapture& capture);
+		void restorePendingMaterials();
+		void flushPendingAst();
+		void compareScript(const String& scriptName);
 
 	private:
 		ScriptCompiler* mCompiler;
@@ -61,7 +116,92 @@ namespace Ogre {
 		String binaryScriptExtension;
 		String scriptCacheLocation;
 		String shaderCacheFilename;
+		bool compressShaders;		// Store microcode compressed when that makes it smaller
+		String packFilename;
+		bool rebuildPack;
+		bool cacheModified;
 		bool pluginEnabled;
+		ScriptCachePack* mPack;
+
+		/// Cached scripts in the order they were first asked for this run.  The pack is rebuilt in this order
+		StringVector accessOrder;
+		std::set<String> accessedScripts;
+
+		/// Modification times of the group's scripts and of their cached versions, listed when its scripting starts
+		ScriptCacheFileTimes* mScriptTimes;
+		ScriptCacheFileTimes* mCacheTimes;
+
+		/// Loads the cached scripts of a group in the background when its scripting starts
+		ScriptCacheReadAhead* mReadAhead;
+		bool readAhead;
+		StringVector scriptExtensions;
+
+		/// Decoded trees kept in memory across resource group reloads.  Null when the budget is zero
+		ScriptAstCache* mAstCache;
+		size_t astCacheBudget;
+
+		/// Last time each cached script was loaded or written, kept in the cache folder between runs
+		typedef map<String, time_t>::type UsageMap;
+		UsageMap scriptUsage;
+		typedef map<String, String>::type LocationMap;
+		LocationMap scriptLocations;		// The resource location each script's text was last seen in
+		bool usageModified;
+		size_t maxCacheSize;
+		bool collectionPending;
+
+		ScriptCacheListener* mCacheListener;
+		String mCurrentScript;		// The script between its parse start and end events, if any
+
+		/// Cached trees waiting to be sent to the compiler in a single batch
+		AbstractNodeListPtr mPendingAst;
+		size_t pendingScriptCount;
+		size_t compileBatchSize;
+		bool batchCompile;
+
+		/// Threads encoding the top level objects of a script being cached. Zero uses all hardware threads
+		size_t encodeThreadCount;
+
+		/// Store newly cached scripts column by column, see ScriptSerializer::setColumnarLayout
+		bool columnarLayout;
+
+		/// Cache scripts without lines and file names, see ScriptSerializer::setReleaseProfile.  Scripts cached in the other profile are stale
+		bool releaseProfile;
+
+		/// Give the most referenced strings of newly cached scripts the smallest ids, see ScriptSerializer::setFrequencyOrderedStrings
+		bool frequencyOrder;
+
+		/// Threads parsing the text scripts missing from the cache when a group's scripting starts.  Zero uses all hardware threads
+		size_t parseThreadCount;
+		typedef map<String, AbstractNodeListPtr>::type ParsedAstMap;
+		ParsedAstMap mParsedAst;		// Trees parsed ahead, waiting for Ogre to reach their script
+
+		/// Reads, decodes and writes the group's cached scripts on threads of their own.  Null unless enabled
+		ScriptCachePipeline* mPipeline;
+		PipelineStages* mPipelineStages;
+		bool pipeline;
+		size_t pipelineQueueSize;
+
+		/// Cached scripts shared with other working copies, by the hash of their text.  Null without a location
+		ScriptCacheStore* mStore;
+		String storeLocation;
+		typedef map<String, String>::type StoreKeyMap;
+		StoreKeyMap mStoreKeys;		// Keys of the group's scripts, computed once per script
+
+		/// Save the materials the translators create and restore them instead of translating them again
+		bool materialState;
+		struct MaterialCapture {
+			String scriptName;
+			String stateFilename;
+			size_t scriptTimestamp;
+			StringVector materials;
+		};
+		MaterialCapture mMaterialCapture;		// The materials of the script being parsed, saved once it is translated
+		struct PendingRestore {
+			MaterialCapture capture;
+			AbstractNodeListPtr materials;
+		};
+		typedef vector<PendingRestore>::type PendingRestoreList;
+		PendingRestoreList mPendingRestores;		// Materials restored once the batch they may use programs of is compiled
 
 #ifdef USE_MICROCODE_SHADERCACHE
 		ShaderSerializer* mShaderSerializer;
@@ -2,8 +2,38 @@
 #include "OgreMemoryAllocatedObject.h"
 
 namespace Ogre {
-	typedef CategorisedAllocPolicy<Ogre::MEMCATEGORY_SCRIPTING> ScriptSerializerAllocPolicy;
-	typedef CategorisedAllocPolicy<Ogre::MEMCATEGORY_SCRIPTING> ScriptSerializerManagerAllocPolicy;
+
+	/// The memory held through the serializer's allocation policy
+	struct ScriptSerializerMemoryStats {
+		enum { HistogramBuckets = 12 };
+
+		size_t currentBytes;
+		size_t peakBytes;
+		size_t allocationCount;
+		size_t histogram[HistogramBuckets];		// Allocations of up to 16 << i bytes.  The last bucket also takes everything larger
+	};
+
+	/**
+	 * Allocates from the scripting category like the rest of the script compiler, and also counts the memory the serializer holds
+	 * so its footprint can be told apart from the compiler's.  The size of each block is kept in a small header in front of it
+	 */
+	class ScriptSerializerTrackingAllocPolicy
+	{
+	public:
+		static void* allocateBytes(size_t count, const char* file = 0, int line = 0, const char* func = 0);
+		static void deallocateBytes(void* ptr);
+		static size_t getMaxAllocationSize();
+
+		/// A copy of the counters.  Threads encoding, parsing and writing scripts update them meanwhile
+		static ScriptSerializerMemoryStats getStats();
+
+	private:
+		static ScriptSerializerMemoryStats stats;
+		OGRE_STATIC_MUTEX(statsMutex)
+	};
+
+	typedef ScriptSerializerTrackingAllocPolicy ScriptSerializerAllocPolicy;
+	typedef ScriptSerializerTrackingAllocPolicy ScriptSerializerManagerAllocPolicy;
 
 	typedef AllocatedObject<ScriptSerializerAllocPolicy> ScriptSerializerAllocatedObject;
 	typedef AllocatedObject<ScriptSerializerManagerAllocPolicy> ScriptSerializerManagerAllocatedObject;
@@ -24,6 +24,9 @@ namespace Ogre {
 		/// @copydoc Plugin::uninstall
 		void uninstall();
 
+		/// The manager caching the scripts, or null before the plugin is initialised
+		ScriptSerializerManager* getSerializerManager() const { return mSerializeManager; }
+
 	private:
 		ScriptSerializerManager* mSerializeManager;
 
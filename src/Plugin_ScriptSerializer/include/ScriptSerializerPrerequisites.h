@@ -6,6 +6,14 @@
 namespace Ogre
 {
 	// Predefine classes
+	class MaterialStateSerializer;
+	class ScriptAstCache;
+	class ScriptCacheFileTimes;
+	class ScriptCacheListener;
+	class ScriptCachePack;
+	class ScriptCachePipeline;
+	class ScriptCacheStore;
+	class ScriptCacheReadAhead;
 	class ScriptSerializer;
 	class ScriptSerializerManager;
 	class ScriptSerializerPlugin;
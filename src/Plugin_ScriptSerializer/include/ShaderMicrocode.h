@@ -0,0 +1,76 @@
+#pragma once
+#include "OgrePrerequisites.h"
+#include "OgreDataStream.h"
+
+
+#ifdef USE_MICROCODE_SHADERCACHE
+
+namespace Ogre {
+
+	typedef vector<uint8>::type MicrocodeBuffer;
+
+	/// Where the microcode of a program is kept in the shader cache file
+	struct ShaderCacheEntry {
+		uint64 offset;			// Position of the stored microcode in the file
+		uint32 size;
+		uint32 storedSize;		// Equals size if the microcode is stored uncompressed
+		bool loaded;
+	};
+	typedef map<String, ShaderCacheEntry>::type ShaderCacheIndex;
+
+	/**
+	 * Microcode is compressed with a byte oriented LZ77 in the block format of LZ4: a token holding the lengths of the
+	 * literals and of the match, the literals, and a 16 bit distance to the match.  Decoding it costs about as much as a copy
+	 */
+	namespace MicrocodeCodec {
+
+		/// Returns false if the microcode does not get smaller
+		bool compress(const uint8* in, size_t size, MicrocodeBuffer& out);
+
+		/// Returns false if the stored microcode does not decode to exactly size bytes
+		bool decompress(const uint8* in, size_t storedSize, uint8* out, size_t size);
+	}
+
+	/**
+	 * Receives the cache Ogre saves and keeps the microcode missing from the index.  The microcode already in the file is
+	 * skipped without being copied.  Ogre writes the number of programs, then the length and name and the length and
+	 * microcode of each one
+	 */
+	class MicrocodeCapture : public DataStream {
+	public:
+		typedef vector<std::pair<String, MicrocodeBuffer> >::type EntryList;
+
+		MicrocodeCapture(const ShaderCacheIndex& index);
+
+		size_t write(const void* buf, size_t count);
+		size_t read(void* buf, size_t count) { return 0; }
+		void skip(long count) { }
+		void seek(size_t pos) { }
+		size_t tell(void) const { return mPosition; }
+		bool eof(void) const { return false; }
+		void close(void) { }
+
+		EntryList& getEntries() { return mEntries; }
+
+	private:
+		enum Field { F_Count, F_NameLength, F_Name, F_CodeLength, F_Code };
+
+		void startField(Field field, size_t size, bool keep);
+		void completeField();
+		uint32 getLength() const;
+
+	private:
+		const ShaderCacheIndex& mIndex;
+		EntryList mEntries;
+		Field mField;
+		size_t mNeeded;
+		size_t mFilled;
+		bool mKeep;
+		MicrocodeBuffer mData;
+		String mName;
+		size_t mPosition;
+	};
+
+}
+
+#endif
@@ -1,22 +1,59 @@
 #pragma once
 #include "OgreScriptCompiler.h"
+#include "ShaderMicrocode.h"
 #include <stack>
+#include <fstream>
 
 
 #ifdef USE_MICROCODE_SHADERCACHE
 
 namespace Ogre {
 
-	/** Uses the Ogre's Microcode shader caching feature. */
+	/**
+	 * Keeps the microcode of Ogre's shader cache in a file of the cache folder.  Programs compiled since the last save
+	 * are appended to the file, compressed when that makes them smaller, and the file is not touched when there are none.
+	 * Only the index of the file is read at startup.  The microcode of a program is handed to Ogre once a script declared
+	 * the program, so the programs of groups that are never initialised are never read
+	 */
 	class ShaderSerializer : public ScriptSerializerAlloc
 	{
 	public:
-		ShaderSerializer();
+		ShaderSerializer(const String& filename, bool compress);
 		~ShaderSerializer();
 
 		void setCaching(bool cache);
-		void saveCache(const DataStreamPtr& stream);
-		void loadCache(const DataStreamPtr& stream);
+
+		/// Reads the index of the cache file.  A file in another format is replaced by the next save
+		void loadIndex();
+
+		/// Hands Ogre the cached microcode of the programs the group's scripts declared
+		void loadGroup(const String& groupName);
+
+		/**
+		 * Hands Ogre the cached microcode named after no program declared so far, such as that of linked GLSL programs.
+		 * Runs once.  The programs of groups declared later look unclaimed as well, so their microcode is read early
+		 * instead of with their group.  Ogre uses it either way
+		 */
+		void loadUnclaimed();
+
+		/// Appends the microcode Ogre compiled since the last save.  Returns the number of programs appended
+		size_t saveCache();
+
+	private:
+		typedef ShaderCacheEntry CacheEntry;
+		typedef ShaderCacheIndex CacheIndex;
+
+		void loadPrograms(ResourceManager::ResourceMapIterator programs, const String& groupName, const String& prefix, std::ifstream& file);
+		bool loadEntry(std::ifstream& file, const String& name, CacheEntry& entry);
+		static bool getRenderSystemPrefix(String& prefix);
+
+	private:
+		String mFilename;
+		bool mCompress;
+		CacheIndex mIndex;
+		uint64 mEnd;			// End of the last complete entry.  New entries are written from here
+		bool mRewrite;			// The file is missing or unreadable and is written from scratch
+		bool mUnclaimedLoaded;
 	};
 
 }
@@ -0,0 +1,818 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "MaterialStateSerializer.h"
+#include "OgreMaterialManager.h"
+#include "OgreTechnique.h"
+#include "OgrePass.h"
+#include "OgreTextureUnitState.h"
+#include "OgreTextureManager.h"
+#include "OgreGpuProgramParams.h"
+#include "OgreLodStrategyManager.h"
+
+namespace Ogre {
+
+	const uint32 materialStateMagicCode = ('M' | 'S' << 8 | 'T' << 16 | 'A' << 24 );
+	const uint32 materialStateVersion = 0x0002;
+
+	struct MaterialStateHeader {
+		uint32 magic;
+		uint32 version;
+		uint64 lastModifiedTime;
+		uint64 materialCount;
+	};
+
+	/// How a named program parameter is stored
+	enum ParameterKind {
+		PK_Auto,
+		PK_Float,
+		PK_Int
+	};
+
+	MaterialStateSerializer::MaterialStateSerializer() {
+	}
+
+	bool MaterialStateSerializer::isSaveable(const MaterialPtr& material, String& reason) {
+		for (unsigned short t = 0; t < material->getNumTechniques(); t++) {
+			Technique* technique = material->getTechnique(t);
+			for (unsigned short p = 0; p < technique->getNumPasses(); p++) {
+				Pass* pass = technique->getPass(p);
+				if (pass->hasShadowCasterVertexProgram() || pass->hasShadowCasterFragmentProgram() ||
+					pass->hasShadowReceiverVertexProgram() || pass->hasShadowReceiverFragmentProgram()) {
+					reason = "shadow programs";
+					return false;
+				}
+				if ((pass->hasVertexProgram() && !isSaveable(pass->getVertexProgramParameters())) ||
+					(pass->hasFragmentProgram() && !isSaveable(pass->getFragmentProgramParameters())) ||
+					(pass->hasGeometryProgram() && !isSaveable(pass->getGeometryProgramParameters()))) {
+					reason = "program parameters not set by name";
+					return false;
+				}
+
+				for (unsigned short u = 0; u < pass->getNumTextureUnitStates(); u++) {
+					TextureUnitState* unit = pass->getTextureUnitState(u);
+					const TextureUnitState::EffectMap& effects = unit->getEffects();
+					if (effects.find(TextureUnitState::ET_PROJECTIVE_TEXTURE) != effects.end()) {
+						reason = "projective texturing";
+						return false;
+					}
+
+					// The translators only name the textures, they are created when the material loads.  A texture that
+					// exists already was made in code, by a texture_source for one, and restoring would not make it again
+					for (unsigned int frame = 0; frame < unit->getNumFrames(); frame++) {
+						ResourcePtr texture = TextureManager::getSingleton().getByName(unit->getFrameTextureName(frame));
+						if (!texture.isNull() && texture->isManuallyLoaded()) {
+							reason = "texture created in code: " + texture->getName();
+							return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool MaterialStateSerializer::isSaveable(const GpuProgramParametersSharedPtr& params) {
+		if (params.isNull()) {
+			return true;
+		}
+		if (!params->getSharedParameters().empty()) {
+			return false;
+		}
+
+		// Programs without named parameters are fine as long as nothing was set on them
+		if (!params->hasNamedParameters()) {
+			return params->getFloatConstantList().empty() && params->getIntConstantList().empty() && !params->hasAutoConstants();
+		}
+
+		// param_indexed writes into a named parameter when its index is one.  A value at any other index has no name to be saved under
+		const GpuConstantDefinitionMap& constants = params->getConstantDefinitions().map;
+		if (!isCoveredByNames(params->getFloatLogicalBufferStruct(), constants, true) || !isCoveredByNames(params->getIntLogicalBufferStruct(), constants, false)) {
+			return false;
+		}
+
+		// The same goes for param_indexed_auto
+		size_t namedAutoConstants = 0;
+		for (GpuConstantDefinitionMap::const_iterator it = constants.begin(); it != constants.end(); ++it) {
+			const GpuConstantDefinition& definition = it->second;
+			if (it->first.find('[') == String::npos && (definition.isFloat() ?
+				params->_findRawAutoConstantEntryFloat(definition.physicalIndex) : params->_findRawAutoConstantEntryInt(definition.physicalIndex))) {
+				namedAutoConstants++;
+			}
+		}
+		return namedAutoConstants == params->getAutoConstantCount();
+	}
+
+	bool MaterialStateSerializer::isCoveredByNames(const GpuLogicalBufferStructPtr& buffer, const GpuConstantDefinitionMap& constants, bool isFloat) {
+		if (buffer.isNull()) {
+			return true;
+		}
+		for (GpuLogicalIndexUseMap::const_iterator use = buffer->map.begin(); use != buffer->map.end(); ++use) {
+			bool covered = false;
+			for (GpuConstantDefinitionMap::const_iterator it = constants.begin(); !covered && it != constants.end(); ++it) {
+				const GpuConstantDefinition& definition = it->second;
+				covered = definition.isFloat() == isFloat && use->second.physicalIndex >= definition.physicalIndex &&
+					use->second.physicalIndex + use->second.currentSize <= definition.physicalIndex + definition.elementSize * definition.arraySize;
+			}
+			if (!covered) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void MaterialStateSerializer::save(const DataStreamPtr& stream, const MaterialList& materials, size_t scriptTimestamp) {
+		mStream = stream;
+
+		MaterialStateHeader header;
+		header.magic = materialStateMagicCode;
+		header.version = materialStateVersion;
+		header.lastModifiedTime = scriptTimestamp;
+		header.materialCount = materials.size();
+		writeValue(header);
+
+		for (MaterialList::const_iterator it = materials.begin(); it != materials.end(); ++it) {
+			writeMaterial(*it);
+		}
+		mStream.setNull();
+	}
+
+	bool MaterialStateSerializer::load(const DataStreamPtr& stream, const String& groupName, const String& origin, size_t& count) {
+		mStream = stream;
+		MaterialManager& materialManager = MaterialManager::getSingleton();
+		StringVector created;
+		bool loaded = true;
+		try {
+			MaterialStateHeader header = readValue<MaterialStateHeader>();
+			if (header.magic != materialStateMagicCode || header.version != materialStateVersion) {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Material state is in another format: " + stream->getName(), "MaterialStateSerializer::load");
+			}
+
+			for (uint64 i = 0; i < header.materialCount; i++) {
+				String name = readString();
+				if (materialManager.resourceExists(name)) {
+					OGRE_EXCEPT(Exception::ERR_DUPLICATE_ITEM, "Material already exists: " + name, "MaterialStateSerializer::load");
+				}
+
+				// Created the way the material translator does
+				MaterialPtr material = materialManager.create(name, groupName);
+				created.push_back(name);
+				material->removeAllTechniques();
+				material->_notifyOrigin(origin);
+				readMaterial(material.get());
+			}
+		}
+		catch (Exception& e) {
+			LogManager::getSingleton().logMessage("Cannot restore the materials of " + origin + ": " + e.getDescription());
+			for (StringVector::iterator it = created.begin(); it != created.end(); ++it) {
+				materialManager.remove(*it);
+			}
+			created.clear();
+			loaded = false;
+		}
+
+		count = created.size();
+		mStream.setNull();
+		return loaded;
+	}
+
+	bool MaterialStateSerializer::readTimestamp(const DataStreamPtr& stream, time_t& timestamp) {
+		MaterialStateHeader header;
+		size_t bytesRead = stream->read(reinterpret_cast<char*>(&header), sizeof(header));
+		stream->seek(0);
+		if (bytesRead != sizeof(header) || header.magic != materialStateMagicCode || header.version != materialStateVersion) {
+			return false;
+		}
+		timestamp = static_cast<time_t>(header.lastModifiedTime);
+		return true;
+	}
+
+	void MaterialStateSerializer::writeMaterial(const MaterialPtr& material) {
+		writeString(material->getName());
+		writeValue<uint8>(material->getReceiveShadows());
+		writeValue<uint8>(material->getTransparencyCastsShadows());
+
+		// The strategy goes first, the levels given by the script are converted by it
+		writeString(material->getLodStrategy() ? material->getLodStrategy()->getName() : StringUtil::BLANK);
+		Material::LodValueList lodValues;
+		Material::LodValueIterator lodIterator = material->getUserLodValueIterator();
+		while (lodIterator.hasMoreElements()) {
+			lodValues.push_back(lodIterator.getNext());
+		}
+		writeValue<uint32>(lodValues.size());
+		for (Material::LodValueList::iterator it = lodValues.begin(); it != lodValues.end(); ++it) {
+			writeValue<float>(*it);
+		}
+
+		writeValue<uint16>(material->getNumTechniques());
+		for (unsigned short i = 0; i < material->getNumTechniques(); i++) {
+			writeTechnique(material->getTechnique(i));
+		}
+	}
+
+	void MaterialStateSerializer::writeTechnique(Technique* technique) {
+		writeString(technique->getName());
+		writeString(technique->getSchemeName());
+		writeValue<uint16>(technique->getLodIndex());
+		MaterialPtr caster = technique->getShadowCasterMaterial();
+		MaterialPtr receiver = technique->getShadowReceiverMaterial();
+		writeString(caster.isNull() ? StringUtil::BLANK : caster->getName());
+		writeString(receiver.isNull() ? StringUtil::BLANK : receiver->getName());
+
+		Technique::GPUVendorRuleList vendorRules;
+		Technique::GPUVendorRuleIterator vendorIterator = technique->getGPUVendorRuleIterator();
+		while (vendorIterator.hasMoreElements()) {
+			vendorRules.push_back(vendorIterator.getNext());
+		}
+		writeValue<uint32>(vendorRules.size());
+		for (Technique::GPUVendorRuleList::iterator it = vendorRules.begin(); it != vendorRules.end(); ++it) {
+			writeValue<uint32>(it->vendor);
+			writeValue<uint32>(it->includeOrExclude);
+		}
+
+		Technique::GPUDeviceNameRuleList deviceRules;
+		Technique::GPUDeviceNameRuleIterator deviceIterator = technique->getGPUDeviceNameRuleIterator();
+		while (deviceIterator.hasMoreElements()) {
+			deviceRules.push_back(deviceIterator.getNext());
+		}
+		writeValue<uint32>(deviceRules.size());
+		for (Technique::GPUDeviceNameRuleList::iterator it = deviceRules.begin(); it != deviceRules.end(); ++it) {
+			writeString(it->devicePattern);
+			writeValue<uint32>(it->includeOrExclude);
+			writeValue<uint8>(it->caseSensitive);
+		}
+
+		writeValue<uint16>(technique->getNumPasses());
+		for (unsigned short i = 0; i < technique->getNumPasses(); i++) {
+			writePass(technique->getPass(i));
+		}
+	}
+
+	void MaterialStateSerializer::writePass(Pass* pass) {
+		writeString(pass->getName());
+		writeColour(pass->getAmbient());
+		writeColour(pass->getDiffuse());
+		writeColour(pass->getSpecular());
+		writeColour(pass->getSelfIllumination());
+		writeValue<float>(pass->getShininess());
+		writeValue<uint32>(pass->getVertexColourTracking());
+
+		writeValue<uint32>(pass->getSourceBlendFactor());
+		writeValue<uint32>(pass->getDestBlendFactor());
+		writeValue<uint32>(pass->getSourceBlendFactorAlpha());
+		writeValue<uint32>(pass->getDestBlendFactorAlpha());
+		writeValue<uint8>(pass->hasSeparateSceneBlending());
+		writeValue<uint32>(pass->getSceneBlendingOperation());
+		writeValue<uint32>(pass->getSceneBlendingOperationAlpha());
+		writeValue<uint8>(pass->hasSeparateSceneBlendingOperations());
+
+		writeValue<uint8>(pass->getDepthCheckEnabled());
+		writeValue<uint8>(pass->getDepthWriteEnabled());
+		writeValue<uint32>(pass->getDepthFunction());
+		writeValue<float>(pass->getDepthBiasConstant());
+		writeValue<float>(pass->getDepthBiasSlopeScale());
+		writeValue<float>(pass->getIterationDepthBias());
+		writeValue<uint32>(pass->getAlphaRejectFunction());
+		writeValue<uint8>(pass->getAlphaRejectValue());
+		writeValue<uint8>(pass->isAlphaToCoverageEnabled());
+		writeValue<uint8>(pass->getTransparentSortingEnabled());
+		writeValue<uint8>(pass->getTransparentSortingForced());
+		writeValue<uint8>(pass->getColourWriteEnabled());
+		writeValue<uint32>(pass->getCullingMode());
+		writeValue<uint32>(pass->getManualCullingMode());
+
+		writeValue<uint8>(pass->getLightingEnabled());
+		writeValue<uint16>(pass->getMaxSimultaneousLights());
+		writeValue<uint16>(pass->getStartLight());
+		writeValue<uint8>(pass->getIteratePerLight());
+		writeValue<uint8>(pass->getRunOnlyForOneLightType());
+		writeValue<uint32>(pass->getOnlyLightType());
+		writeValue<uint16>(pass->getLightCountPerIteration());
+		writeValue<uint64>(pass->getPassIterationCount());
+		writeValue<uint8>(pass->getLightScissoringEnabled());
+		writeValue<uint8>(pass->getLightClipPlanesEnabled());
+		writeValue<uint32>(pass->getIlluminationStage());
+		writeValue<uint32>(pass->getLightMask());
+		writeValue<uint8>(pass->getNormaliseNormals());
+		writeValue<uint32>(pass->getShadingMode());
+		writeValue<uint32>(pass->getPolygonMode());
+		writeValue<uint8>(pass->getPolygonModeOverrideable());
+
+		writeValue<uint8>(pass->getFogOverride());
+		writeValue<uint32>(pass->getFogMode());
+		writeColour(pass->getFogColour());
+		writeValue<float>(pass->getFogDensity());
+		writeValue<float>(pass->getFogStart());
+		writeValue<float>(pass->getFogEnd());
+
+		writeValue<float>(pass->getPointSize());
+		writeValue<uint8>(pass->getPointSpritesEnabled());
+		writeValue<uint8>(pass->isPointAttenuationEnabled());
+		writeValue<float>(pass->getPointAttenuationConstant());
+		writeValue<float>(pass->getPointAttenuationLinear());
+		writeValue<float>(pass->getPointAttenuationQuadratic());
+		writeValue<float>(pass->getPointMinSize());
+		writeValue<float>(pass->getPointMaxSize());
+
+		writeProgram(pass->hasVertexProgram() ? pass->getVertexProgram() : GpuProgramPtr(),
+			pass->hasVertexProgram() ? pass->getVertexProgramParameters() : GpuProgramParametersSharedPtr());
+		writeProgram(pass->hasFragmentProgram() ? pass->getFragmentProgram() : GpuProgramPtr(),
+			pass->hasFragmentProgram() ? pass->getFragmentProgramParameters() : GpuProgramParametersSharedPtr());
+		writeProgram(pass->hasGeometryProgram() ? pass->getGeometryProgram() : GpuProgramPtr(),
+			pass->hasGeometryProgram() ? pass->getGeometryProgramParameters() : GpuProgramParametersSharedPtr());
+
+		writeValue<uint16>(pass->getNumTextureUnitStates());
+		for (unsigned short i = 0; i < pass->getNumTextureUnitStates(); i++) {
+			writeTextureUnit(pass->getTextureUnitState(i));
+		}
+	}
+
+	void MaterialStateSerializer::writeProgram(const GpuProgramPtr& program, const GpuProgramParametersSharedPtr& params) {
+		writeString(program.isNull() ? StringUtil::BLANK : program->getName());
+		if (program.isNull()) {
+			return;
+		}
+
+		writeValue<uint8>(params.isNull() ? false : params->getTransposeMatrices());
+		if (params.isNull() || !params->hasNamedParameters()) {
+			writeValue<uint32>(0);
+			return;
+		}
+
+		// Restoring sets the program first, which starts the parameters from its defaults as they are then.  Only the
+		// values the material changed are written, so the defaults may change without the material script.  Array
+		// elements are listed on their own as well, but their values are written with the whole array
+		GpuProgramParametersSharedPtr defaults = program->getDefaultParameters();
+		const GpuConstantDefinitionMap& constants = params->getConstantDefinitions().map;
+		vector<GpuConstantDefinitionMap::const_iterator>::type changed;
+		for (GpuConstantDefinitionMap::const_iterator it = constants.begin(); it != constants.end(); ++it) {
+			if (it->first.find('[') == String::npos && !isDefault(it->second, params, defaults)) {
+				changed.push_back(it);
+			}
+		}
+		writeValue<uint32>(changed.size());
+
+		for (size_t i = 0; i < changed.size(); i++) {
+			const GpuConstantDefinition& definition = changed[i]->second;
+			writeString(changed[i]->first);
+			GpuProgramParameters::AutoConstantEntry* autoConstant = definition.isFloat() ?
+				params->_findRawAutoConstantEntryFloat(definition.physicalIndex) : params->_findRawAutoConstantEntryInt(definition.physicalIndex);
+			if (autoConstant) {
+				writeValue<uint8>(PK_Auto);
+				writeValue<uint32>(autoConstant->paramType);
+				const GpuProgramParameters::AutoConstantDefinition* autoDefinition = GpuProgramParameters::getAutoConstantDefinition(autoConstant->paramType);
+				if (autoDefinition && autoDefinition->dataType == GpuProgramParameters::ACDT_REAL) {
+					writeValue<uint8>(true);
+					writeValue<float>(autoConstant->fData);
+				}
+				else {
+					writeValue<uint8>(false);
+					writeValue<uint64>(autoConstant->data);
+				}
+				continue;
+			}
+
+			uint32 size = static_cast<uint32>(definition.elementSize * definition.arraySize);
+			writeValue<uint8>(definition.isFloat() ? PK_Float : PK_Int);
+			writeValue(size);
+			if (definition.isFloat()) {
+				mStream->write(params->getFloatPointer(definition.physicalIndex), size * sizeof(float));
+			}
+			else {
+				mStream->write(params->getIntPointer(definition.physicalIndex), size * sizeof(int));
+			}
+		}
+	}
+
+	bool MaterialStateSerializer::isDefault(const GpuConstantDefinition& definition, const GpuProgramParametersSharedPtr& params, const GpuProgramParametersSharedPtr& defaults) {
+		if (defaults.isNull()) {
+			return false;
+		}
+
+		// The parameters are created from the defaults, so both have the same layout
+		GpuProgramParameters::AutoConstantEntry* autoConstant = definition.isFloat() ?
+			params->_findRawAutoConstantEntryFloat(definition.physicalIndex) : params->_findRawAutoConstantEntryInt(definition.physicalIndex);
+		GpuProgramParameters::AutoConstantEntry* defaultAutoConstant = definition.isFloat() ?
+			defaults->_findRawAutoConstantEntryFloat(definition.physicalIndex) : defaults->_findRawAutoConstantEntryInt(definition.physicalIndex);
+		if (autoConstant || defaultAutoConstant) {
+			return autoConstant && defaultAutoConstant && autoConstant->paramType == defaultAutoConstant->paramType &&
+				autoConstant->data == defaultAutoConstant->data && autoConstant->fData == defaultAutoConstant->fData;
+		}
+
+		size_t size = definition.elementSize * definition.arraySize;
+		if (definition.isFloat()) {
+			return !memcmp(params->getFloatPointer(definition.physicalIndex), defaults->getFloatPointer(definition.physicalIndex), size * sizeof(float));
+		}
+		return !memcmp(params->getIntPointer(definition.physicalIndex), defaults->getIntPointer(definition.physicalIndex), size * sizeof(int));
+	}
+
+	void MaterialStateSerializer::writeTextureUnit(TextureUnitState* unit) {
+		writeString(unit->getName());
+		writeString(unit->getTextureNameAlias());
+		writeValue<uint32>(unit->getTextureType());
+		writeValue<uint8>(unit->isCubic());
+		writeValue<uint32>(unit->getNumFrames());
+		for (unsigned int i = 0; i < unit->getNumFrames(); i++) {
+			writeString(unit->getFrameTextureName(i));
+		}
+		writeValue<float>(unit->getAnimationDuration());
+		writeValue<uint32>(unit->getCurrentFrame());
+		writeValue<int32>(unit->getNumMipmaps());
+		writeValue<uint8>(unit->getIsAlpha());
+		writeValue<uint32>(unit->getDesiredFormat());
+		writeValue<uint8>(unit->isHardwareGammaEnabled());
+
+		writeValue<uint32>(unit->getContentType());
+		writeString(unit->getReferencedCompositorName());
+		writeString(unit->getReferencedTextureName());
+		writeValue<uint64>(unit->getReferencedMRTIndex());
+		writeValue<uint32>(unit->getBindingType());
+
+		writeValue<uint32>(unit->getTextureCoordSet());
+		const TextureUnitState::UVWAddressingMode& addressing = unit->getTextureAddressingMode();
+		writeValue<uint32>(addressing.u);
+		writeValue<uint32>(addressing.v);
+		writeValue<uint32>(addressing.w);
+		writeColour(unit->getTextureBorderColour());
+		writeValue<uint32>(unit->getTextureFiltering(FT_MIN));
+		writeValue<uint32>(unit->getTextureFiltering(FT_MAG));
+		writeValue<uint32>(unit->getTextureFiltering(FT_MIP));
+		writeValue<uint32>(unit->getTextureAnisotropy());
+		writeValue<float>(unit->getTextureMipmapBias());
+
+		const LayerBlendModeEx& colourBlend = unit->getColourBlendMode();
+		writeValue<uint32>(colourBlend.operation);
+		writeValue<uint32>(colourBlend.source1);
+		writeValue<uint32>(colourBlend.source2);
+		writeColour(colourBlend.colourArg1);
+		writeColour(colourBlend.colourArg2);
+		writeValue<float>(colourBlend.factor);
+		const LayerBlendModeEx& alphaBlend = unit->getAlphaBlendMode();
+		writeValue<uint32>(alphaBlend.operation);
+		writeValue<uint32>(alphaBlend.source1);
+		writeValue<uint32>(alphaBlend.source2);
+		writeValue<float>(alphaBlend.alphaArg1);
+		writeValue<float>(alphaBlend.alphaArg2);
+		writeValue<float>(alphaBlend.factor);
+		writeValue<uint32>(unit->getColourBlendFallbackSrc());
+		writeValue<uint32>(unit->getColourBlendFallbackDest());
+
+		writeValue<float>(unit->getTextureUScroll());
+		writeValue<float>(unit->getTextureVScroll());
+		writeValue<float>(unit->getTextureUScale());
+		writeValue<float>(unit->getTextureVScale());
+		writeValue<float>(unit->getTextureRotate().valueRadians());
+
+		// The matrix is the one the values above make, unless the transform was set directly
+		const Matrix4& transform = unit->getTextureTransform();
+		for (size_t row = 0; row < 4; row++) {
+			for (size_t column = 0; column < 4; column++) {
+				writeValue<float>(transform[row][column]);
+			}
+		}
+
+		const TextureUnitState::EffectMap& effects = unit->getEffects();
+		writeValue<uint32>(effects.size());
+		for (TextureUnitState::EffectMap::const_iterator it = effects.begin(); it != effects.end(); ++it) {
+			const TextureUnitState::TextureEffect& effect = it->second;
+			writeValue<uint32>(effect.type);
+			writeValue<int32>(effect.subtype);
+			writeValue<float>(effect.arg1);
+			writeValue<float>(effect.arg2);
+			writeValue<uint32>(effect.waveType);
+			writeValue<float>(effect.base);
+			writeValue<float>(effect.frequency);
+			writeValue<float>(effect.phase);
+			writeValue<float>(effect.amplitude);
+		}
+	}
+
+	void MaterialStateSerializer::readMaterial(Material* material) {
+		material->setReceiveShadows(readValue<uint8>() != 0);
+		material->setTransparencyCastsShadows(readValue<uint8>() != 0);
+
+		String lodStrategy = readString();
+		if (!lodStrategy.empty()) {
+			material->setLodStrategy(LodStrategyManager::getSingleton().getStrategy(lodStrategy));
+		}
+		Material::LodValueList lodValues(readValue<uint32>());
+		for (Material::LodValueList::iterator it = lodValues.begin(); it != lodValues.end(); ++it) {
+			*it = readValue<float>();
+		}
+		if (!lodValues.empty()) {
+			material->setLodLevels(lodValues);
+		}
+
+		uint16 techniqueCount = readValue<uint16>();
+		for (uint16 i = 0; i < techniqueCount; i++) {
+			readTechnique(material->createTechnique());
+		}
+	}
+
+	void MaterialStateSerializer::readTechnique(Technique* technique) {
+		technique->setName(readString());
+		technique->setSchemeName(readString());
+		technique->setLodIndex(readValue<uint16>());
+		String caster = readString();
+		String receiver = readString();
+		if (!caster.empty()) {
+			technique->setShadowCasterMaterial(caster);
+		}
+		if (!receiver.empty()) {
+			technique->setShadowReceiverMaterial(receiver);
+		}
+
+		uint32 vendorRuleCount = readValue<uint32>();
+		for (uint32 i = 0; i < vendorRuleCount; i++) {
+			GPUVendor vendor = static_cast<GPUVendor>(readValue<uint32>());
+			technique->addGPUVendorRule(vendor, static_cast<Technique::IncludeOrExclude>(readValue<uint32>()));
+		}
+		uint32 deviceRuleCount = readValue<uint32>();
+		for (uint32 i = 0; i < deviceRuleCount; i++) {
+			String pattern = readString();
+			Technique::IncludeOrExclude includeOrExclude = static_cast<Technique::IncludeOrExclude>(readValue<uint32>());
+			technique->addGPUDeviceNameRule(pattern, includeOrExclude, readValue<uint8>() != 0);
+		}
+
+		uint16 passCount = readValue<uint16>();
+		for (uint16 i = 0; i < passCount; i++) {
+			readPass(technique->createPass());
+		}
+	}
+
+	void MaterialStateSerializer::readPass(Pass* pass) {
+		pass->setName(readString());
+		pass->setAmbient(readColour());
+		pass->setDiffuse(readColour());
+		pass->setSpecular(readColour());
+		pass->setSelfIllumination(readColour());
+		pass->setShininess(readValue<float>());
+		pass->setVertexColourTracking(static_cast<TrackVertexColourType>(readValue<uint32>()));
+
+		SceneBlendFactor source = static_cast<SceneBlendFactor>(readValue<uint32>());
+		SceneBlendFactor dest = static_cast<SceneBlendFactor>(readValue<uint32>());
+		SceneBlendFactor sourceAlpha = static_cast<SceneBlendFactor>(readValue<uint32>());
+		SceneBlendFactor destAlpha = static_cast<SceneBlendFactor>(readValue<uint32>());
+		if (readValue<uint8>()) {
+			pass->setSeparateSceneBlending(source, dest, sourceAlpha, destAlpha);
+		}
+		else {
+			pass->setSceneBlending(source, dest);
+		}
+		SceneBlendOperation operation = static_cast<SceneBlendOperation>(readValue<uint32>());
+		SceneBlendOperation alphaOperation = static_cast<SceneBlendOperation>(readValue<uint32>());
+		if (readValue<uint8>()) {
+			pass->setSeparateSceneBlendingOperation(operation, alphaOperation);
+		}
+		else {
+			pass->setSceneBlendingOperation(operation);
+		}
+
+		pass->setDepthCheckEnabled(readValue<uint8>() != 0);
+		pass->setDepthWriteEnabled(readValue<uint8>() != 0);
+		pass->setDepthFunction(static_cast<CompareFunction>(readValue<uint32>()));
+		float depthBias = readValue<float>();
+		pass->setDepthBias(depthBias, readValue<float>());
+		pass->setIterationDepthBias(readValue<float>());
+		CompareFunction alphaReject = static_cast<CompareFunction>(readValue<uint32>());
+		unsigned char alphaRejectValue = readValue<uint8>();
+		pass->setAlphaRejectSettings(alphaReject, alphaRejectValue, readValue<uint8>() != 0);
+		pass->setTransparentSortingEnabled(readValue<uint8>() != 0);
+		pass->setTransparentSortingForced(readValue<uint8>() != 0);
+		pass->setColourWriteEnabled(readValue<uint8>() != 0);
+		pass->setCullingMode(static_cast<CullingMode>(readValue<uint32>()));
+		pass->setManualCullingMode(static_cast<ManualCullingMode>(readValue<uint32>()));
+
+		pass->setLightingEnabled(readValue<uint8>() != 0);
+		pass->setMaxSimultaneousLights(readValue<uint16>());
+		pass->setStartLight(readValue<uint16>());
+		bool iteratePerLight = readValue<uint8>() != 0;
+		bool onlyOneLightType = readValue<uint8>() != 0;
+		pass->setIteratePerLight(iteratePerLight, onlyOneLightType, static_cast<Light::LightTypes>(readValue<uint32>()));
+		pass->setLightCountPerIteration(readValue<uint16>());
+		pass->setPassIterationCount(static_cast<size_t>(readValue<uint64>()));
+		pass->setLightScissoringEnabled(readValue<uint8>() != 0);
+		pass->setLightClipPlanesEnabled(readValue<uint8>() != 0);
+		pass->setIlluminationStage(static_cast<IlluminationStage>(readValue<uint32>()));
+		pass->setLightMask(readValue<uint32>());
+		pass->setNormaliseNormals(readValue<uint8>() != 0);
+		pass->setShadingMode(static_cast<ShadeOptions>(readValue<uint32>()));
+		pass->setPolygonMode(static_cast<PolygonMode>(readValue<uint32>()));
+		pass->setPolygonModeOverrideable(readValue<uint8>() != 0);
+
+		bool fogOverride = readValue<uint8>() != 0;
+		FogMode fogMode = static_cast<FogMode>(readValue<uint32>());
+		ColourValue fogColour = readColour();
+		float fogDensity = readValue<float>();
+		float fogStart = readValue<float>();
+		pass->setFog(fogOverride, fogMode, fogColour, fogDensity, fogStart, readValue<float>());
+
+		pass->setPointSize(readValue<float>());
+		pass->setPointSpritesEnabled(readValue<uint8>() != 0);
+		bool attenuation = readValue<uint8>() != 0;
+		float constant = readValue<float>();
+		float linear = readValue<float>();
+		pass->setPointAttenuation(attenuation, constant, linear, readValue<float>());
+		pass->setPointMinSize(readValue<float>());
+		pass->setPointMaxSize(readValue<float>());
+
+		readProgram(pass, &Pass::setVertexProgram, &Pass::getVertexProgramParameters);
+		readProgram(pass, &Pass::setFragmentProgram, &Pass::getFragmentProgramParameters);
+		readProgram(pass, &Pass::setGeometryProgram, &Pass::getGeometryProgramParameters);
+
+		uint16 unitCount = readValue<uint16>();
+		for (uint16 i = 0; i < unitCount; i++) {
+			readTextureUnit(pass->createTextureUnitState());
+		}
+	}
+
+	void MaterialStateSerializer::readProgram(Pass* pass, void (Pass::*setProgram)(const String&, bool), GpuProgramParametersSharedPtr (Pass::*getParameters)() const) {
+		String name = readString();
+		if (name.empty()) {
+			return;
+		}
+
+		(pass->*setProgram)(name, true);
+		GpuProgramParametersSharedPtr params = (pass->*getParameters)();
+		params->setTransposeMatrices(readValue<uint8>() != 0);
+
+		// A parameter the program no longer has throws, and the script is then translated instead
+		uint32 count = readValue<uint32>();
+		std::vector<float> floats;
+		std::vector<int> ints;
+		for (uint32 i = 0; i < count; i++) {
+			String parameter = readString();
+			uint8 kind = readValue<uint8>();
+			if (kind == PK_Auto) {
+				GpuProgramParameters::AutoConstantType type = static_cast<GpuProgramParameters::AutoConstantType>(readValue<uint32>());
+				if (readValue<uint8>()) {
+					params->setNamedAutoConstantReal(parameter, type, readValue<float>());
+				}
+				else {
+					params->setNamedAutoConstant(parameter, type, static_cast<size_t>(readValue<uint64>()));
+				}
+				continue;
+			}
+
+			uint32 size = readValue<uint32>();
+			if (kind == PK_Float) {
+				floats.resize(std::max<size_t>(size, 1));
+				readBytes(&floats[0], size * sizeof(float));
+				params->setNamedConstant(parameter, &floats[0], size, 1);
+			}
+			else {
+				ints.resize(std::max<size_t>(size, 1));
+				readBytes(&ints[0], size * sizeof(int));
+				params->setNamedConstant(parameter, &ints[0], size, 1);
+			}
+		}
+	}
+
+	void MaterialStateSerializer::readTextureUnit(TextureUnitState* unit) {
+		unit->setName(readString());
+		unit->setTextureNameAlias(readString());
+		TextureType type = static_cast<TextureType>(readValue<uint32>());
+		bool cubic = readValue<uint8>() != 0;
+		StringVector frames(readValue<uint32>());
+		for (StringVector::iterator it = frames.begin(); it != frames.end(); ++it) {
+			*it = readString();
+		}
+		float duration = readValue<float>();
+		uint32 currentFrame = readValue<uint32>();
+
+		// Separate cube faces are six frames, a single cube map or volume is one
+		if (cubic && frames.size() == 6) {
+			unit->setCubicTextureName(&frames[0], type == TEX_TYPE_CUBE_MAP);
+		}
+		else if (frames.size() > 1) {
+			unit->setAnimatedTextureName(&frames[0], static_cast<unsigned int>(frames.size()), duration);
+			unit->setCurrentFrame(currentFrame);
+		}
+		else if (frames.size() == 1) {
+			unit->setTextureName(frames[0], type);
+		}
+		unit->setNumMipmaps(readValue<int32>());
+		unit->setIsAlpha(readValue<uint8>() != 0);
+		unit->setDesiredFormat(static_cast<PixelFormat>(readValue<uint32>()));
+		unit->setHardwareGammaEnabled(readValue<uint8>() != 0);
+
+		// Setting a texture name makes the content named, so the content type comes after the textures
+		unit->setContentType(static_cast<TextureUnitState::ContentType>(readValue<uint32>()));
+		String compositor = readString();
+		String compositorTexture = readString();
+		size_t mrtIndex = static_cast<size_t>(readValue<uint64>());
+		if (!compositor.empty()) {
+			unit->setCompositorReference(compositor, compositorTexture, mrtIndex);
+		}
+		unit->setBindingType(static_cast<TextureUnitState::BindingType>(readValue<uint32>()));
+
+		unit->setTextureCoordSet(readValue<uint32>());
+		TextureUnitState::UVWAddressingMode addressing;
+		addressing.u = static_cast<TextureUnitState::TextureAddressingMode>(readValue<uint32>());
+		addressing.v = static_cast<TextureUnitState::TextureAddressingMode>(readValue<uint32>());
+		addressing.w = static_cast<TextureUnitState::TextureAddressingMode>(readValue<uint32>());
+		unit->setTextureAddressingMode(addressing);
+		unit->setTextureBorderColour(readColour());
+		FilterOptions minFilter = static_cast<FilterOptions>(readValue<uint32>());
+		FilterOptions magFilter = static_cast<FilterOptions>(readValue<uint32>());
+		unit->setTextureFiltering(minFilter, magFilter, static_cast<FilterOptions>(readValue<uint32>()));
+		unit->setTextureAnisotropy(readValue<uint32>());
+		unit->setTextureMipmapBias(readValue<float>());
+
+		LayerBlendOperationEx operation = static_cast<LayerBlendOperationEx>(readValue<uint32>());
+		LayerBlendSource source1 = static_cast<LayerBlendSource>(readValue<uint32>());
+		LayerBlendSource source2 = static_cast<LayerBlendSource>(readValue<uint32>());
+		ColourValue colourArg1 = readColour();
+		ColourValue colourArg2 = readColour();
+		unit->setColourOperationEx(operation, source1, source2, colourArg1, colourArg2, readValue<float>());
+		operation = static_cast<LayerBlendOperationEx>(readValue<uint32>());
+		source1 = static_cast<LayerBlendSource>(readValue<uint32>());
+		source2 = static_cast<LayerBlendSource>(readValue<uint32>());
+		float alphaArg1 = readValue<float>();
+		float alphaArg2 = readValue<float>();
+		unit->setAlphaOperation(operation, source1, source2, alphaArg1, alphaArg2, readValue<float>());
+		SceneBlendFactor fallbackSource = static_cast<SceneBlendFactor>(readValue<uint32>());
+		unit->setColourOpMultipassFallback(fallbackSource, static_cast<SceneBlendFactor>(readValue<uint32>()));
+
+		float uScroll = readValue<float>();
+		unit->setTextureScroll(uScroll, readValue<float>());
+		float uScale = readValue<float>();
+		unit->setTextureScale(uScale, readValue<float>());
+		unit->setTextureRotate(Radian(readValue<float>()));
+		Matrix4 transform;
+		for (size_t row = 0; row < 4; row++) {
+			for (size_t column = 0; column < 4; column++) {
+				transform[row][column] = readValue<float>();
+			}
+		}
+		unit->setTextureTransform(transform);
+
+		// The controllers of the effects are created when the material is loaded
+		uint32 effectCount = readValue<uint32>();
+		for (uint32 i = 0; i < effectCount; i++) {
+			TextureUnitState::TextureEffect effect;
+			effect.type = static_cast<TextureUnitState::TextureEffectType>(readValue<uint32>());
+			effect.subtype = readValue<int32>();
+			effect.arg1 = readValue<float>();
+			effect.arg2 = readValue<float>();
+			effect.waveType = static_cast<WaveformType>(readValue<uint32>());
+			effect.base = readValue<float>();
+			effect.frequency = readValue<float>();
+			effect.phase = readValue<float>();
+			effect.amplitude = readValue<float>();
+			effect.controller = 0;
+			effect.frustum = 0;
+			unit->addEffect(effect);
+		}
+	}
+
+	void MaterialStateSerializer::writeString(const String& value) {
+		uint32 length = static_cast<uint32>(value.length());
+		writeValue(length);
+		mStream->write(value.c_str(), length);
+	}
+
+	String MaterialStateSerializer::readString() {
+		uint32 length = readValue<uint32>();
+		String value(length, '\0');
+		if (length && mStream->read(&value[0], length) != length) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Material state is truncated: " + mStream->getName(), "MaterialStateSerializer::readString");
+		}
+		return value;
+	}
+
+	void MaterialStateSerializer::readBytes(void* data, size_t size) {
+		if (mStream->read(data, size) != size) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Material state is truncated: " + mStream->getName(), "MaterialStateSerializer::readBytes");
+		}
+	}
+
+	void MaterialStateSerializer::writeColour(const ColourValue& colour) {
+		writeValue<float>(colour.r);
+		writeValue<float>(colour.g);
+		writeValue<float>(colour.b);
+		writeValue<float>(colour.a);
+	}
+
+	ColourValue MaterialStateSerializer::readColour() {
+		ColourValue colour;
+		colour.r = readValue<float>();
+		colour.g = readValue<float>();
+		colour.b = readValue<float>();
+		colour.a = readValue<float>();
+		return colour;
+	}
+
+	template<typename T>
+	void MaterialStateSerializer::writeValue(const T& value) {
+		mStream->write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	T MaterialStateSerializer::readValue() {
+		T value;
+		if (mStream->read(reinterpret_cast<char*>(&value), sizeof(T)) != sizeof(T)) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Material state is truncated: " + mStream->getName(), "MaterialStateSerializer::readValue");
+		}
+		return value;
+	}
+
+}
@@ -0,0 +1,120 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptAstCache.h"
+
+namespace Ogre {
+
+	ScriptAstCache::ScriptAstCache(size_t budget) : mBudget(budget), mMemoryUsage(0), mHits(0), mMisses(0) {
+	}
+
+	AbstractNodeListPtr ScriptAstCache::find(const String& name, time_t timestamp) {
+		EntryMap::iterator it = mEntries.find(name);
+		if (it == mEntries.end()) {
+			mMisses++;
+			return AbstractNodeListPtr();
+		}
+
+		// The script was changed since the tree was made
+		if (timestamp > it->second.timestamp) {
+			remove(name);
+			mMisses++;
+			return AbstractNodeListPtr();
+		}
+
+		mUsage.splice(mUsage.begin(), mUsage, it->second.usage);
+		mHits++;
+		return copyTrees(*it->second.ast);
+	}
+
+	void ScriptAstCache::insert(const String& name, time_t timestamp, const AbstractNodeListPtr& ast) {
+		remove(name);
+
+		size_t size = 0;
+		for (AbstractNodeList::const_iterator it = ast->begin(); it != ast->end(); ++it) {
+			size += estimateSize(it->get());
+		}
+		if (size > mBudget) {
+			return;
+		}
+
+		// Make room by dropping the least recently used trees
+		while (mMemoryUsage + size > mBudget && !mUsage.empty()) {
+			String oldest = mUsage.back();
+			remove(oldest);
+		}
+
+		mUsage.push_front(name);
+		Entry& entry = mEntries[name];
+		entry.timestamp = timestamp;
+		entry.ast = copyTrees(*ast);
+		entry.size = size;
+		entry.usage = mUsage.begin();
+		mMemoryUsage += size;
+	}
+
+	bool ScriptAstCache::contains(const String& name, time_t timestamp) const {
+		EntryMap::const_iterator it = mEntries.find(name);
+		return it != mEntries.end() && timestamp <= it->second.timestamp;
+	}
+
+	void ScriptAstCache::remove(const String& name) {
+		EntryMap::iterator it = mEntries.find(name);
+		if (it != mEntries.end()) {
+			mMemoryUsage -= it->second.size;
+			mUsage.erase(it->second.usage);
+			mEntries.erase(it);
+		}
+	}
+
+	void ScriptAstCache::clear() {
+		mEntries.clear();
+		mUsage.clear();
+		mMemoryUsage = 0;
+	}
+
+	AbstractNodeListPtr ScriptAstCache::copyTrees(const AbstractNodeList& trees) {
+		AbstractNodeListPtr copy = AbstractNodeListPtr(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+		for (AbstractNodeList::const_iterator it = trees.begin(); it != trees.end(); ++it) {
+			copy->push_back(AbstractNodePtr((*it)->clone()));
+		}
+		return copy;
+	}
+
+	size_t ScriptAstCache::estimateSize(const AbstractNode* node) {
+		// The node, its strings and the list entry holding it.  Close enough to keep the budget meaningful
+		size_t size = node->file.capacity() + sizeof(AbstractNodePtr) + 2 * sizeof(void*);
+		const AbstractNodeList* lists[3] = { 0, 0, 0 };
+
+		if (node->type == ANT_ATOM) {
+			const AtomAbstractNode* atomNode = static_cast<const AtomAbstractNode*>(node);
+			size += sizeof(AtomAbstractNode) + atomNode->value.capacity();
+		}
+		else if (node->type == ANT_PROPERTY) {
+			const PropertyAbstractNode* propertyNode = static_cast<const PropertyAbstractNode*>(node);
+			size += sizeof(PropertyAbstractNode) + propertyNode->name.capacity();
+			lists[0] = &propertyNode->values;
+		}
+		else if (node->type == ANT_OBJECT) {
+			const ObjectAbstractNode* objectNode = static_cast<const ObjectAbstractNode*>(node);
+			size += sizeof(ObjectAbstractNode) + objectNode->name.capacity() + objectNode->cls.capacity();
+			size += objectNode->bases.capacity() * sizeof(String);
+			for (std::vector<String>::const_iterator it = objectNode->bases.begin(); it != objectNode->bases.end(); ++it) {
+				size += it->capacity();
+			}
+			const map<String, String>::type& variables = objectNode->getVariables();
+			for (map<String, String>::type::const_iterator it = variables.begin(); it != variables.end(); ++it) {
+				size += sizeof(*it) + 4 * sizeof(void*) + it->first.capacity() + it->second.capacity();
+			}
+			lists[0] = &objectNode->children;
+			lists[1] = &objectNode->values;
+			lists[2] = &objectNode->overrides;
+		}
+
+		for (size_t i = 0; i < 3 && lists[i]; i++) {
+			for (AbstractNodeList::const_iterator it = lists[i]->begin(); it != lists[i]->end(); ++it) {
+				size += estimateSize(it->get());
+			}
+		}
+		return size;
+	}
+
+}
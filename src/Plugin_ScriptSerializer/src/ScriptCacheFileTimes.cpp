@@ -0,0 +1,99 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptCacheFileTimes.h"
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <dirent.h>
+#	include <fcntl.h>
+#	include <sys/stat.h>
+#endif
+
+namespace Ogre {
+
+	void ScriptCacheFileTimes::request(const String& folder, const String& filename, const String& key) {
+		mRequests[folder][foldName(filename)] = key;
+
+		// Files the listing does not return are missing
+		FileTime& time = mTimes[key];
+		time.exists = false;
+		time.timestamp = 0;
+	}
+
+	void ScriptCacheFileTimes::scan() {
+		for (FolderMap::iterator it = mRequests.begin(); it != mRequests.end(); ++it) {
+			scanFolder(it->first, it->second);
+		}
+		mRequests.clear();
+	}
+
+	bool ScriptCacheFileTimes::find(const String& key, bool& exists, time_t& timestamp) const {
+		FileTimeMap::const_iterator it = mTimes.find(key);
+		if (it == mTimes.end()) {
+			return false;
+		}
+		exists = it->second.exists;
+		timestamp = it->second.timestamp;
+		return true;
+	}
+
+	void ScriptCacheFileTimes::update(const String& key, bool exists, time_t timestamp) {
+		FileTime& time = mTimes[key];
+		time.exists = exists;
+		time.timestamp = timestamp;
+	}
+
+	void ScriptCacheFileTimes::clear() {
+		mTimes.clear();
+		mRequests.clear();
+	}
+
+	void ScriptCacheFileTimes::scanFolder(const String& folder, const FileKeyMap& files) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		WIN32_FIND_DATAA entry;
+		HANDLE listing = FindFirstFileA((folder + "/*").c_str(), &entry);
+		if (listing == INVALID_HANDLE_VALUE) {
+			return;
+		}
+
+		do {
+			FileKeyMap::const_iterator file = files.find(foldName(entry.cFileName));
+			if (file != files.end() && !(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+				// FILETIME counts 100 ns intervals since 1601, time_t seconds since 1970
+				ULARGE_INTEGER writeTime;
+				writeTime.LowPart = entry.ftLastWriteTime.dwLowDateTime;
+				writeTime.HighPart = entry.ftLastWriteTime.dwHighDateTime;
+				update(file->second, true, static_cast<time_t>((writeTime.QuadPart - 116444736000000000ULL) / 10000000ULL));
+			}
+		} while (FindNextFileA(listing, &entry));
+		FindClose(listing);
+#else
+		DIR* listing = opendir(folder.c_str());
+		if (!listing) {
+			return;
+		}
+
+		while (struct dirent* entry = readdir(listing)) {
+			FileKeyMap::const_iterator file = files.find(entry->d_name);
+			struct stat info;
+			if (file != files.end() && fstatat(dirfd(listing), entry->d_name, &info, 0) == 0 && S_ISREG(info.st_mode)) {
+				update(file->second, true, info.st_mtime);
+			}
+		}
+		closedir(listing);
+#endif
+	}
+
+	String ScriptCacheFileTimes::foldName(const String& filename) {
+		// Windows file names ignore case
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		String folded = filename;
+		StringUtil::toLowerCase(folded);
+		return folded;
+#else
+		return filename;
+#endif
+	}
+
+}
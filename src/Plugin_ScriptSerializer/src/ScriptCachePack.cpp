@@ -0,0 +1,277 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptCachePack.h"
+#include <cstdio>
+#include <fstream>
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace Ogre {
+
+	const uint32 packMagicCode = ('S' | 'P' << 8 | 'A' << 16 | 'K' << 24 );
+	const uint32 packVersion = 0x0001;
+
+	struct PackHeader {
+		uint32 magic;
+		uint32 version;
+		uint64 entryCount;
+		uint64 indexOffset;
+	};
+
+	ScriptCachePack::ScriptCachePack() : mData(0), mSize(0), mFileHandle(0), mMappingHandle(0) {
+	}
+
+	ScriptCachePack::~ScriptCachePack() {
+		unload();
+	}
+
+	bool ScriptCachePack::load(const String& filename) {
+		unload();
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = 0;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+			mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		}
+		if (!mapping) {
+			CloseHandle(file);
+			return false;
+		}
+
+		mData = static_cast<uint8*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		mSize = static_cast<size_t>(fileSize.QuadPart);
+		mFileHandle = file;
+		mMappingHandle = mapping;
+#else
+		int file = ::open(filename.c_str(), O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+
+		struct stat fileInfo;
+		void* data = MAP_FAILED;
+		if (fstat(file, &fileInfo) == 0 && fileInfo.st_size > 0) {
+			data = mmap(0, fileInfo.st_size, PROT_READ, MAP_SHARED, file, 0);
+		}
+		// The mapping keeps its own reference to the file
+		::close(file);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		mData = static_cast<uint8*>(data);
+		mSize = static_cast<size_t>(fileInfo.st_size);
+#endif
+
+		if (!mData || !readIndex()) {
+			LogManager::getSingleton().logMessage("WARNING: Invalid script cache pack: " + filename);
+			unload();
+			return false;
+		}
+		return true;
+	}
+
+	void ScriptCachePack::unload() {
+		mIndex.clear();
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		if (mData) UnmapViewOfFile(mData);
+		if (mMappingHandle) CloseHandle(static_cast<HANDLE>(mMappingHandle));
+		if (mFileHandle) CloseHandle(static_cast<HANDLE>(mFileHandle));
+#else
+		if (mData) munmap(mData, mSize);
+#endif
+		mData = 0;
+		mSize = 0;
+		mFileHandle = 0;
+		mMappingHandle = 0;
+	}
+
+	bool ScriptCachePack::readIndex() {
+		if (mSize < sizeof(PackHeader)) {
+			return false;
+		}
+
+		PackHeader header;
+		memcpy(&header, mData, sizeof(header));
+		if (header.magic != packMagicCode || header.version != packVersion || header.indexOffset > mSize) {
+			return false;
+		}
+
+		const uint8* cursor = mData + header.indexOffset;
+		const uint8* end = mData + mSize;
+		for (uint64 i = 0; i < header.entryCount; i++) {
+			uint32 nameLength;
+			if (cursor + sizeof(nameLength) > end) return false;
+			memcpy(&nameLength, cursor, sizeof(nameLength));
+			cursor += sizeof(nameLength);
+
+			PackEntry entry;
+			if (cursor + nameLength + sizeof(entry) > end) return false;
+			String name(reinterpret_cast<const char*>(cursor), nameLength);
+			cursor += nameLength;
+			memcpy(&entry, cursor, sizeof(entry));
+			cursor += sizeof(entry);
+
+			if (entry.offset + entry.size > header.indexOffset) return false;
+			mIndex[name] = entry;
+		}
+		return true;
+	}
+
+	bool ScriptCachePack::exists(const String& name) const {
+		return mIndex.find(name) != mIndex.end();
+	}
+
+	StringVector ScriptCachePack::getNames() const {
+		StringVector names;
+		for (PackIndex::const_iterator it = mIndex.begin(); it != mIndex.end(); ++it) {
+			names.push_back(it->first);
+		}
+		return names;
+	}
+
+	StringVector ScriptCachePack::getLayout() const {
+		std::multimap<uint64, String> byOffset;
+		for (PackIndex::const_iterator it = mIndex.begin(); it != mIndex.end(); ++it) {
+			byOffset.insert(std::make_pair(it->second.offset, it->first));
+		}
+
+		StringVector names;
+		for (std::multimap<uint64, String>::const_iterator it = byOffset.begin(); it != byOffset.end(); ++it) {
+			names.push_back(it->second);
+		}
+		return names;
+	}
+
+	DataStreamPtr ScriptCachePack::open(const String& name) const {
+		PackIndex::const_iterator it = mIndex.find(name);
+		if (it == mIndex.end()) {
+			return DataStreamPtr();
+		}
+
+		const PackEntry& entry = it->second;
+		void* entryData = mData + entry.offset;
+		return DataStreamPtr(OGRE_NEW MemoryDataStream(name, entryData, static_cast<size_t>(entry.size), false, true));
+	}
+
+	bool ScriptCachePack::prefetch(const String& name) const {
+		PackIndex::const_iterator it = mIndex.find(name);
+		if (it == mIndex.end()) {
+			return false;
+		}
+
+		const PackEntry& entry = it->second;
+		if (entry.size == 0) {
+			return true;
+		}
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#	if _WIN32_WINNT >= 0x0602
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = mData + entry.offset;
+		range.NumberOfBytes = static_cast<SIZE_T>(entry.size);
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#	endif
+#else
+		// Hints work on whole pages.  The mapping itself starts on a page boundary
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t start = static_cast<size_t>(entry.offset) / pageSize * pageSize;
+		size_t end = static_cast<size_t>(entry.offset + entry.size);
+		madvise(mData + start, end - start, MADV_WILLNEED);
+#endif
+		return true;
+	}
+
+	bool ScriptCachePack::build(const String& filename, Archive* archive, const StringVector& names) {
+		String tempFilename = filename + ".tmp";
+		std::ofstream file(tempFilename.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file) {
+			LogManager::getSingleton().logMessage("WARNING: Cannot create script cache pack: " + tempFilename);
+			return false;
+		}
+
+		PackHeader header;
+		header.magic = packMagicCode;
+		header.version = packVersion;
+		header.entryCount = 0;
+		header.indexOffset = 0;		// Will be overwritten later
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		typedef std::vector<std::pair<String, PackEntry> > EntryList;
+		EntryList entries;
+		std::vector<char> buffer;
+		uint64 offset = sizeof(header);
+		for (StringVector::const_iterator it = names.begin(); it != names.end(); ++it) {
+			if (!archive->exists(*it)) {
+				continue;
+			}
+
+			DataStreamPtr stream = archive->open(*it);
+			buffer.resize(stream->size());
+			size_t size = buffer.empty() ? 0 : stream->read(&buffer[0], buffer.size());
+			stream->close();
+
+			// Keep every entry 8 byte aligned inside the mapping
+			uint64 padding = (8 - (size % 8)) % 8;
+			buffer.resize(size + static_cast<size_t>(padding), 0);
+			if (!buffer.empty()) {
+				file.write(&buffer[0], buffer.size());
+			}
+
+			PackEntry entry;
+			entry.offset = offset;
+			entry.size = size;
+			entries.push_back(std::make_pair(*it, entry));
+			offset += size + padding;
+		}
+
+		header.entryCount = entries.size();
+		header.indexOffset = offset;
+		for (EntryList::iterator it = entries.begin(); it != entries.end(); ++it) {
+			uint32 nameLength = static_cast<uint32>(it->first.length());
+			file.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+			file.write(it->first.c_str(), nameLength);
+			file.write(reinterpret_cast<const char*>(&it->second), sizeof(PackEntry));
+		}
+
+		// Re-write the header with the correct index offset
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.close();
+		if (file.fail()) {
+			remove(tempFilename.c_str());
+			return false;
+		}
+
+		// Swap the new pack in.  Processes that still map the old file keep their view of it
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		if (!MoveFileExA(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+		if (rename(tempFilename.c_str(), filename.c_str()) != 0) {
+#endif
+			LogManager::getSingleton().logMessage("WARNING: Cannot replace script cache pack: " + filename);
+			remove(tempFilename.c_str());
+			return false;
+		}
+
+		stringstream message;
+		message << "Script cache pack written: " << filename << " (" << entries.size() << " scripts)";
+		LogManager::getSingleton().logMessage(message.str());
+		return true;
+	}
+
+}
@@ -0,0 +1,311 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptCachePipeline.h"
+
+namespace Ogre {
+
+	struct ScriptCachePipeline::ReadWorker {
+		ReadWorker(ScriptCachePipeline* pipeline) : pipeline(pipeline) { }
+		void operator()() { pipeline->runReader(); }
+		ScriptCachePipeline* pipeline;
+	};
+
+	struct ScriptCachePipeline::DecodeWorker {
+		DecodeWorker(ScriptCachePipeline* pipeline) : pipeline(pipeline) { }
+		void operator()() { pipeline->runDecoder(); }
+		ScriptCachePipeline* pipeline;
+	};
+
+	struct ScriptCachePipeline::WriteWorker {
+		WriteWorker(ScriptCachePipeline* pipeline) : pipeline(pipeline) { }
+		void operator()() { pipeline->runWriter(); }
+		ScriptCachePipeline* pipeline;
+	};
+
+	ScriptCachePipeline::ScriptCachePipeline(Stages* stages, size_t queueSize)
+		: mStages(stages), mListener(0), mQueueSize(std::max<size_t>(queueSize, 1)), mStopping(false), mActiveJobs(0), mGeneration(0), mIdle(true) {
+		resetStats();
+#if OGRE_THREAD_SUPPORT
+		OGRE_THREAD_CREATE(reader, ReadWorker(this));
+		mThreads.push_back(reader);
+		OGRE_THREAD_CREATE(decoder, DecodeWorker(this));
+		mThreads.push_back(decoder);
+		OGRE_THREAD_CREATE(writer, WriteWorker(this));
+		mThreads.push_back(writer);
+#endif
+	}
+
+	ScriptCachePipeline::~ScriptCachePipeline() {
+		{
+			OGRE_LOCK_MUTEX(mMutex)
+			mStopping = true;
+			OGRE_THREAD_NOTIFY_ALL(mCondition)
+		}
+#if OGRE_THREAD_SUPPORT
+		// The writer empties its queue before it stops, the other threads drop theirs
+		for (size_t t = 0; t < mThreads.size(); t++) {
+			mThreads[t]->join();
+			OGRE_THREAD_DESTROY(mThreads[t]);
+		}
+#endif
+	}
+
+	void ScriptCachePipeline::setListener(ScriptCacheListener* listener) {
+		OGRE_LOCK_MUTEX(mMutex)
+		mListener = listener;
+	}
+
+	void ScriptCachePipeline::add(const String& binaryFilename, time_t scriptTimestamp, bool cached) {
+		OGRE_LOCK_MUTEX(mMutex)
+		if (mIdle) {
+			mTimer.reset();
+			mIdle = false;
+		}
+		ReadJob job = { binaryFilename, scriptTimestamp, cached };
+		mReadQueue.push_back(job);
+		mPending.insert(binaryFilename);
+		queueChanged("read", mReadQueue.size(), ScriptPipelineStats::PS_Read);
+		OGRE_THREAD_NOTIFY_ALL(mCondition)
+	}
+
+	AbstractNodeListPtr ScriptCachePipeline::take(const String& binaryFilename) {
+		OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+		if (mPending.find(binaryFilename) == mPending.end()) {
+			return AbstractNodeListPtr();
+		}
+
+		// The trees arrive in the order the scripts were added.  The ones before the script were skipped by Ogre
+		Timer timer;
+		for (;;) {
+			if (mDecodedQueue.empty()) {
+				OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+				continue;
+			}
+
+			DecodedScript script = mDecodedQueue.front();
+			mDecodedQueue.pop_front();
+			mPending.erase(mPending.find(script.binaryFilename));
+			queueChanged("compile", mDecodedQueue.size(), ScriptPipelineStats::PS_Compile);
+			OGRE_THREAD_NOTIFY_ALL(mCondition)
+			if (script.binaryFilename == binaryFilename) {
+				mStats.stages[ScriptPipelineStats::PS_Compile].waitTime += timer.getMicroseconds();
+				return script.ast;
+			}
+			mStats.dropped++;
+		}
+	}
+
+	void ScriptCachePipeline::compiled(unsigned long time) {
+		OGRE_LOCK_MUTEX(mMutex)
+		mStats.stages[ScriptPipelineStats::PS_Compile].scripts++;
+		mStats.stages[ScriptPipelineStats::PS_Compile].busyTime += time;
+	}
+
+	void ScriptCachePipeline::write(const String& binaryFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+		OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+		if (mIdle) {
+			mTimer.reset();
+			mIdle = false;
+		}
+
+		Timer timer;
+		while (mWriteQueue.size() >= mQueueSize) {
+			OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+		}
+		mStats.stages[ScriptPipelineStats::PS_Compile].waitTime += timer.getMicroseconds();
+
+		WriteJob job = { binaryFilename, scriptTimestamp, ast };
+		mWriteQueue.push_back(job);
+		queueChanged("write", mWriteQueue.size(), ScriptPipelineStats::PS_Write);
+		OGRE_THREAD_NOTIFY_ALL(mCondition)
+	}
+
+	StringVector ScriptCachePipeline::takeWritten() {
+		OGRE_LOCK_MUTEX(mMutex)
+		StringVector written;
+		written.swap(mWritten);
+		return written;
+	}
+
+	void ScriptCachePipeline::finish(ScriptPipelineStats& stats) {
+		OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+		mGeneration++;
+		mPending.clear();
+		mReadQueue.clear();
+		mDecodeQueue.clear();
+		mStats.dropped += mDecodedQueue.size();
+		mDecodedQueue.clear();
+		queueChanged("read", 0, ScriptPipelineStats::PS_Read);
+		queueChanged("decode", 0, ScriptPipelineStats::PS_Decode);
+		queueChanged("compile", 0, ScriptPipelineStats::PS_Compile);
+		OGRE_THREAD_NOTIFY_ALL(mCondition)
+
+		while (mActiveJobs || !mWriteQueue.empty()) {
+			OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+		}
+
+		mStats.elapsedTime = mIdle ? 0 : mTimer.getMicroseconds();
+		stats = mStats;
+		resetStats();
+		mIdle = true;
+	}
+
+	void ScriptCachePipeline::runReader() {
+		Timer timer;
+		for (;;) {
+			ReadJob job;
+			size_t generation;
+			{
+				// Nothing is read while the decoder is a queue behind, so only the queue's worth of files is held in memory
+				OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+				bool full = !mReadQueue.empty() && mDecodeQueue.size() >= mQueueSize;
+				unsigned long waitStart = timer.getMicroseconds();
+				while (!mStopping && (mReadQueue.empty() || mDecodeQueue.size() >= mQueueSize)) {
+					OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+				}
+				if (mStopping) {
+					return;
+				}
+				if (full) {
+					mStats.stages[ScriptPipelineStats::PS_Read].waitTime += timer.getMicroseconds() - waitStart;
+				}
+
+				job = mReadQueue.front();
+				mReadQueue.pop_front();
+				queueChanged("read", mReadQueue.size(), ScriptPipelineStats::PS_Read);
+				generation = mGeneration;
+				mActiveJobs++;
+			}
+
+			unsigned long start = timer.getMicroseconds();
+			DataStreamPtr stream;
+			try {
+				ScriptCacheStage stage(mListener, "read", job.binaryFilename, ReadThread);
+				stream = mStages->readScript(job.binaryFilename, job.scriptTimestamp, job.cached);
+			}
+			catch (Exception& e) {
+				LogManager::getSingleton().logMessage("WARNING: Cannot read cached script " + job.binaryFilename + ": " + e.getDescription());
+			}
+			unsigned long busyTime = timer.getMicroseconds() - start;
+
+			OGRE_LOCK_MUTEX(mMutex)
+			mActiveJobs--;
+			if (generation == mGeneration) {
+				mStats.stages[ScriptPipelineStats::PS_Read].scripts++;
+				mStats.stages[ScriptPipelineStats::PS_Read].busyTime += busyTime;
+
+				// A stale script still goes down the pipeline, so take() learns it has no tree
+				DecodeJob decodeJob = { job.binaryFilename, stream };
+				mDecodeQueue.push_back(decodeJob);
+				queueChanged("decode", mDecodeQueue.size(), ScriptPipelineStats::PS_Decode);
+			}
+			OGRE_THREAD_NOTIFY_ALL(mCondition)
+		}
+	}
+
+	void ScriptCachePipeline::runDecoder() {
+		Timer timer;
+		for (;;) {
+			DecodeJob job;
+			size_t generation;
+			{
+				OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+				bool full = !mDecodeQueue.empty() && mDecodedQueue.size() >= mQueueSize;
+				unsigned long waitStart = timer.getMicroseconds();
+				while (!mStopping && (mDecodeQueue.empty() || mDecodedQueue.size() >= mQueueSize)) {
+					OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+				}
+				if (mStopping) {
+					return;
+				}
+				if (full) {
+					mStats.stages[ScriptPipelineStats::PS_Decode].waitTime += timer.getMicroseconds() - waitStart;
+				}
+
+				job = mDecodeQueue.front();
+				mDecodeQueue.pop_front();
+				queueChanged("decode", mDecodeQueue.size(), ScriptPipelineStats::PS_Decode);
+				generation = mGeneration;
+				mActiveJobs++;
+			}
+
+			unsigned long start = timer.getMicroseconds();
+			AbstractNodeListPtr ast;
+			if (!job.stream.isNull()) {
+				try {
+					ScriptCacheStage stage(mListener, "decode", job.binaryFilename, DecodeThread);
+					ast = mStages->decodeScript(job.stream);
+				}
+				catch (Exception& e) {
+					LogManager::getSingleton().logMessage("WARNING: Cannot decode cached script " + job.binaryFilename + ": " + e.getDescription());
+				}
+				job.stream.setNull();
+			}
+			unsigned long busyTime = timer.getMicroseconds() - start;
+
+			OGRE_LOCK_MUTEX(mMutex)
+			mActiveJobs--;
+			if (generation == mGeneration) {
+				mStats.stages[ScriptPipelineStats::PS_Decode].scripts++;
+				mStats.stages[ScriptPipelineStats::PS_Decode].busyTime += busyTime;
+				DecodedScript script = { job.binaryFilename, ast };
+				mDecodedQueue.push_back(script);
+				queueChanged("compile", mDecodedQueue.size(), ScriptPipelineStats::PS_Compile);
+			}
+			OGRE_THREAD_NOTIFY_ALL(mCondition)
+		}
+	}
+
+	void ScriptCachePipeline::runWriter() {
+		Timer timer;
+		for (;;) {
+			WriteJob job;
+			{
+				OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+				while (!mStopping && mWriteQueue.empty()) {
+					OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+				}
+				if (mWriteQueue.empty()) {
+					return;
+				}
+				job = mWriteQueue.front();
+				mWriteQueue.pop_front();
+				queueChanged("write", mWriteQueue.size(), ScriptPipelineStats::PS_Write);
+				mActiveJobs++;
+			}
+
+			unsigned long start = timer.getMicroseconds();
+			bool written = false;
+			try {
+				mStages->writeScript(job.binaryFilename, job.scriptTimestamp, job.ast);
+				written = true;
+			}
+			catch (Exception& e) {
+				LogManager::getSingleton().logMessage("WARNING: Cannot cache script " + job.binaryFilename + ": " + e.getDescription());
+			}
+			job.ast.setNull();
+			unsigned long busyTime = timer.getMicroseconds() - start;
+
+			OGRE_LOCK_MUTEX(mMutex)
+			mActiveJobs--;
+			mStats.stages[ScriptPipelineStats::PS_Write].scripts++;
+			mStats.stages[ScriptPipelineStats::PS_Write].busyTime += busyTime;
+			if (written) {
+				mWritten.push_back(job.binaryFilename);
+			}
+			OGRE_THREAD_NOTIFY_ALL(mCondition)
+		}
+	}
+
+	void ScriptCachePipeline::resetStats() {
+		memset(&mStats, 0, sizeof(mStats));
+	}
+
+	void ScriptCachePipeline::queueChanged(const char* queue, size_t depth, size_t stage) {
+		// Called with the mutex held
+		mStats.stages[stage].maxQueueDepth = std::max(mStats.stages[stage].maxQueueDepth, depth);
+		if (mListener) {
+			mListener->queueChanged(queue, depth);
+		}
+	}
+
+}
@@ -0,0 +1,80 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptCacheReadAhead.h"
+#include <fstream>
+
+#if OGRE_PLATFORM != OGRE_PLATFORM_WIN32
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+// The kernel reads hinted files on its own, so no thread is needed where the hint exists
+#if defined(POSIX_FADV_WILLNEED)
+#	define SCRIPTCACHE_FADVISE
+#endif
+
+namespace Ogre {
+
+	/// Reads the queued files on the background thread
+	struct ScriptCacheReadAhead::Worker {
+		Worker(const StringVector* paths) : paths(paths) { }
+
+		void operator()() {
+			for (StringVector::const_iterator it = paths->begin(); it != paths->end(); ++it) {
+				ScriptCacheReadAhead::readFile(*it);
+			}
+		}
+
+		const StringVector* paths;
+	};
+
+	ScriptCacheReadAhead::ScriptCacheReadAhead() {
+#if OGRE_THREAD_SUPPORT
+		mThread = 0;
+#endif
+	}
+
+	ScriptCacheReadAhead::~ScriptCacheReadAhead() {
+		wait();
+	}
+
+	void ScriptCacheReadAhead::start(const StringVector& paths) {
+		wait();
+
+#ifdef SCRIPTCACHE_FADVISE
+		for (StringVector::const_iterator it = paths.begin(); it != paths.end(); ++it) {
+			int file = ::open(it->c_str(), O_RDONLY);
+			if (file >= 0) {
+				posix_fadvise(file, 0, 0, POSIX_FADV_WILLNEED);
+				::close(file);
+			}
+		}
+#elif OGRE_THREAD_SUPPORT
+		// The thread works on its own copy of the list, which is not touched again until it is joined
+		mPaths = paths;
+		if (!mPaths.empty()) {
+			OGRE_THREAD_CREATE(worker, Worker(&mPaths));
+			mThread = worker;
+		}
+#endif
+	}
+
+	void ScriptCacheReadAhead::wait() {
+#if OGRE_THREAD_SUPPORT
+		if (mThread) {
+			mThread->join();
+			OGRE_THREAD_DESTROY(mThread);
+			mThread = 0;
+		}
+#endif
+		mPaths.clear();
+	}
+
+	void ScriptCacheReadAhead::readFile(const String& path) {
+		// The data is thrown away.  Reading it is enough to get it into the file cache
+		std::ifstream file(path.c_str(), std::ios::binary);
+		std::vector<char> buffer(64 * 1024);
+		while (file.read(&buffer[0], buffer.size()) || file.gcount() > 0) {
+		}
+	}
+
+}
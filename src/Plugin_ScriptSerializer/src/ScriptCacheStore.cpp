@@ -0,0 +1,113 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptCacheStore.h"
+#include "ScriptSerializer.h"
+#include <fstream>
+#include <cstdio>
+#include <cstddef>
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#	define SCRIPTCACHE_PROCESS_ID() GetCurrentProcessId()
+#else
+#	include <unistd.h>
+#	define SCRIPTCACHE_PROCESS_ID() getpid()
+#endif
+
+namespace Ogre {
+
+	// 64 bit FNV-1a, as used for the subtree hashes of the serializer
+	const uint64 storeHashOffsetBasis = 14695981039346656037ULL;
+	const uint64 storeHashPrime = 1099511628211ULL;
+
+	static uint64 hashBytes(uint64 hash, const void* data, size_t size) {
+		const uint8* bytes = static_cast<const uint8*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * storeHashPrime;
+		}
+		return hash;
+	}
+
+	ScriptCacheStore::ScriptCacheStore(const String& location) : mLocation(location) {
+	}
+
+	String ScriptCacheStore::makeKey(const String& scriptName, const String& text, bool releaseProfile) {
+		// The nodes keep the name of their script, and the header layout depends on the size of size_t
+		uint16 version = ScriptSerializer::getFormatVersion();
+		uint8 sizeTypeSize = sizeof(size_t);
+		uint8 profile = releaseProfile ? 1 : 0;
+		uint64 hash = storeHashOffsetBasis;
+		hash = hashBytes(hash, &version, sizeof(version));
+		hash = hashBytes(hash, &sizeTypeSize, sizeof(sizeTypeSize));
+		hash = hashBytes(hash, &profile, sizeof(profile));
+		hash = hashBytes(hash, scriptName.c_str(), scriptName.length() + 1);
+		hash = hashBytes(hash, text.data(), text.length());
+
+		char key[17];
+		sprintf(key, "%08x%08x", static_cast<uint32>(hash >> 32), static_cast<uint32>(hash));
+		return key;
+	}
+
+	bool ScriptCacheStore::fetch(const String& key, const String& path, size_t scriptTimestamp) {
+		String entryPath = getEntryPath(key);
+		ScriptBlock::ScriptHeader header;
+		{
+			std::ifstream entry(entryPath.c_str(), std::ios::binary);
+			if (!entry || !entry.read(reinterpret_cast<char*>(&header), sizeof(header)) || !ScriptSerializer::isSupported(header)) {
+				return false;
+			}
+		}
+
+		if (!copyFile(entryPath, path)) {
+			return false;
+		}
+
+		// The entry keeps the timestamp of the working copy that wrote it
+		std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(offsetof(ScriptBlock::ScriptHeader, lastModifiedTime));
+		file.write(reinterpret_cast<const char*>(&scriptTimestamp), sizeof(scriptTimestamp));
+		file.close();
+		if (file.fail()) {
+			remove(path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void ScriptCacheStore::publish(const String& key, const String& path) {
+		String entryPath = getEntryPath(key);
+		if (std::ifstream(entryPath.c_str(), std::ios::binary)) {
+			return;
+		}
+
+		// Another process may publish the same entry at the same time.  Both write the same bytes, whichever rename wins
+		String tempPath = entryPath + "." + StringConverter::toString(static_cast<unsigned long>(SCRIPTCACHE_PROCESS_ID())) + ".tmp";
+		if (!copyFile(path, tempPath)) {
+			LogManager::getSingleton().logMessage("WARNING: Cannot write to the shared script cache: " + tempPath);
+			return;
+		}
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		if (!MoveFileExA(tempPath.c_str(), entryPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+		if (rename(tempPath.c_str(), entryPath.c_str()) != 0) {
+#endif
+			remove(tempPath.c_str());
+		}
+	}
+
+	String ScriptCacheStore::getEntryPath(const String& key) const {
+		return mLocation + "/" + key + ".sbin";
+	}
+
+	bool ScriptCacheStore::copyFile(const String& source, const String& destination) {
+		std::ifstream input(source.c_str(), std::ios::binary);
+		std::ofstream output(destination.c_str(), std::ios::binary | std::ios::trunc);
+		if (!input || !output) {
+			return false;
+		}
+		output << input.rdbuf();
+		output.close();
+		return !output.fail();
+	}
+
+}
@@ -0,0 +1,280 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptColumnKernels.h"
+#include <algorithm>
+
+// SSE2 is part of every x64 processor.  32 bit builds only use it when the compiler is allowed to
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define COLUMN_KERNELS_SSE2
+#	include <emmintrin.h>
+#endif
+
+// AVX2 is compiled into single functions and only called once the processor is known to support it
+#if defined(COLUMN_KERNELS_SSE2)
+#	if defined(_MSC_VER) && _MSC_VER >= 1700
+#		define COLUMN_KERNELS_AVX2
+#		define COLUMN_KERNELS_TARGET_AVX2
+#		include <immintrin.h>
+#		include <intrin.h>
+#	elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#		define COLUMN_KERNELS_AVX2
+#		define COLUMN_KERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#		include <immintrin.h>
+#	endif
+#endif
+
+namespace Ogre {
+namespace ColumnKernels {
+
+	static bool anyAtLeastScalar(const uint32* values, size_t count, uint32 limit) {
+		for (size_t i = 0; i < count; i++) {
+			if (values[i] >= limit) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static size_t countEqualScalar(const uint8* values, size_t count, uint8 value) {
+		size_t total = 0;
+		for (size_t i = 0; i < count; i++) {
+			total += values[i] == value;
+		}
+		return total;
+	}
+
+	static bool allInRangeScalar(const uint8* values, size_t count, uint8 low, uint8 high) {
+		for (size_t i = 0; i < count; i++) {
+			if (values[i] < low || values[i] > high) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static uint64 sumScalar(const uint32* values, size_t count) {
+		uint64 total = 0;
+		for (size_t i = 0; i < count; i++) {
+			total += values[i];
+		}
+		return total;
+	}
+
+#ifdef COLUMN_KERNELS_SSE2
+	static bool anyAtLeastSSE2(const uint32* values, size_t count, uint32 limit) {
+		if (limit == 0) {
+			return count != 0;
+		}
+
+		// SSE2 only compares signed integers.  Flipping the sign bit of both sides keeps the unsigned order
+		const __m128i signBit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+		const __m128i highest = _mm_set1_epi32(static_cast<int>((limit - 1) ^ 0x80000000u));
+		__m128i above = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), signBit);
+			above = _mm_or_si128(above, _mm_cmpgt_epi32(v, highest));
+		}
+		return _mm_movemask_epi8(above) != 0 || anyAtLeastScalar(values + i, count - i, limit);
+	}
+
+	static size_t countEqualSSE2(const uint8* values, size_t count, uint8 value) {
+		const __m128i target = _mm_set1_epi8(static_cast<char>(value));
+		const __m128i zero = _mm_setzero_si128();
+		size_t total = 0;
+		size_t i = 0;
+		size_t vectorEnd = count & ~size_t(15);
+		while (i < vectorEnd) {
+			// Every match subtracts all ones from a byte counter.  The counters are added up before they can wrap
+			__m128i counters = _mm_setzero_si128();
+			size_t end = std::min(vectorEnd, i + 255 * 16);
+			for (; i < end; i += 16) {
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+				counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(v, target));
+			}
+			__m128i sums = _mm_sad_epu8(counters, zero);
+			total += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+		}
+		return total + countEqualScalar(values + i, count - i, value);
+	}
+
+	static bool allInRangeSSE2(const uint8* values, size_t count, uint8 low, uint8 high) {
+		// A byte lies within the range if subtracting low, wrapping around, leaves at most high - low
+		const __m128i lowest = _mm_set1_epi8(static_cast<char>(low));
+		const __m128i span = _mm_set1_epi8(static_cast<char>(high - low));
+		__m128i inside = _mm_set1_epi8(-1);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m128i v = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), lowest);
+			inside = _mm_and_si128(inside, _mm_cmpeq_epi8(_mm_max_epu8(v, span), span));
+		}
+		return _mm_movemask_epi8(inside) == 0xFFFF && allInRangeScalar(values + i, count - i, low, high);
+	}
+
+	static uint64 sumSSE2(const uint32* values, size_t count) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i totals = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+			totals = _mm_add_epi64(totals, _mm_unpacklo_epi32(v, zero));
+			totals = _mm_add_epi64(totals, _mm_unpackhi_epi32(v, zero));
+		}
+		uint64 lanes[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), totals);
+		return lanes[0] + lanes[1] + sumScalar(values + i, count - i);
+	}
+#endif
+
+#ifdef COLUMN_KERNELS_AVX2
+	COLUMN_KERNELS_TARGET_AVX2 static bool anyAtLeastAVX2(const uint32* values, size_t count, uint32 limit) {
+		if (limit == 0) {
+			return count != 0;
+		}
+
+		// AVX2 has an unsigned maximum, so only the largest value needs to be compared with the limit
+		const __m256i highest = _mm256_set1_epi32(static_cast<int>(limit - 1));
+		__m256i largest = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			largest = _mm256_max_epu32(largest, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+		}
+		__m256i within = _mm256_cmpeq_epi32(_mm256_max_epu32(largest, highest), highest);
+		return _mm256_movemask_epi8(within) != -1 || anyAtLeastScalar(values + i, count - i, limit);
+	}
+
+	COLUMN_KERNELS_TARGET_AVX2 static size_t countEqualAVX2(const uint8* values, size_t count, uint8 value) {
+		const __m256i target = _mm256_set1_epi8(static_cast<char>(value));
+		const __m256i zero = _mm256_setzero_si256();
+		size_t total = 0;
+		size_t i = 0;
+		size_t vectorEnd = count & ~size_t(31);
+		while (i < vectorEnd) {
+			__m256i counters = _mm256_setzero_si256();
+			size_t end = std::min(vectorEnd, i + 255 * 32);
+			for (; i < end; i += 32) {
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+				counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(v, target));
+			}
+			__m256i sums = _mm256_sad_epu8(counters, zero);
+			__m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+			total += _mm_cvtsi128_si32(halves) + _mm_cvtsi128_si32(_mm_srli_si128(halves, 8));
+		}
+		return total + countEqualScalar(values + i, count - i, value);
+	}
+
+	COLUMN_KERNELS_TARGET_AVX2 static bool allInRangeAVX2(const uint8* values, size_t count, uint8 low, uint8 high) {
+		const __m256i lowest = _mm256_set1_epi8(static_cast<char>(low));
+		const __m256i span = _mm256_set1_epi8(static_cast<char>(high - low));
+		__m256i inside = _mm256_set1_epi8(-1);
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32) {
+			__m256i v = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)), lowest);
+			inside = _mm256_and_si256(inside, _mm256_cmpeq_epi8(_mm256_max_epu8(v, span), span));
+		}
+		return _mm256_movemask_epi8(inside) == -1 && allInRangeScalar(values + i, count - i, low, high);
+	}
+
+	COLUMN_KERNELS_TARGET_AVX2 static uint64 sumAVX2(const uint32* values, size_t count) {
+		__m256i totals = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			totals = _mm256_add_epi64(totals, _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i))));
+			totals = _mm256_add_epi64(totals, _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 4))));
+		}
+		uint64 lanes[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), totals);
+		return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumScalar(values + i, count - i);
+	}
+
+	static bool processorHasAVX2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+
+		// The processor needs to support AVX and the OS needs to save the YMM registers
+		const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+		__cpuid(info, 1);
+		if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+
+	static InstructionSet detectInstructionSet() {
+#ifdef COLUMN_KERNELS_AVX2
+		if (processorHasAVX2()) {
+			return IS_AVX2;
+		}
+#endif
+#ifdef COLUMN_KERNELS_SSE2
+		return IS_SSE2;
+#else
+		return IS_Scalar;
+#endif
+	}
+
+	static const InstructionSet supportedSet = detectInstructionSet();
+	static InstructionSet activeSet = supportedSet;
+
+	InstructionSet getInstructionSet() {
+		return activeSet;
+	}
+
+	void setInstructionSet(InstructionSet set) {
+		activeSet = std::min(set, supportedSet);
+	}
+
+	bool anyAtLeast(const uint32* values, size_t count, uint32 limit) {
+#ifdef COLUMN_KERNELS_AVX2
+		if (activeSet == IS_AVX2) return anyAtLeastAVX2(values, count, limit);
+#endif
+#ifdef COLUMN_KERNELS_SSE2
+		if (activeSet >= IS_SSE2) return anyAtLeastSSE2(values, count, limit);
+#endif
+		return anyAtLeastScalar(values, count, limit);
+	}
+
+	size_t countEqual(const uint8* values, size_t count, uint8 value) {
+#ifdef COLUMN_KERNELS_AVX2
+		if (activeSet == IS_AVX2) return countEqualAVX2(values, count, value);
+#endif
+#ifdef COLUMN_KERNELS_SSE2
+		if (activeSet >= IS_SSE2) return countEqualSSE2(values, count, value);
+#endif
+		return countEqualScalar(values, count, value);
+	}
+
+	bool allInRange(const uint8* values, size_t count, uint8 low, uint8 high) {
+		if (low > high) {
+			return count == 0;
+		}
+#ifdef COLUMN_KERNELS_AVX2
+		if (activeSet == IS_AVX2) return allInRangeAVX2(values, count, low, high);
+#endif
+#ifdef COLUMN_KERNELS_SSE2
+		if (activeSet >= IS_SSE2) return allInRangeSSE2(values, count, low, high);
+#endif
+		return allInRangeScalar(values, count, low, high);
+	}
+
+	uint64 sum(const uint32* values, size_t count) {
+#ifdef COLUMN_KERNELS_AVX2
+		if (activeSet == IS_AVX2) return sumAVX2(values, count);
+#endif
+#ifdef COLUMN_KERNELS_SSE2
+		if (activeSet >= IS_SSE2) return sumSSE2(values, count);
+#endif
+		return sumScalar(values, count);
+	}
+
+}
+}
@@ -1,8 +1,14 @@
 #include "ScriptSerializerPreCompiled.h"
 #include "ScriptSerializer.h"
+#include "ScriptBlockCodec.h"
+#include "ScriptColumnKernels.h"
+#include "ScriptCacheListener.h"
 #include "OgreScriptCompiler.h"
 #include <iostream>
 #include <sstream>
+#include <cstddef>
+#include <algorithm>
+#include <limits>
 using namespace Ogre::ScriptBlock;
 using namespace std;
 
@@ -11,10 +17,101 @@ using namespace std;
 namespace Ogre {
 
 	const uint32 magicCode = ('O' | 'G' << 8 | 'R' << 16 | 'E' << 24 );
-	const uint32 version = 0x0001;
+	const uint32 version = 0x0008;
 
-	ScriptSerializer::ScriptSerializer(void) : blockIdCounter(0) {
+	// 64 bit FNV-1a, used for the subtree hashes
+	const uint64 hashOffsetBasis = 14695981039346656037ULL;
+	const uint64 hashPrime = 1099511628211ULL;
+
+	static void hashBytes(uint64& hash, const void* data, size_t size) {
+		const uint8* bytes = static_cast<const uint8*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * hashPrime;
+		}
+	}
+
+	template<typename T>
+	static void hashValue(uint64& hash, const T& value) {
+		hashBytes(hash, &value, sizeof(T));
+	}
+
+	static void hashString(uint64& hash, const String& value) {
+		hashValue(hash, value.length());
+		hashBytes(hash, value.data(), value.length());
+	}
+
+	// An update writes the script again once more than this share of its string table would be left unused
+	const size_t deadStringDivisor = 4;
+
+	/// Drops the reused segments that reference subtrees of segments which are not reused
+	static void keepDependencies(std::vector<size_t>& reusedFrom, size_t notReused, const SegmentTable& existingSegments,
+		const SegmentDependencies& existingDependencies, const std::vector<size_t>& dependencyStart) {
+		bool dropped = true;
+		while (dropped) {
+			dropped = false;
+			std::set<uint64> keptOffsets;
+			for (size_t index = 0; index < reusedFrom.size(); index++) {
+				if (reusedFrom[index] != notReused) {
+					keptOffsets.insert(existingSegments[reusedFrom[index]].offset);
+				}
+			}
+			for (size_t index = 0; index < reusedFrom.size(); index++) {
+				size_t existing = reusedFrom[index];
+				if (existing == notReused) {
+					continue;
+				}
+				for (size_t d = dependencyStart[existing]; d < dependencyStart[existing + 1]; d++) {
+					if (keptOffsets.find(existingDependencies[d]) == keptOffsets.end()) {
+						reusedFrom[index] = notReused;
+						dropped = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	/// Adds every string the node's subtree puts in the string table
+	static void collectStrings(const AbstractNode* node, std::set<String>& strings) {
+		if (node->type == ANT_ATOM) {
+			strings.insert(static_cast<const AtomAbstractNode*>(node)->value);
+		}
+		else if (node->type == ANT_PROPERTY) {
+			const PropertyAbstractNode* propertyNode = static_cast<const PropertyAbstractNode*>(node);
+			strings.insert(propertyNode->name);
+			for (AbstractNodeList::const_iterator it = propertyNode->values.begin(); it != propertyNode->values.end(); ++it) {
+				collectStrings(it->get(), strings);
+			}
+		}
+		else if (node->type == ANT_OBJECT) {
+			const ObjectAbstractNode* objectNode = static_cast<const ObjectAbstractNode*>(node);
+			strings.insert(objectNode->name);
+			strings.insert(objectNode->cls);
+			strings.insert(objectNode->bases.begin(), objectNode->bases.end());
+			const std::map<String, String>& variables = objectNode->getVariables();
+			for (std::map<String, String>::const_iterator it = variables.begin(); it != variables.end(); ++it) {
+				strings.insert(it->first);
+				strings.insert(it->second);
+			}
+			const AbstractNodeList* lists[] = { &objectNode->overrides, &objectNode->values, &objectNode->children };
+			for (size_t i = 0; i < 3; i++) {
+				for (AbstractNodeList::const_iterator it = lists[i]->begin(); it != lists[i]->end(); ++it) {
+					collectStrings(it->get(), strings);
+				}
+			}
+		}
+	}
+
+	// A node whose child lists are still being visited, along with the number of lists left
+	struct VisitEntry {
+		int type;
+		int listsLeft;
+		uint32 line;
+	};
+
+	ScriptSerializer::ScriptSerializer(void) : blockIdCounter(0), threadCount(1), columnarLayout(false), releaseProfile(false), frequencyOrder(false), debugInfo(true), compactStrings(false), listener(0) {
 		stringTable = OGRE_NEW StringTable();
+		memset(&stats, 0, sizeof(stats));
 	}
 
 	ScriptSerializer::~ScriptSerializer(void)
@@ -25,23 +122,432 @@ namespace Ogre {
 	void ScriptSerializer::serialize(const DataStreamPtr& stream, const AbstractNodeListPtr& ast, size_t lastModifiedDate) {
 		blockIdCounter = 0;
 		stringTable->clear();
+		memset(&stats, 0, sizeof(stats));
+		subtreeHashes.clear();
+		firstOccurrences.clear();
+		duplicates.clear();
+		sharedSubtrees.clear();
 
 		ScriptHeader header;
+		memset(&header, 0, sizeof(header));
 		header.magic = magicCode;
 		header.version = version;
+		bool compact = frequencyOrder && !columnarLayout;
+		header.flags = (releaseProfile ? SF_Release : 0) | (compact ? SF_CompactStrings : 0);
 		header.lastModifiedTime = lastModifiedDate;
 		header.stringTableOffset = 0;	// Will be overwritten later
+		header.segmentTableOffset = 0;	// Will be overwritten later
 		writeToStream(stream, header);
 
+		// Each top level node gets its own segment, so it can be replaced later on without touching the rest.
+		// Repeated subtrees are written once, every later copy becomes a reference to it
+		SegmentWriterList writers;
+		size_t index = 0;
+		for(AbstractNodeList::iterator i = ast->begin(); i != ast->end(); ++i, ++index) {
+			if (!columnarLayout) {
+				findSharedSubtrees(*i, index);
+			}
+			writers.push_back(OGRE_NEW SegmentWriter(*i, index, hashTree(*i), releaseProfile));
+		}
+
+		SegmentTable segments(ast->size());
+		SegmentDependencyList dependencies(ast->size());
+		try {
+			writeSegments(stream, writers, segments, dependencies, compact, compact);
+		}
+		catch (...) {
+			deleteWriters(writers);
+			throw;
+		}
+
+		writeTables(stream, header, segments, dependencies);
+		updateDedupRatio();
+	}
+
+	bool ScriptSerializer::update(const DataStreamPtr& stream, const AbstractNodeListPtr& ast, size_t lastModifiedDate) {
+		memset(&stats, 0, sizeof(stats));
+		subtreeHashes.clear();
+		firstOccurrences.clear();
+		duplicates.clear();
+		sharedSubtrees.clear();
+
+		ScriptHeader header;
+		if (stream->read(&header, sizeof(header)) != sizeof(header) || !isSupported(header)) {
+			return false;
+		}
+
+		// Segments of the two profiles cannot be mixed, and neither can those of the two string encodings
+		bool compact = (header.flags & SF_CompactStrings) != 0;
+		if (((header.flags & SF_Release) != 0) != releaseProfile || compact != (frequencyOrder && !columnarLayout)) {
+			return false;
+		}
+
+		SegmentTable existingSegments;
+		SegmentDependencies existingDependencies;
+		stream->seek(serializer_cast<size_t>(header.segmentTableOffset));
+		readSegmentTable(stream, existingSegments, existingDependencies);
+
+		typedef std::map<uint64, size_t> SegmentLookup;
+		SegmentLookup lookup;
+		std::vector<size_t> dependencyStart(existingSegments.size() + 1, 0);
+		for (size_t i = 0; i < existingSegments.size(); i++) {
+			lookup.insert(SegmentLookup::value_type(existingSegments[i].hash, i));
+			dependencyStart[i + 1] = dependencyStart[i] + existingSegments[i].dependencyCount;
+		}
+
+		// Find the top level nodes that are already stored in the file
+		const size_t notReused = existingSegments.size();
+		std::vector<size_t> reusedFrom(ast->size(), notReused);
+		std::set<size_t> matched;
+		size_t index = 0;
+		for(AbstractNodeList::iterator i = ast->begin(); i != ast->end(); ++i, ++index) {
+			SegmentLookup::iterator match = lookup.find(hashTree(*i));
+			if (match != lookup.end() && matched.insert(match->second).second) {
+				reusedFrom[index] = match->second;
+			}
+		}
+
+		// A kept segment may only reference subtrees of segments that are kept as well
+		keepDependencies(reusedFrom, notReused, existingSegments, existingDependencies, dependencyStart);
+
+		// The hashes only pick the candidates.  The kept segments are decoded and compared with the new trees, so a
+		// collision cannot leave a stale tree in the file.  References point backwards, and every segment a kept one
+		// references is kept, so decoding them in file order finds each referenced subtree.  The release profile
+		// stores no lines to compare
+		stream->seek(serializer_cast<size_t>(header.stringTableOffset));
+		stringTable->clear();
+		readStringTable(stream);
+		std::vector<const AbstractNode*> newTrees;
+		for(AbstractNodeList::iterator i = ast->begin(); i != ast->end(); ++i) {
+			newTrees.push_back(i->get());
+		}
+		typedef std::multimap<uint64, size_t> SegmentOrder;
+		SegmentOrder order;
+		for (index = 0; index < reusedFrom.size(); index++) {
+			if (reusedFrom[index] != notReused) {
+				order.insert(SegmentOrder::value_type(existingSegments[reusedFrom[index]].offset, index));
+			}
+		}
+		// The decoded trees are held until the end, later segments copy the subtrees they reference from them
+		SharedNodeMap sharedNodes;
+		ByteBuffer buffer;
+		std::vector<AbstractNodeList> storedTrees(reusedFrom.size());
+		bool mismatched = false;
+		for (SegmentOrder::iterator it = order.begin(); it != order.end(); ++it) {
+			AbstractNodeList& stored = storedTrees[it->second];
+			readSegment(stream, existingSegments[reusedFrom[it->second]], buffer, stored, sharedNodes);
+			if (stored.size() != 1 || !equalTrees(stored.front().get(), newTrees[it->second], !releaseProfile)) {
+				reusedFrom[it->second] = notReused;
+				mismatched = true;
+			}
+		}
+		if (mismatched) {
+			keepDependencies(reusedFrom, notReused, existingSegments, existingDependencies, dependencyStart);
+		}
+		memset(&stats, 0, sizeof(stats));
+
+		SegmentTable segments(ast->size());
+		SegmentDependencyList dependencies(ast->size());
+		uint64 reusedBytes = 0;
+		index = 0;
+		for(AbstractNodeList::iterator i = ast->begin(); i != ast->end(); ++i, ++index) {
+			size_t existing = reusedFrom[index];
+			if (existing != notReused) {
+				segments[index] = existingSegments[existing];
+				segments[index].baseLine = (*i)->line;
+				dependencies[index].assign(existingDependencies.begin() + dependencyStart[existing], existingDependencies.begin() + dependencyStart[existing + 1]);
+				reusedBytes += segments[index].size;
+			}
+		}
+
+		// Writing the script from scratch is better once most of the file would be unused
+		uint64 segmentBytes = header.stringTableOffset - sizeof(header);
+		if (reusedBytes == 0 || segmentBytes - reusedBytes > reusedBytes) {
+			return false;
+		}
+
+		// Continue the existing string table so the ids used by the kept segments remain valid.  Decoding took strings
+		// out of the table, so it is read again.  Reference counts of dropped segments are kept, which is safe as the
+		// counts only decide when a string may be moved
+		stream->seek(serializer_cast<size_t>(header.stringTableOffset));
+		stringTable->clear();
+		readStringTable(stream);
+		stringTable->indexStrings();
+
+		// The strings only dropped segments used stay in the table and are read on every load
+		std::set<String> liveStrings;
+		for (size_t i = 0; i < newTrees.size(); i++) {
+			collectStrings(newTrees[i], liveStrings);
+		}
+		size_t storedStrings = 0;
+		size_t liveStored = 0;
+		for (size_t id = 1; id < stringTable->getIdLimit(); id++) {
+			storedStrings++;
+			if (liveStrings.find(stringTable->getString(serializer_cast<ResourceID>(id))) != liveStrings.end()) {
+				liveStored++;
+			}
+		}
+		size_t deadStrings = storedStrings - liveStored;
+		if (deadStrings * deadStringDivisor > storedStrings + (liveStrings.size() - liveStored)) {
+			return false;
+		}
+
+		// Clear the timestamp while the file is being modified, so an interrupted update leaves a script that reads as out of date
+		ScriptHeader pendingHeader = header;
+		pendingHeader.lastModifiedTime = 0;
+		stream->seek(0);
+		writeToStream(stream, pendingHeader);
+
+		// The changed segments are appended over the old tables, which are held in memory by now
+		stream->seek(serializer_cast<size_t>(header.stringTableOffset));
+
+		// Only the changed segments share subtrees among each other
+		SegmentWriterList writers;
+		index = 0;
+		for(AbstractNodeList::iterator i = ast->begin(); i != ast->end(); ++i, ++index) {
+			if (reusedFrom[index] == notReused) {
+				if (!columnarLayout) {
+					findSharedSubtrees(*i, index);
+				}
+				writers.push_back(OGRE_NEW SegmentWriter(*i, index, hashTree(*i), releaseProfile));
+			}
+			else {
+				stats.segmentsReused++;
+			}
+		}
+
+		blockIdCounter = 0;
+		try {
+			writeSegments(stream, writers, segments, dependencies, false, compact);
+		}
+		catch (...) {
+			deleteWriters(writers);
+			throw;
+		}
+
+		header.lastModifiedTime = lastModifiedDate;
+		writeTables(stream, header, segments, dependencies);
+		updateDedupRatio();
+		return true;
+	}
+
+	void ScriptSerializer::setThreadCount(size_t count) {
+#if OGRE_THREAD_SUPPORT
+		if (count == 0) {
+			count = OGRE_THREAD_HARDWARE_CONCURRENCY;
+		}
+#else
+		count = 1;
+#endif
+		threadCount = std::max<size_t>(count, 1);
+	}
+
+	/// Encodes every step-th segment of the list, starting with the first one given.
+	/// An exception must not leave a thread, so a copy is kept for the calling thread to throw after the join
+	struct ScriptSerializer::EncodeWorker {
+		EncodeWorker(ScriptSerializer* serializer, SegmentWriterList* writers, size_t first, size_t step, Exception** error)
+			: serializer(serializer), writers(writers), first(first), step(step), error(error) { }
+
+		void operator()() {
+			try {
+				ScriptCacheStage stage(serializer->listener, "encode", StringUtil::BLANK, first);
+				for (size_t i = first; i < writers->size(); i += step) {
+					serializer->encodeSegment(*(*writers)[i]);
+				}
+			}
+			catch (Exception& e) {
+				*error = OGRE_NEW_T(Exception, MEMCATEGORY_GENERAL)(e);
+			}
+			catch (std::exception& e) {
+				*error = OGRE_NEW_T(Exception, MEMCATEGORY_GENERAL)(Exception::ERR_INTERNAL_ERROR, e.what(), "ScriptSerializer::encodeSegments");
+			}
+		}
+
+		ScriptSerializer* serializer;
+		SegmentWriterList* writers;
+		size_t first;
+		size_t step;
+		Exception** error;
+	};
+
+	void ScriptSerializer::encodeSegments(SegmentWriterList& writers) {
+#if OGRE_THREAD_SUPPORT
+		size_t threads = std::min(threadCount, writers.size());
+		if (threads > 1) {
+			// The segments don't share any mutable state while being encoded.  The calling thread takes a share as well
+			std::vector<Exception*> errors(threads, 0);
+			std::vector<OGRE_THREAD_TYPE*> workers;
+			for (size_t t = 1; t < threads; t++) {
+				OGRE_THREAD_CREATE(worker, EncodeWorker(this, &writers, t, threads, &errors[t]));
+				workers.push_back(worker);
+			}
+			EncodeWorker(this, &writers, 0, threads, &errors[0])();
+			for (size_t t = 0; t < workers.size(); t++) {
+				workers[t]->join();
+				OGRE_THREAD_DESTROY(workers[t]);
+			}
+
+			// Each thread stops at its first failure.  The error of the lowest thread is thrown, the others are dropped
+			Exception* error = 0;
+			for (size_t t = 0; t < errors.size(); t++) {
+				if (errors[t] && !error) {
+					error = errors[t];
+				}
+				else if (errors[t]) {
+					OGRE_DELETE_T(errors[t], Exception, MEMCATEGORY_GENERAL);
+				}
+			}
+			if (error) {
+				Exception copy(*error);
+				OGRE_DELETE_T(error, Exception, MEMCATEGORY_GENERAL);
+				throw copy;
+			}
+			return;
+		}
+#endif
+		ScriptCacheStage stage(listener, "encode", StringUtil::BLANK, 0);
+		for (size_t i = 0; i < writers.size(); i++) {
+			encodeSegment(*writers[i]);
+		}
+	}
+
+	void ScriptSerializer::deleteWriters(SegmentWriterList& writers) {
+		for (SegmentWriterList::iterator it = writers.begin(); it != writers.end(); ++it) {
+			OGRE_DELETE *it;
+		}
+		writers.clear();
+	}
+
+	static size_t varintSize(uint32 value) {
+		size_t size = 1;
+		while (value >= 0x80) {
+			value >>= 7;
+			size++;
+		}
+		return size;
+	}
+
+	void ScriptSerializer::writeSegments(const DataStreamPtr& stream, SegmentWriterList& writers, SegmentTable& segments, SegmentDependencyList& dependencies, bool reorderStrings, bool compactStrings) {
+		encodeSegments(writers);
+
+		// Merging in script order hands out the same ids a single pass over the script would, whatever thread encoded the segment
+		std::vector<std::vector<ResourceID> > remaps(writers.size());
+		for (size_t i = 0; i < writers.size(); i++) {
+			stringTable->mergeStrings(writers[i]->strings, remaps[i]);
+		}
+
+		// Every reference is counted by now, so the ids can be handed out again by frequency
+		std::vector<ResourceID> frequencyRemap;
+		if (reorderStrings) {
+			std::vector<size_t> firstSeenBytes(stringTable->getIdLimit(), 0);
+			for (size_t id = 1; id < firstSeenBytes.size(); id++) {
+				firstSeenBytes[id] = stringTable->getReferenceCount(serializer_cast<ResourceID>(id)) * varintSize(serializer_cast<uint32>(id));
+			}
+			stringTable->orderByReferences(frequencyRemap);
+			for (size_t id = 1; id < firstSeenBytes.size(); id++) {
+				stats.referenceBytesSaved += firstSeenBytes[id];
+			}
+		}
+
+		// Swap the writers' own string ids for those of the merged table
+		std::vector<SegmentWriter*> segmentWriters(segments.size(), 0);
+		for (size_t i = 0; i < writers.size(); i++) {
+			SegmentWriter* writer = writers[i];
+			std::vector<ResourceID>& remap = remaps[i];
+			for (SegmentWriter::StringFixupList::iterator fixup = writer->stringFixups.begin(); fixup != writer->stringFixups.end(); ++fixup) {
+				fixup->id = reorderStrings ? frequencyRemap[remap[fixup->id]] : remap[fixup->id];
+				memcpy(&writer->data[fixup->position], &fixup->id, sizeof(ResourceID));
+				stats.referenceBytes += compactStrings ? varintSize(fixup->id) : sizeof(ResourceID);
+			}
+			if (compactStrings) {
+				writer->compactStrings();
+			}
+			segmentWriters[writer->index] = writer;
+		}
+
+		// The shared subtrees moved along with the rest of their segment
+		if (compactStrings) {
+			for (SharedSubtreeMap::iterator it = sharedSubtrees.begin(); it != sharedSubtrees.end(); ++it) {
+				SegmentWriter* writer = segmentWriters[serializer_cast<size_t>(it->second.segment)];
+				if (writer) {
+					it->second.offset = writer->compactedPosition(serializer_cast<size_t>(it->second.offset));
+				}
+			}
+		}
+
+		// Lay the segments out one after the other, in the order of the script
+		size_t offset = stream->tell();
+		for (SegmentWriterList::iterator it = writers.begin(); it != writers.end(); ++it) {
+			SegmentWriter* writer = *it;
+			writer->segment.offset = offset;
+			writer->segment.size = writer->data.size();
+			writer->segment.dependencyCount = serializer_cast<uint32>(writer->referencedSegments.size());
+			segments[writer->index] = writer->segment;
+			offset += writer->data.size();
+		}
+
+		for (size_t i = 0; i < writers.size(); i++) {
+			SegmentWriter* writer = writers[i];
+
+			// References can now be pointed at the final location of their subtree
+			for (SegmentWriter::ReferenceFixupList::iterator fixup = writer->referenceFixups.begin(); fixup != writer->referenceFixups.end(); ++fixup) {
+				const SharedSubtree& target = sharedSubtrees.find(fixup->target)->second;
+				uint64 targetOffset = segments[serializer_cast<size_t>(target.segment)].offset + target.offset;
+				memcpy(&writer->data[fixup->position], &targetOffset, sizeof(uint64));
+			}
+
+			for (std::set<size_t>::iterator it = writer->referencedSegments.begin(); it != writer->referencedSegments.end(); ++it) {
+				dependencies[writer->index].push_back(segments[*it].offset);
+			}
+
+			if (!writer->data.empty()) {
+				stream->write(&writer->data[0], writer->data.size());
+			}
+			stats.segmentsWritten++;
+			stats.nodeBlocks += writer->nodeBlocks;
+			stats.nodesShared += writer->nodesShared;
+		}
+		deleteWriters(writers);
+
+		if (reorderStrings) {
+			stats.referenceBytesSaved -= stats.referenceBytes;
+		}
+	}
+
+	void ScriptSerializer::encodeSegment(SegmentWriter& writer) {
+		// Runs on the encoding threads. Only the writer is modified, besides the offsets of the writer's own shared subtrees
+		if (columnarLayout) {
+			encodeColumns(writer);
+			return;
+		}
+
+		AbstractNodeList root;
+		root.push_back(writer.node);
+
 		SerializeStack s;
-		writeStackChildren(s, *ast);
+		writeStackChildren(s, root, writer.node->line);
 
-		// Traverse all the trees and their nodes in depth-first order
+		// Traverse the tree and its nodes in depth-first order
 		while (!s.empty()) {
 			BlockEntry* entry = s.top();
 			s.pop();
 
-			writeBlock(stream, entry);
+			if (entry->blockClass == BC_Node) {
+				NodeBlockEntry* nodeEntry = serializer_cast<NodeBlockEntry*>(entry);
+				NodeLinkMap::const_iterator duplicate = duplicates.find(nodeEntry->node.get());
+				if (duplicate != duplicates.end()) {
+					writeReference(writer, nodeEntry, duplicate->second);
+					OGRE_DELETE entry;
+					continue;
+				}
+
+				SharedSubtreeMap::iterator shared = sharedSubtrees.find(nodeEntry->node.get());
+				if (shared != sharedSubtrees.end()) {
+					shared->second.offset = writer.tell();
+				}
+			}
+
+			writeBlock(writer, entry);
 
 			// Add child nodes
 			if (entry->blockClass == BC_Node) {
@@ -49,33 +555,203 @@ namespace Ogre {
 				const AbstractNodePtr& node = nodeEntry->node;
 				if (node->type == ANT_PROPERTY) {
 					PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(node.get());
-					writeStackChildren(s, propertyNode->values);
+					writeStackChildren(s, propertyNode->values, node->line);
+				}
+				else if (node->type == ANT_OBJECT) {
+					ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(node.get());
+					writeStackChildren(s, objectNode->children, node->line, OATT_Children);
+					writeStackChildren(s, objectNode->values, node->line, OATT_Values);
+					writeStackChildren(s, objectNode->overrides, node->line, OATT_Overrides);
+				}
+			}
+
+			OGRE_DELETE entry;
+		}
+	}
+
+	void ScriptSerializer::encodeColumns(SegmentWriter& writer) {
+		// The same depth-first walk as the block layout, with every field appended to its own column
+		ColumnSet columns;
+		AbstractNodeList root;
+		root.push_back(writer.node);
+
+		SerializeStack s;
+		writeStackChildren(s, root, writer.node->line);
+
+		while (!s.empty()) {
+			BlockEntry* entry = s.top();
+			s.pop();
+
+			if (entry->blockClass == BC_Transition) {
+				TransitionBlockEntry* transitionEntry = serializer_cast<TransitionBlockEntry*>(entry);
+				uint32 code = transitionEntry->direction == TTD_Down ? SC_Down | transitionEntry->userData : SC_Up;
+				columns.shape.push_back(serializer_cast<uint8>(code));
+			}
+			else {
+				NodeBlockEntry* nodeEntry = serializer_cast<NodeBlockEntry*>(entry);
+				const AbstractNodePtr& node = nodeEntry->node;
+				columns.shape.push_back(SC_Node);
+				columns.types.push_back(serializer_cast<uint8>(node->type));
+				columns.lines.push_back(node->line - nodeEntry->parentLine);
+				writer.nodeBlocks++;
+
+				if (node->type == ANT_ATOM) {
+					AtomAbstractNode* atomNode = serializer_cast<AtomAbstractNode*>(node.get());
+					columns.ids.push_back(atomNode->id);
+					columns.strings.push_back(writer.strings.registerString(atomNode->value));
+				}
+				else if (node->type == ANT_PROPERTY) {
+					PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(node.get());
+					columns.ids.push_back(propertyNode->id);
+					columns.strings.push_back(writer.strings.registerString(propertyNode->name));
+					writeStackChildren(s, propertyNode->values, node->line);
 				}
 				else if (node->type == ANT_OBJECT) {
 					ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(node.get());
-					writeStackChildren(s, objectNode->children, OATT_Children);
-					writeStackChildren(s, objectNode->values, OATT_Values);
-					writeStackChildren(s, objectNode->overrides, OATT_Overrides);
+					columns.ids.push_back(objectNode->id);
+					columns.strings.push_back(writer.strings.registerString(objectNode->name));
+					columns.classes.push_back(writer.strings.registerString(objectNode->cls));
+					columns.abstract.push_back(objectNode->abstract ? 1 : 0);
+
+					const map<String, String>::type& variables = objectNode->getVariables();
+					columns.baseCounts.push_back(serializer_cast<uint32>(objectNode->bases.size()));
+					columns.variableCounts.push_back(serializer_cast<uint32>(variables.size()));
+					for(std::vector<String>::iterator it = objectNode->bases.begin(); it != objectNode->bases.end(); it++) {
+						columns.lists.push_back(writer.strings.registerString(*it));
+					}
+					for(map<String, String>::type::const_iterator it = variables.begin(); it != variables.end(); ++it) {
+						columns.lists.push_back(writer.strings.registerString(it->first));
+						columns.lists.push_back(writer.strings.registerString(it->second));
+					}
+
+					writeStackChildren(s, objectNode->children, node->line, OATT_Children);
+					writeStackChildren(s, objectNode->values, node->line, OATT_Values);
+					writeStackChildren(s, objectNode->overrides, node->line, OATT_Overrides);
+				}
+				else {
+					String type = StringConverter::toString(node->type);
+					OGRE_DELETE entry;
+					for (; !s.empty(); s.pop()) {
+						OGRE_DELETE s.top();
+					}
+					OGRE_EXCEPT(Exception::ERR_ITEM_NOT_FOUND, "Cannot serialize node of type:" + type, "ScriptSerializer::encodeColumns");
 				}
 			}
 
 			OGRE_DELETE entry;
 		}
 
-		// Write the string table
+		ScriptBlockHeader blockHeader;
+		blockHeader.blockClass = BC_Columns;
+		blockHeader.blockType = 0;		// Not used
+		blockHeader.blockID = ++writer.blockIdCounter;
+
+		ColumnsBlock block;
+		block.nodeCount = serializer_cast<uint32>(columns.types.size());
+		block.objectCount = serializer_cast<uint32>(columns.classes.size());
+		block.listCount = serializer_cast<uint32>(columns.lists.size());
+		block.shapeCount = serializer_cast<uint32>(columns.shape.size());
+		writer.writeBlock(blockHeader, block);
+
+		// The 32 bit columns go first, so they stay aligned once copied to the reader's buffer
+		if (!releaseProfile) {
+			writer.writeColumn(columns.lines);
+		}
+		writer.writeColumn(columns.ids);
+		writer.writeStringColumn(columns.strings);
+		writer.writeStringColumn(columns.classes);
+		writer.writeColumn(columns.baseCounts);
+		writer.writeColumn(columns.variableCounts);
+		writer.writeStringColumn(columns.lists);
+		writer.writeColumn(columns.shape);
+		writer.writeColumn(columns.types);
+		writer.writeColumn(columns.abstract);
+	}
+
+	void ScriptSerializer::writeReference(SegmentWriter& writer, NodeBlockEntry* entry, const AbstractNode* target) {
+		ScriptBlockHeader blockHeader;
+		blockHeader.blockClass = BC_Reference;
+		blockHeader.blockType = entry->node->type;
+		blockHeader.blockID = ++writer.blockIdCounter;
+
+		// The target's offset is filled in once all segments are laid out
+		ReferenceBlock block;
+		memset(&block, 0, sizeof(block));
+		block.nodeInfo.lineNumber = entry->node->line - entry->parentLine;
+		writer.writeBlock(blockHeader, block);
+		SegmentWriter::ReferenceFixup fixup = { writer.offsetPosition, target };
+		writer.referenceFixups.push_back(fixup);
+
+		size_t targetSegment = serializer_cast<size_t>(sharedSubtrees.find(target)->second.segment);
+		if (targetSegment != writer.index) {
+			writer.referencedSegments.insert(targetSegment);
+		}
+		writer.nodesShared += countNodes(entry->node.get());
+	}
+
+	void ScriptSerializer::findSharedSubtrees(const AbstractNodePtr& node, size_t segment) {
+		// Walks the subtree in the order encodeSegment emits it, so the first occurrence is always written before its copies
+		if (node->type == ANT_ATOM) {
+			return;
+		}
+
+		uint64 hash = hashTree(node);
+		HashedNodeMap::iterator first = firstOccurrences.find(hash);
+		if (first != firstOccurrences.end() && equalTrees(first->second.first, node.get())) {
+			duplicates[node.get()] = first->second.first;
+			sharedSubtrees[first->second.first].segment = first->second.second;	// The offset is filled in once the first occurrence is written
+			return;
+		}
+		if (first == firstOccurrences.end()) {
+			firstOccurrences[hash] = std::make_pair(node.get(), segment);
+		}
+
+		if (node->type == ANT_PROPERTY) {
+			PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(node.get());
+			for (AbstractNodeList::iterator it = propertyNode->values.begin(); it != propertyNode->values.end(); ++it) {
+				findSharedSubtrees(*it, segment);
+			}
+		}
+		else if (node->type == ANT_OBJECT) {
+			ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(node.get());
+			AbstractNodeList* lists[] = { &objectNode->overrides, &objectNode->values, &objectNode->children };
+			for (size_t i = 0; i < 3; i++) {
+				for (AbstractNodeList::iterator it = lists[i]->begin(); it != lists[i]->end(); ++it) {
+					findSharedSubtrees(*it, segment);
+				}
+			}
+		}
+	}
+
+	void ScriptSerializer::updateDedupRatio() {
+		size_t totalNodes = stats.nodeBlocks + stats.nodesShared;
+		stats.dedupRatio = totalNodes ? serializer_cast<float>(stats.nodesShared) / totalNodes : 0.0f;
+	}
+
+	void ScriptSerializer::writeTables(const DataStreamPtr& stream, ScriptHeader& header, SegmentTable& segments, const SegmentDependencyList& dependencies) {
+		if (releaseProfile) {
+			for (SegmentTable::iterator it = segments.begin(); it != segments.end(); ++it) {
+				it->baseLine = 0;
+			}
+		}
+
 		header.stringTableOffset = stream->tell();
 		writeStringTable(stream);
 
-		// Re-write the header with the correct string table offset
+		header.segmentTableOffset = stream->tell();
+		writeSegmentTable(stream, segments, dependencies);
+		stats.fileSize = stream->tell();
+
+		// Re-write the header with the correct table offsets
 		stream->seek(0);
 		writeToStream(stream, header);
 	}
 
-	void ScriptSerializer::writeStackChildren(SerializeStack& s, AbstractNodeList& children, int transitionUserdata) {
+	void ScriptSerializer::writeStackChildren(SerializeStack& s, AbstractNodeList& children, uint32 parentLine, int transitionUserdata) {
 		BlockEntryList entries;
 		entries.push_back(OGRE_NEW TransitionBlockEntry(TTD_Down, transitionUserdata));
 		for(AbstractNodeList::iterator i = children.begin(); i != children.end(); ++i) {
-			BlockEntry* entry = OGRE_NEW NodeBlockEntry(*i);
+			BlockEntry* entry = OGRE_NEW NodeBlockEntry(*i, parentLine);
 			entries.push_back(entry);
 		}
 		entries.push_back(OGRE_NEW TransitionBlockEntry(TTD_Up, transitionUserdata));
@@ -87,81 +763,86 @@ namespace Ogre {
 		}
 	}
 
-	void ScriptSerializer::writeBlock(const DataStreamPtr& stream, BlockEntry* entry) {
+	void ScriptSerializer::writeBlock(SegmentWriter& writer, BlockEntry* entry) {
 		if (entry->blockClass == BC_Transition) {
 			TransitionBlockEntry* transitionEntry = serializer_cast<TransitionBlockEntry*>(entry);
 			ScriptBlockHeader blockHeader;
-			blockHeader.blockID = ++blockIdCounter;
+			blockHeader.blockID = ++writer.blockIdCounter;
 			blockHeader.blockClass = BC_Transition;
 			blockHeader.blockType = 0;		// Not used
 
 			TransitionBlock block;
 			block.direction = transitionEntry->direction;
 			block.userData = transitionEntry->userData;
-			writeToStream(stream, blockHeader);
-			writeToStream(stream, block);
+			writer.writeBlock(blockHeader, block);
 		}
 		else if (entry->blockClass == BC_Node) {
 			NodeBlockEntry* nodeEntry = serializer_cast<NodeBlockEntry*>(entry);
 			AbstractNodePtr node = nodeEntry->node;
+			writer.nodeBlocks++;
+
+			// Flag repeated subtrees, so the reader keeps them around for their references
+			uint8 flags = sharedSubtrees.find(node.get()) != sharedSubtrees.end() ? BF_Shared : 0;
+
+			// The block ids of strings come from the writer's table.  writeBlock records where they end up, so they can be remapped later on
 			if (node->type == ANT_ATOM) {
 				AtomAbstractNode* atomNode = serializer_cast<AtomAbstractNode*>(node.get());
 				ScriptBlockHeader blockHeader;
 				blockHeader.blockClass = BC_Node;
 				blockHeader.blockType = ANT_ATOM;
-				blockHeader.blockID = ++blockIdCounter;
+				blockHeader.blockID = ++writer.blockIdCounter;
 
 				AtomAbstractNodeBlock block;
-				block.nodeInfo.lineNumber = atomNode->line;
+				block.nodeInfo.lineNumber = atomNode->line - nodeEntry->parentLine;
 				block.id = atomNode->id;
-				block.value = stringTable->registerString(atomNode->value);
-				writeToStream(stream, blockHeader);
-				writeToStream(stream, block);
+				block.value = writer.strings.registerString(atomNode->value);
+				writer.writeBlock(blockHeader, block);
 			}
 			else if (node->type == ANT_PROPERTY) {
 				PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(node.get());
 				ScriptBlockHeader blockHeader;
 				blockHeader.blockClass = BC_Node;
 				blockHeader.blockType = ANT_PROPERTY;
-				blockHeader.blockID = ++blockIdCounter;
+				blockHeader.blockID = ++writer.blockIdCounter;
+				blockHeader.flags = flags;
 
 				PropertyAbstractNodeBlock block;
-				block.nodeInfo.lineNumber = propertyNode->line;
+				block.nodeInfo.lineNumber = propertyNode->line - nodeEntry->parentLine;
 				block.id = propertyNode->id;
-				block.name = stringTable->registerString(propertyNode->name);
-				writeToStream(stream, blockHeader);
-				writeToStream(stream, block);
+				block.name = writer.strings.registerString(propertyNode->name);
+				writer.writeBlock(blockHeader, block);
 			}
 			else if (node->type == ANT_OBJECT) {
 				ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(node.get());
+				bool noLists = releaseProfile && objectNode->bases.empty() && objectNode->getVariables().empty();
 				ScriptBlockHeader blockHeader;
 				blockHeader.blockClass = BC_Node;
 				blockHeader.blockType = ANT_OBJECT;
-				blockHeader.blockID = ++blockIdCounter;
+				blockHeader.blockID = ++writer.blockIdCounter;
+				blockHeader.flags = flags | (noLists ? BF_NoLists : 0);
 
 				ObjectAbstractNodeBlock block;
-				block.nodeInfo.lineNumber = objectNode->line;
-				block.name = stringTable->registerString(objectNode->name);
-				block.cls = stringTable->registerString(objectNode->cls);
+				block.nodeInfo.lineNumber = objectNode->line - nodeEntry->parentLine;
+				block.name = writer.strings.registerString(objectNode->name);
+				block.cls = writer.strings.registerString(objectNode->cls);
 				block.id = objectNode->id;
 				block.abstract = objectNode->abstract;
 				block.bases.count = objectNode->bases.size();
 				block.environmentVars.count = objectNode->getVariables().size();
-				writeToStream(stream, blockHeader);
-				writeToStream(stream, block);
+				writer.writeBlock(blockHeader, block);
 
 				// Write out the "bases" list
 				for(std::vector<String>::iterator it = objectNode->bases.begin(); it != objectNode->bases.end(); it++) {
-					ResourceID id = stringTable->registerString(*it);
-					writeToStream(stream, id);
+					ResourceID id = writer.registerString(*it, writer.tell());
+					writer.write(id);
 				}
 
 				// Write the environment variables
 				for(map<String,String>::type::const_iterator i = objectNode->getVariables().begin(); i != objectNode->getVariables().end(); ++i) {
-					ResourceID keyID = stringTable->registerString(i->first);
-					ResourceID valueID = stringTable->registerString(i->second);
-					writeToStream(stream, keyID);
-					writeToStream(stream, valueID);
+					ResourceID keyID = writer.registerString(i->first, writer.tell());
+					writer.write(keyID);
+					ResourceID valueID = writer.registerString(i->second, writer.tell());
+					writer.write(valueID);
 				}
 			}
 		}
@@ -174,24 +855,55 @@ namespace Ogre {
 		AbstractNodeListPtr trees = AbstractNodeListPtr(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
 		
 		ScriptHeader header;
-		readFromStream(stream, header);
+		readHeader(stream, header);
+		memset(&stats, 0, sizeof(stats));
 
-		if (header.magic != magicCode) {
-			OGRE_EXCEPT(Exception::ERR_INTERNAL_ERROR, "Binary file is not in correct format: " + stream->getName(), "ScriptSerializer::deserialize");
+		// Seek to the string table
+		stream->seek(serializer_cast<size_t>(header.stringTableOffset));
+		stringTable->clear();
+		readStringTable(stream);
+
+		SegmentTable segments;
+		SegmentDependencies dependencies;
+		stream->seek(serializer_cast<size_t>(header.segmentTableOffset));
+		readSegmentTable(stream, segments, dependencies);
+
+		// Read the node data of each top level node.  References always point backwards in the file,
+		// so reading the segments in file order loads every referenced subtree before its copies
+		typedef std::multimap<uint64, size_t> SegmentOrder;
+		SegmentOrder order;
+		for (size_t i = 0; i < segments.size(); i++) {
+			order.insert(SegmentOrder::value_type(segments[i].offset, i));
 		}
-		else if (header.version != version) {
-			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Binary script is in an older format.  Please reparse the script", "ScriptSerializer::deserialize");
+
+		SharedNodeMap sharedNodes;
+		ByteBuffer buffer;
+		std::vector<AbstractNodeList> segmentTrees(segments.size());
+		for (SegmentOrder::iterator it = order.begin(); it != order.end(); ++it) {
+			readSegment(stream, segments[it->second], buffer, segmentTrees[it->second], sharedNodes);
+		}
+		for (size_t i = 0; i < segmentTrees.size(); i++) {
+			trees->splice(trees->end(), segmentTrees[i]);
 		}
 
+		updateDedupRatio();
+		return trees;
+	}
 
-		// Seek to the string table 
-		stream->seek(header.stringTableOffset);
-		stringTable->clear();
-		readStringTable(stream);
+	void ScriptSerializer::readSegment(const DataStreamPtr& stream, const SegmentEntry& segment, ByteBuffer& buffer, AbstractNodeList& trees, SharedNodeMap& sharedNodes) {
+		// The segment is decoded from memory.  Block offsets are still those of the stream, as references point at them
+		BlockReader reader = loadBlocks(stream, segment.offset, segment.size, buffer);
+		const String& file = stream->getName();
+
+		// Columnar segments start with their columns block instead of the root list
+		ScriptBlockHeader firstHeader;
+		reader.read(firstHeader, readContext(0));
+		if (firstHeader.blockClass == BC_Columns) {
+			readColumnSegment(reader, segment, file, trees);
+			return;
+		}
+		reader.seek(serializer_cast<size_t>(segment.offset));
 
-		// Seek back to the start for reading the node data
-		stream->seek(sizeof(header));
-		
 		typedef std::pair<AbstractNode*, int> ParentEntry;
 		typedef std::stack<ParentEntry> ParentStack;
 
@@ -199,190 +911,975 @@ namespace Ogre {
 		AbstractNode* previousNode = 0;
 
 		while (true) {
+			size_t blockOffset = reader.tell();
 			ScriptBlockHeader blockHeader;
-			readFromStream(stream, blockHeader);
-			//int headerSize = sizeof(blockHeader);
-			//stream->skip(-headerSize);
+			reader.read(blockHeader, readContext(0));
+			CodecContext context = readContext(blockHeader.flags);
 
 			if (blockHeader.blockClass == BC_Transition) {
 				TransitionBlock block;
-				readFromStream(stream, block);
+				reader.read(block, context);
 
 				if (block.direction == TTD_Down) {
 					parentStack.push(ParentEntry(previousNode, block.userData));
 				}
 				else if (block.direction == TTD_Up) {
+					if (parentStack.empty()) {
+						OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unbalanced transition", "ScriptSerializer::readSegment");
+					}
 					previousNode = parentStack.top().first;
 					parentStack.pop();
+
+					// The segment ends with its root list
+					if (parentStack.empty()) {
+						break;
+					}
 				}
 				else {
-					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported direction type", "ScriptSerializer::deserialize");
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported direction type", "ScriptSerializer::readSegment");
 				}
 
 			} 
-			else if (blockHeader.blockClass == BC_Node) {
+			else if (blockHeader.blockClass == BC_Node || blockHeader.blockClass == BC_Reference) {
+				if (parentStack.empty()) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Node outside of a list", "ScriptSerializer::readSegment");
+				}
 				AbstractNode* parent = parentStack.top().first;
+				uint32 parentLine = parent ? parent->line : segment.baseLine;
 				AbstractNodePtr asn;
 
-				if (blockHeader.blockType == ANT_ATOM) {
+				if (blockHeader.blockClass == BC_Reference) {
+					ReferenceBlock block;
+					reader.read(block, context);
+
+					// Repeats a subtree read earlier on. Copy it over to the new position
+					SharedNodeMap::iterator target = sharedNodes.find(block.target);
+					if (target == sharedNodes.end()) {
+						OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Reference to an unknown subtree", "ScriptSerializer::readSegment");
+					}
+					int line = serializer_cast<int>(parentLine + block.nodeInfo.lineNumber);
+					previousNode = cloneTree(target->second, parent, line - serializer_cast<int>(target->second->line));
+					asn = AbstractNodePtr(previousNode);
+				}
+				else if (blockHeader.blockType == ANT_ATOM) {
 					AtomAbstractNodeBlock block;
-					readFromStream(stream, block);
+					reader.read(block, context);
 
 					AtomAbstractNode *impl = OGRE_NEW AtomAbstractNode(parent);
-					impl->file = stream->getName();
-					impl->line = block.nodeInfo.lineNumber;
-					impl->value = stringTable->getString(block.value);
+					impl->line = parentLine + block.nodeInfo.lineNumber;
+					stats.stringCopies += stringTable->takeString(block.value, impl->value);
 					impl->id = block.id;
 					previousNode = impl;
 					asn = AbstractNodePtr(impl);
 				}
 				else if (blockHeader.blockType == ANT_PROPERTY) {
 					PropertyAbstractNodeBlock block;
-					readFromStream(stream, block);
+					reader.read(block, context);
 
 					PropertyAbstractNode* impl = OGRE_NEW PropertyAbstractNode(parent);
-					impl->file = stream->getName();
-					impl->line = block.nodeInfo.lineNumber;
-					impl->name = stringTable->getString(block.name);
+					impl->line = parentLine + block.nodeInfo.lineNumber;
+					stats.stringCopies += stringTable->takeString(block.name, impl->name);
 					impl->id = block.id;
 					previousNode = impl;
 					asn = AbstractNodePtr(impl);
 				}
-				else if (blockHeader.blockType = ANT_OBJECT) {
+				else if (blockHeader.blockType == ANT_OBJECT) {
 					ObjectAbstractNodeBlock block;
-					readFromStream(stream, block);
+					reader.read(block, context);
 
 					ObjectAbstractNode* impl = OGRE_NEW ObjectAbstractNode(parent);
-					impl->file = stream->getName();
-					impl->line = block.nodeInfo.lineNumber;
-					impl->name = stringTable->getString(block.name);
-					impl->cls = stringTable->getString(block.cls);
+					impl->line = parentLine + block.nodeInfo.lineNumber;
+					stats.stringCopies += stringTable->takeString(block.name, impl->name);
+					stats.stringCopies += stringTable->takeString(block.cls, impl->cls);
 					impl->id = block.id;
 					impl->abstract = block.abstract;
+					asn = AbstractNodePtr(impl);
 
 					uint64 baseCount = block.bases.count;
 					uint64 envCount = block.environmentVars.count;
-
-					for (int i = 0; i < baseCount; i++) {
-						ResourceID id;
-						readFromStream(stream, id);
-						String base = stringTable->getString(id);
-						impl->bases.push_back(base);
+					if ((baseCount + envCount * 2) * BlockReader::minStringSize(context) > reader.remaining()) {
+						OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Object lists run past the end of the segment", "ScriptSerializer::readSegment");
 					}
 
-					for (int i = 0; i < envCount; i++) {
-						ResourceID keyId, valueId;
-						readFromStream(stream, keyId);
-						readFromStream(stream, valueId);
+					impl->bases.resize(serializer_cast<size_t>(baseCount));
+					for (size_t i = 0; i < baseCount; i++) {
+						ResourceID id = reader.readString(context);
+						stats.stringCopies += stringTable->takeString(id, impl->bases[i]);
+					}
 
-						String key = stringTable->getString(keyId);
-						String value = stringTable->getString(valueId);
+					for (size_t i = 0; i < envCount; i++) {
+						ResourceID keyId = reader.readString(context);
+						ResourceID valueId = reader.readString(context);
 
-						impl->setVariable(key, value);
+						// The environment keeps its own copies
+						impl->setVariable(stringTable->getString(keyId), stringTable->getString(valueId));
+						stats.stringCopies += 2;
 					}
 
 					previousNode = impl;
-					asn = AbstractNodePtr(impl);
+				}
+				else {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported node type", "ScriptSerializer::readSegment");
 				}
 
-				// Attach the node to the parent's appropriate child list
-				if (parent) {
-					if (parent->type == ANT_PROPERTY) {
-						PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(parent);
-						propertyNode->values.push_back(asn);
+				if (blockHeader.blockClass == BC_Node) {
+					// The stream's name is looked up once per segment.  Copies of the same String share its characters where
+					// the library allows, and release scripts leave the file names out
+					if (debugInfo) {
+						previousNode->file = file;
 					}
-					else if (parent->type == ANT_OBJECT) {
-						ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(parent);
-						int userData = parentStack.top().second;
-						switch(userData) {
-						case OATT_Children:
-							objectNode->children.push_back(asn);
-							break;
-
-						case OATT_Overrides:
-							objectNode->overrides.push_back(asn);
-							break;
-
-						case OATT_Values:
-							objectNode->values.push_back(asn);
-							break;
-
-						default:
-							OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported child type", "ScriptSerializer::deserialize");
-						}
+					stats.nodeBlocks++;
+					if (blockHeader.flags & BF_Shared) {
+						sharedNodes[blockOffset] = previousNode;
 					}
-				} 
-				else {
-					// This node has no parent and is the root node
-					trees->push_back(asn);
 				}
+
+				attachNode(parent, parentStack.top().second, asn, trees);
 			}
-			else if (blockHeader.blockClass == BC_StringTable) {
-				break;
+			else {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unexpected block in segment", "ScriptSerializer::readSegment");
 			}
 		}
-
-		return trees;
 	}
 
-	void ScriptSerializer::writeStringTable(const DataStreamPtr& stream) {
-		ScriptBlockHeader blockHeader;
-		blockHeader.blockID = ++blockIdCounter;
-		blockHeader.blockClass = BC_StringTable;
-		blockHeader.blockType = 0;		// Not used
+	void ScriptSerializer::attachNode(AbstractNode* parent, int listType, const AbstractNodePtr& node, AbstractNodeList& trees) {
+		// Attach the node to the parent's appropriate child list
+		if (parent) {
+			if (parent->type == ANT_PROPERTY) {
+				PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(parent);
+				propertyNode->values.push_back(node);
+			}
+			else if (parent->type == ANT_OBJECT) {
+				ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(parent);
+				switch(listType) {
+				case OATT_Children:
+					objectNode->children.push_back(node);
+					break;
+
+				case OATT_Overrides:
+					objectNode->overrides.push_back(node);
+					break;
+
+				case OATT_Values:
+					objectNode->values.push_back(node);
+					break;
+
+				default:
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported child type", "ScriptSerializer::attachNode");
+				}
+			}
+		} 
+		else {
+			// This node has no parent and is the root node
+			trees.push_back(node);
+		}
+	}
 
-		StringTableBlock block;
-		StringTable::ResourceTable table = stringTable->getTable();
-		block.count = table.size();
+	void ScriptSerializer::readColumns(BlockReader& reader, ColumnBuffer& buffer, ColumnView& view) {
+		ColumnsBlock& counts = view.counts;
+		reader.read(counts, readContext(0));
 
-		writeToStream(stream, blockHeader);
-		writeToStream(stream, block);
+		// Release scripts have no line column.  A column of zeros takes its place in the buffer
+		size_t lineWords = debugInfo ? 0 : counts.nodeCount;
+		uint64 wordCount = serializer_cast<uint64>(counts.nodeCount) * 3 + serializer_cast<uint64>(counts.objectCount) * 3 + counts.listCount - lineWords;
+		uint64 byteCount = wordCount * sizeof(uint32) + counts.shapeCount + counts.nodeCount + counts.objectCount;
+		if (byteCount > reader.remaining()) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Columnar segment runs past the end of the file", "ScriptSerializer::readColumns");
+		}
 
-		for (StringTable::ResourceTable::iterator it = table.begin(); it != table.end(); it++) {
-			String data = it->first;
-			ResourceID id = it->second;
+		// Copied to 32 bit words so the wide columns are aligned
+		buffer.assign(lineWords + serializer_cast<size_t>((byteCount + sizeof(uint32) - 1) / sizeof(uint32)) + 1, 0);
+		reader.readBytes(&buffer[lineWords], serializer_cast<size_t>(byteCount));
+
+		view.lines = &buffer[0];
+		view.ids = view.lines + counts.nodeCount;
+		view.strings = view.ids + counts.nodeCount;
+		view.classes = view.strings + counts.nodeCount;
+		view.baseCounts = view.classes + counts.objectCount;
+		view.variableCounts = view.baseCounts + counts.objectCount;
+		view.lists = view.variableCounts + counts.objectCount;
+		view.shape = reinterpret_cast<const uint8*>(view.lists + counts.listCount);
+		view.types = view.shape + counts.shapeCount;
+		view.abstract = view.types + counts.nodeCount;
+
+		// Check the columns up front, so rebuilding the tree only has to follow the shape.
+		// ANT_ATOM, ANT_OBJECT and ANT_PROPERTY follow each other in AbstractNodeType
+		size_t idLimit = stringTable->getIdLimit();
+		size_t upCount = ColumnKernels::countEqual(view.shape, counts.shapeCount, SC_Up);
+		size_t atomCount = ColumnKernels::countEqual(view.types, counts.nodeCount, ANT_ATOM);
+		uint64 baseTotal = ColumnKernels::sum(view.baseCounts, counts.objectCount);
+		uint64 variableTotal = ColumnKernels::sum(view.variableCounts, counts.objectCount);
+		bool valid = ColumnKernels::allInRange(view.types, counts.nodeCount, ANT_ATOM, ANT_PROPERTY) &&
+			ColumnKernels::countEqual(view.types, counts.nodeCount, ANT_OBJECT) == counts.objectCount &&
+			ColumnKernels::countEqual(view.shape, counts.shapeCount, SC_Node) == counts.nodeCount &&
+			upCount * 2 + counts.nodeCount == counts.shapeCount &&
+			!ColumnKernels::anyAtLeast(view.strings, counts.nodeCount + counts.objectCount, serializer_cast<uint32>(idLimit)) &&
+			!ColumnKernels::anyAtLeast(view.lists, counts.listCount, serializer_cast<uint32>(idLimit));
+
+		// Each object takes its bases and variables from the list column in turn, so the counts may not add up past it.
+		// Every property owns one list and every object three, besides the root list
+		valid = valid && baseTotal <= counts.listCount && variableTotal <= counts.listCount && baseTotal + variableTotal * 2 == counts.listCount &&
+			upCount == 1 + (counts.nodeCount - atomCount - counts.objectCount) + serializer_cast<size_t>(counts.objectCount) * 3;
+		if (!valid) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Corrupt columnar segment", "ScriptSerializer::readColumns");
+		}
+	}
+
+	void ScriptSerializer::readColumnSegment(BlockReader& reader, const SegmentEntry& segment, const String& file, AbstractNodeList& trees) {
+		ColumnBuffer buffer;
+		ColumnView view;
+		readColumns(reader, buffer, view);
+
+		typedef std::pair<AbstractNode*, int> ParentEntry;
+		typedef std::vector<ParentEntry> ParentStack;
+
+		ParentStack parentStack;
+		AbstractNode* previousNode = 0;
+		size_t node = 0, object = 0, list = 0;
+
+		for (size_t i = 0; i < view.counts.shapeCount; i++) {
+			uint8 code = view.shape[i];
+			if (code == SC_Node) {
+				if (parentStack.empty()) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Node outside of a list", "ScriptSerializer::readColumnSegment");
+				}
+				AbstractNode* parent = parentStack.back().first;
+				uint32 line = (parent ? parent->line : segment.baseLine) + view.lines[node];
+
+				// The node types were validated along with the columns
+				if (view.types[node] == ANT_ATOM) {
+					AtomAbstractNode* impl = OGRE_NEW AtomAbstractNode(parent);
+					stats.stringCopies += stringTable->takeString(view.strings[node], impl->value);
+					impl->id = view.ids[node];
+					previousNode = impl;
+				}
+				else if (view.types[node] == ANT_PROPERTY) {
+					PropertyAbstractNode* impl = OGRE_NEW PropertyAbstractNode(parent);
+					stats.stringCopies += stringTable->takeString(view.strings[node], impl->name);
+					impl->id = view.ids[node];
+					previousNode = impl;
+				}
+				else {
+					ObjectAbstractNode* impl = OGRE_NEW ObjectAbstractNode(parent);
+					stats.stringCopies += stringTable->takeString(view.strings[node], impl->name);
+					stats.stringCopies += stringTable->takeString(view.classes[object], impl->cls);
+					impl->id = view.ids[node];
+					impl->abstract = view.abstract[object] != 0;
+
+					impl->bases.resize(view.baseCounts[object]);
+					for (size_t b = 0; b < impl->bases.size(); b++) {
+						stats.stringCopies += stringTable->takeString(view.lists[list++], impl->bases[b]);
+					}
+
+					// The environment keeps its own copies
+					for (uint32 v = 0; v < view.variableCounts[object]; v++, list += 2) {
+						impl->setVariable(stringTable->getString(view.lists[list]), stringTable->getString(view.lists[list + 1]));
+						stats.stringCopies += 2;
+					}
+					object++;
+					previousNode = impl;
+				}
+
+				if (debugInfo) {
+					previousNode->file = file;
+				}
+				previousNode->line = line;
+				node++;
+				stats.nodeBlocks++;
+				attachNode(parent, parentStack.back().second, AbstractNodePtr(previousNode), trees);
+			}
+			else if (code == SC_Up) {
+				if (parentStack.empty()) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unbalanced shape column", "ScriptSerializer::readColumnSegment");
+				}
+				previousNode = parentStack.back().first;
+				parentStack.pop_back();
+			}
+			else if ((code & ~0x03) == SC_Down) {
+				if (previousNode && previousNode->type == ANT_ATOM) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "List opened below an atom", "ScriptSerializer::readColumnSegment");
+				}
+				parentStack.push_back(ParentEntry(previousNode, code & 0x03));
+			}
+			else {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported shape code", "ScriptSerializer::readColumnSegment");
+			}
+		}
+	}
+
+	void ScriptSerializer::visit(const DataStreamPtr& stream, ScriptSerializerVisitor& visitor) {
+		ScriptHeader header;
+		readHeader(stream, header);
+		memset(&stats, 0, sizeof(stats));
+
+		stream->seek(serializer_cast<size_t>(header.stringTableOffset));
+		stringTable->clear();
+		readStringTable(stream);
+
+		SegmentTable segments;
+		SegmentDependencies dependencies;
+		stream->seek(serializer_cast<size_t>(header.segmentTableOffset));
+		readSegmentTable(stream, segments, dependencies);
+
+		// References may point into any segment, so all of them are loaded
+		ByteBuffer buffer;
+		BlockReader reader = loadBlocks(stream, sizeof(header), header.stringTableOffset - sizeof(header), buffer);
+		for (SegmentTable::iterator it = segments.begin(); it != segments.end(); ++it) {
+			visitNodes(reader, serializer_cast<size_t>(it->offset), it->baseLine, visitor, false);
+		}
+		updateDedupRatio();
+	}
+
+	void ScriptSerializer::describe(const DataStreamPtr& stream, ScriptLayout& layout) {
+		readHeader(stream, layout.header);
+		memset(&stats, 0, sizeof(stats));
+		layout.fileSize = stream->size();
+		layout.segmentCount = 0;
+		layout.columnSegments = 0;
+		memset(layout.blockCounts, 0, sizeof(layout.blockCounts));
+		memset(layout.blockBytes, 0, sizeof(layout.blockBytes));
+		memset(layout.nodeCounts, 0, sizeof(layout.nodeCounts));
+		memset(layout.nodeBytes, 0, sizeof(layout.nodeBytes));
+
+		size_t start = serializer_cast<size_t>(layout.header.stringTableOffset);
+		stream->seek(start);
+		stringTable->clear();
+		readStringTable(stream);
+		layout.blockCounts[BC_StringTable]++;
+		layout.blockBytes[BC_StringTable] += stream->tell() - start;
+
+		layout.strings.clear();
+		layout.strings.resize(stringTable->getIdLimit());
+		for (size_t id = 1; id < layout.strings.size(); id++) {
+			ResourceID resource = serializer_cast<ResourceID>(id);
+			layout.strings[id] = std::make_pair(stringTable->getString(resource), stringTable->getReferenceCount(resource));
+		}
+
+		SegmentTable segments;
+		SegmentDependencies dependencies;
+		start = serializer_cast<size_t>(layout.header.segmentTableOffset);
+		stream->seek(start);
+		readSegmentTable(stream, segments, dependencies);
+		layout.blockCounts[BC_SegmentTable]++;
+		layout.blockBytes[BC_SegmentTable] += stream->tell() - start;
+		layout.segmentCount = segments.size();
+
+		ByteBuffer buffer;
+		for (SegmentTable::iterator it = segments.begin(); it != segments.end(); ++it) {
+			BlockReader reader = loadBlocks(stream, it->offset, it->size, buffer);
+			describeSegment(reader, *it, layout);
+		}
+		updateDedupRatio();
+	}
+
+	void ScriptSerializer::describeSegment(BlockReader& reader, const SegmentEntry& segment, ScriptLayout& layout) {
+		while (!reader.atEnd()) {
+			size_t start = reader.tell();
+			ScriptBlockHeader blockHeader;
+			reader.read(blockHeader, readContext(0));
+			CodecContext context = readContext(blockHeader.flags);
+
+			if (blockHeader.blockClass == BC_Transition) {
+				TransitionBlock block;
+				reader.read(block, context);
+			}
+			else if (blockHeader.blockClass == BC_Reference) {
+				ReferenceBlock block;
+				reader.read(block, context);
+				stats.nodesShared++;
+			}
+			else if (blockHeader.blockClass == BC_Columns) {
+				ColumnBuffer buffer;
+				ColumnView view;
+				readColumns(reader, buffer, view);
+				for (uint32 i = 0; i < view.counts.nodeCount; i++) {
+					layout.nodeCounts[view.types[i]]++;
+				}
+				stats.nodeBlocks += view.counts.nodeCount;
+				layout.columnSegments++;
+			}
+			else if (blockHeader.blockClass == BC_Node) {
+				if (blockHeader.blockType == ANT_ATOM) {
+					AtomAbstractNodeBlock block;
+					reader.read(block, context);
+				}
+				else if (blockHeader.blockType == ANT_PROPERTY) {
+					PropertyAbstractNodeBlock block;
+					reader.read(block, context);
+				}
+				else if (blockHeader.blockType == ANT_OBJECT) {
+					ObjectAbstractNodeBlock block;
+					reader.read(block, context);
+					uint64 idCount = block.bases.count + block.environmentVars.count * 2;
+					for (uint64 i = 0; i < idCount; i++) {
+						reader.readString(context);
+					}
+				}
+				else {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported node type", "ScriptSerializer::describeSegment");
+				}
+				layout.nodeCounts[blockHeader.blockType]++;
+				layout.nodeBytes[blockHeader.blockType] += reader.tell() - start;
+				stats.nodeBlocks++;
+			}
+			else {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unexpected block in segment", "ScriptSerializer::describeSegment");
+			}
+
+			layout.blockCounts[blockHeader.blockClass]++;
+			layout.blockBytes[blockHeader.blockClass] += reader.tell() - start;
+		}
+	}
+
+	void ScriptSerializer::visitNodes(BlockReader reader, size_t offset, uint32 baseLine, ScriptSerializerVisitor& visitor, bool singleNode) {
+		// Visits either a whole segment or, for references, the single subtree stored at the offset
+		reader.seek(offset);
+		if (!singleNode) {
+			ScriptBlockHeader firstHeader;
+			reader.read(firstHeader, readContext(0));
+			if (firstHeader.blockClass == BC_Columns) {
+				visitColumnSegment(reader, baseLine, visitor);
+				return;
+			}
+			reader.seek(offset);
+		}
+
+		typedef std::vector<VisitEntry> VisitStack;
+
+		VisitStack visitStack;
+		size_t listDepth = singleNode ? 1 : 0;
+		size_t skipDepth = 0;		// Depth of the visit stack at which the skipped node lives. zero if not skipping
+		std::vector<ResourceID> ids;
+
+		while (true) {
+			ScriptBlockHeader blockHeader;
+			reader.read(blockHeader, readContext(0));
+			CodecContext context = readContext(blockHeader.flags);
+
+			if (blockHeader.blockClass == BC_Transition) {
+				TransitionBlock block;
+				reader.read(block, context);
+
+				if (block.direction == TTD_Down) {
+					listDepth++;
+				}
+				else if (block.direction == TTD_Up) {
+					listDepth--;
+
+					// The root list has no owner and closes the segment.  Every other list belongs to the node on top of the stack
+					if (listDepth == 0) {
+						break;
+					}
+					if (--visitStack.back().listsLeft == 0) {
+						int nodeType = visitStack.back().type;
+						if (skipDepth == visitStack.size()) {
+							skipDepth = 0;
+						}
+						else if (!skipDepth) {
+							if (nodeType == ANT_OBJECT) visitor.exitObject();
+							else visitor.exitProperty();
+						}
+						visitStack.pop_back();
+
+						if (singleNode && visitStack.empty()) {
+							break;
+						}
+					}
+				}
+				else {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported direction type", "ScriptSerializer::visitNodes");
+				}
+			}
+			else if (blockHeader.blockClass == BC_Reference) {
+				ReferenceBlock block;
+				reader.read(block, context);
+
+				// The nodes of the target count as shared as they are visited, as deserialize counts their copies
+				if (!skipDepth) {
+					uint32 line = visitStack.empty() ? baseLine : visitStack.back().line + block.nodeInfo.lineNumber;
+					visitNodes(reader, serializer_cast<size_t>(block.target), line, visitor, true);
+				}
+			}
+			else if (blockHeader.blockClass == BC_Node) {
+				// Line numbers are stored relative to the parent. Hand out absolute ones to the visitor.
+				// The root takes the base line, as a repeated subtree's root is stored relative to its original parent
+				if (singleNode) {
+					stats.nodesShared++;
+				}
+				else {
+					stats.nodeBlocks++;
+				}
+				uint32 parentLine = visitStack.empty() ? 0 : visitStack.back().line;
+				uint32 rootLine = baseLine;
+
+				if (blockHeader.blockType == ANT_ATOM) {
+					AtomAbstractNodeBlock block;
+					reader.read(block, context);
+					block.nodeInfo.lineNumber = visitStack.empty() ? rootLine : parentLine + block.nodeInfo.lineNumber;
+					if (!skipDepth) {
+						visitor.atom(stringTable->getString(block.value), block);
+					}
+				}
+				else if (blockHeader.blockType == ANT_PROPERTY) {
+					PropertyAbstractNodeBlock block;
+					reader.read(block, context);
+					block.nodeInfo.lineNumber = visitStack.empty() ? rootLine : parentLine + block.nodeInfo.lineNumber;
+
+					VisitEntry entry = { ANT_PROPERTY, 1, block.nodeInfo.lineNumber };
+					visitStack.push_back(entry);
+					if (!skipDepth && !visitor.enterProperty(stringTable->getString(block.name), block)) {
+						skipDepth = visitStack.size();
+					}
+				}
+				else if (blockHeader.blockType == ANT_OBJECT) {
+					ObjectAbstractNodeBlock block;
+					reader.read(block, context);
+					block.nodeInfo.lineNumber = visitStack.empty() ? rootLine : parentLine + block.nodeInfo.lineNumber;
+
+					size_t idCount = serializer_cast<size_t>(block.bases.count + block.environmentVars.count * 2);
+					VisitEntry entry = { ANT_OBJECT, 3, block.nodeInfo.lineNumber };
+					visitStack.push_back(entry);
+					if (skipDepth || !visitor.enterObject(stringTable->getString(block.cls), stringTable->getString(block.name), block)) {
+						if (!skipDepth) skipDepth = visitStack.size();
+						for (size_t i = 0; i < idCount; i++) {
+							reader.readString(context);
+						}
+						continue;
+					}
+
+					ids.resize(idCount);
+					for (size_t i = 0; i < idCount; i++) {
+						ids[i] = reader.readString(context);
+					}
+
+					size_t baseCount = serializer_cast<size_t>(block.bases.count);
+					for (size_t i = 0; i < baseCount; i++) {
+						visitor.objectBase(stringTable->getString(ids[i]));
+					}
+					for (size_t i = baseCount; i < idCount; i += 2) {
+						visitor.objectVariable(stringTable->getString(ids[i]), stringTable->getString(ids[i + 1]));
+					}
+				}
+				else {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported node type", "ScriptSerializer::visitNodes");
+				}
+			}
+			else {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unexpected block in segment", "ScriptSerializer::visitNodes");
+			}
+		}
+	}
+
+	void ScriptSerializer::visitColumnSegment(BlockReader& reader, uint32 baseLine, ScriptSerializerVisitor& visitor) {
+		ColumnBuffer buffer;
+		ColumnView view;
+		readColumns(reader, buffer, view);
+
+		typedef std::vector<VisitEntry> VisitStack;
+
+		VisitStack visitStack;
+		size_t listDepth = 0;
+		size_t skipDepth = 0;		// Depth of the visit stack at which the skipped node lives. zero if not skipping
+		size_t node = 0, object = 0, list = 0;
+
+		for (size_t i = 0; i < view.counts.shapeCount; i++) {
+			uint8 code = view.shape[i];
+			if (code == SC_Node) {
+				stats.nodeBlocks++;
+				uint32 line = visitStack.empty() ? baseLine : visitStack.back().line + view.lines[node];
+
+				if (view.types[node] == ANT_ATOM) {
+					if (!skipDepth) {
+						AtomAbstractNodeBlock block;
+						block.nodeInfo.lineNumber = line;
+						block.id = view.ids[node];
+						block.value = view.strings[node];
+						visitor.atom(stringTable->getString(block.value), block);
+					}
+				}
+				else if (view.types[node] == ANT_PROPERTY) {
+					PropertyAbstractNodeBlock block;
+					block.nodeInfo.lineNumber = line;
+					block.id = view.ids[node];
+					block.name = view.strings[node];
+
+					VisitEntry entry = { ANT_PROPERTY, 1, line };
+					visitStack.push_back(entry);
+					if (!skipDepth && !visitor.enterProperty(stringTable->getString(block.name), block)) {
+						skipDepth = visitStack.size();
+					}
+				}
+				else {
+					ObjectAbstractNodeBlock block;
+					memset(&block, 0, sizeof(block));
+					block.nodeInfo.lineNumber = line;
+					block.name = view.strings[node];
+					block.cls = view.classes[object];
+					block.id = view.ids[node];
+					block.abstract = view.abstract[object] != 0;
+					block.bases.count = view.baseCounts[object];
+					block.environmentVars.count = view.variableCounts[object];
+
+					VisitEntry entry = { ANT_OBJECT, 3, line };
+					visitStack.push_back(entry);
+					if (!skipDepth && visitor.enterObject(stringTable->getString(block.cls), stringTable->getString(block.name), block)) {
+						const ResourceID* ids = view.lists + list;
+						for (uint32 b = 0; b < view.baseCounts[object]; b++) {
+							visitor.objectBase(stringTable->getString(ids[b]));
+						}
+						ids += view.baseCounts[object];
+						for (uint32 v = 0; v < view.variableCounts[object]; v++) {
+							visitor.objectVariable(stringTable->getString(ids[v * 2]), stringTable->getString(ids[v * 2 + 1]));
+						}
+					}
+					else if (!skipDepth) {
+						skipDepth = visitStack.size();
+					}
+					list += view.baseCounts[object] + view.variableCounts[object] * 2;
+					object++;
+				}
+				node++;
+			}
+			else if (code == SC_Up) {
+				if (listDepth == 0 || (listDepth > 1 && visitStack.empty())) {
+					OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unbalanced shape column", "ScriptSerializer::visitColumnSegment");
+				}
+
+				// The root list has no owner and closes the segment.  Every other list belongs to the node on top of the stack
+				if (--listDepth == 0) {
+					break;
+				}
+				if (--visitStack.back().listsLeft == 0) {
+					int nodeType = visitStack.back().type;
+					if (skipDepth == visitStack.size()) {
+						skipDepth = 0;
+					}
+					else if (!skipDepth) {
+						if (nodeType == ANT_OBJECT) visitor.exitObject();
+						else visitor.exitProperty();
+					}
+					visitStack.pop_back();
+				}
+			}
+			else if ((code & ~0x03) == SC_Down) {
+				listDepth++;
+			}
+			else {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Unsupported shape code", "ScriptSerializer::visitColumnSegment");
+			}
+		}
+	}
+
+	uint64 ScriptSerializer::hashTree(const AbstractNodePtr& node) {
+		NodeValueMap::iterator cached = subtreeHashes.find(node.get());
+		if (cached != subtreeHashes.end()) {
+			return cached->second;
+		}
+
+		// Everything that ends up in the node's blocks, with the children's lines taken relative to the node just like in the file
+		uint64 hash = hashOffsetBasis;
+		hashValue(hash, node->type);
+
+		if (node->type == ANT_ATOM) {
+			AtomAbstractNode* atomNode = serializer_cast<AtomAbstractNode*>(node.get());
+			hashValue(hash, atomNode->id);
+			hashString(hash, atomNode->value);
+		}
+		else if (node->type == ANT_PROPERTY) {
+			PropertyAbstractNode* propertyNode = serializer_cast<PropertyAbstractNode*>(node.get());
+			hashValue(hash, propertyNode->id);
+			hashString(hash, propertyNode->name);
+			hashValue(hash, propertyNode->values.size());
+			for (AbstractNodeList::iterator it = propertyNode->values.begin(); it != propertyNode->values.end(); ++it) {
+				hashValue(hash, (*it)->line - node->line);
+				hashValue(hash, hashTree(*it));
+			}
+		}
+		else if (node->type == ANT_OBJECT) {
+			ObjectAbstractNode* objectNode = serializer_cast<ObjectAbstractNode*>(node.get());
+			hashValue(hash, objectNode->id);
+			hashValue(hash, objectNode->abstract);
+			hashString(hash, objectNode->cls);
+			hashString(hash, objectNode->name);
+
+			hashValue(hash, objectNode->bases.size());
+			for (std::vector<String>::iterator it = objectNode->bases.begin(); it != objectNode->bases.end(); ++it) {
+				hashString(hash, *it);
+			}
+
+			const std::map<String, String>& variables = objectNode->getVariables();
+			hashValue(hash, variables.size());
+			for (std::map<String, String>::const_iterator it = variables.begin(); it != variables.end(); ++it) {
+				hashString(hash, it->first);
+				hashString(hash, it->second);
+			}
+
+			AbstractNodeList* lists[] = { &objectNode->overrides, &objectNode->values, &objectNode->children };
+			for (size_t i = 0; i < 3; i++) {
+				hashValue(hash, lists[i]->size());
+				for (AbstractNodeList::iterator it = lists[i]->begin(); it != lists[i]->end(); ++it) {
+					hashValue(hash, (*it)->line - node->line);
+					hashValue(hash, hashTree(*it));
+				}
+			}
+		}
+
+		subtreeHashes[node.get()] = hash;
+		return hash;
+	}
+
+	bool ScriptSerializer::equalTrees(const AbstractNode* a, const AbstractNode* b, bool compareLines) {
+		// Guards the subtree hashes against collisions.  Compares what hashTree covers, the lines unless told otherwise
+		if (a->type != b->type) {
+			return false;
+		}
+
+		if (a->type == ANT_ATOM) {
+			const AtomAbstractNode* atomA = serializer_cast<const AtomAbstractNode*>(a);
+			const AtomAbstractNode* atomB = serializer_cast<const AtomAbstractNode*>(b);
+			return atomA->id == atomB->id && atomA->value == atomB->value;
+		}
+		else if (a->type == ANT_PROPERTY) {
+			const PropertyAbstractNode* propertyA = serializer_cast<const PropertyAbstractNode*>(a);
+			const PropertyAbstractNode* propertyB = serializer_cast<const PropertyAbstractNode*>(b);
+			return propertyA->id == propertyB->id && propertyA->name == propertyB->name &&
+				equalLists(propertyA->values, a, propertyB->values, b, compareLines);
+		}
+		else if (a->type == ANT_OBJECT) {
+			const ObjectAbstractNode* objectA = serializer_cast<const ObjectAbstractNode*>(a);
+			const ObjectAbstractNode* objectB = serializer_cast<const ObjectAbstractNode*>(b);
+			return objectA->id == objectB->id && objectA->abstract == objectB->abstract &&
+				objectA->cls == objectB->cls && objectA->name == objectB->name &&
+				objectA->bases == objectB->bases && objectA->getVariables() == objectB->getVariables() &&
+				equalLists(objectA->overrides, a, objectB->overrides, b, compareLines) &&
+				equalLists(objectA->values, a, objectB->values, b, compareLines) &&
+				equalLists(objectA->children, a, objectB->children, b, compareLines);
+		}
+		return false;
+	}
+
+	bool ScriptSerializer::equalLists(const AbstractNodeList& a, const AbstractNode* parentA, const AbstractNodeList& b, const AbstractNode* parentB, bool compareLines) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (AbstractNodeList::const_iterator itA = a.begin(), itB = b.begin(); itA != a.end(); ++itA, ++itB) {
+			if ((compareLines && (*itA)->line - parentA->line != (*itB)->line - parentB->line) || !equalTrees(itA->get(), itB->get(), compareLines)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t ScriptSerializer::countNodes(const AbstractNode* node) {
+		size_t count = 1;
+		if (node->type == ANT_PROPERTY) {
+			const PropertyAbstractNode* propertyNode = serializer_cast<const PropertyAbstractNode*>(node);
+			for (AbstractNodeList::const_iterator it = propertyNode->values.begin(); it != propertyNode->values.end(); ++it) {
+				count += countNodes(it->get());
+			}
+		}
+		else if (node->type == ANT_OBJECT) {
+			const ObjectAbstractNode* objectNode = serializer_cast<const ObjectAbstractNode*>(node);
+			const AbstractNodeList* lists[] = { &objectNode->overrides, &objectNode->values, &objectNode->children };
+			for (size_t i = 0; i < 3; i++) {
+				for (AbstractNodeList::const_iterator it = lists[i]->begin(); it != lists[i]->end(); ++it) {
+					count += countNodes(it->get());
+				}
+			}
+		}
+		return count;
+	}
+
+	AbstractNode* ScriptSerializer::cloneTree(const AbstractNode* node, AbstractNode* parent, int lineOffset) {
+		AbstractNode* clone = node->clone();
+		clone->parent = parent;
+		adjustClone(node, clone, lineOffset);
+		return clone;
+	}
+
+	void ScriptSerializer::adjustClone(const AbstractNode* node, AbstractNode* clone, int lineOffset) {
+		// clone() keeps the lines of the original and, as of Ogre 1.8, leaves out the bases and overrides of objects
+		clone->line = node->line + lineOffset;
+		stats.nodesShared++;
+
+		if (node->type == ANT_ATOM) {
+			stats.stringCopies++;
+		}
+		else if (node->type == ANT_PROPERTY) {
+			const PropertyAbstractNode* propertyNode = serializer_cast<const PropertyAbstractNode*>(node);
+			PropertyAbstractNode* impl = serializer_cast<PropertyAbstractNode*>(clone);
+			stats.stringCopies++;
+			AbstractNodeList::iterator cloneIt = impl->values.begin();
+			for (AbstractNodeList::const_iterator it = propertyNode->values.begin(); it != propertyNode->values.end(); ++it, ++cloneIt) {
+				adjustClone(it->get(), cloneIt->get(), lineOffset);
+			}
+		}
+		else {
+			const ObjectAbstractNode* objectNode = serializer_cast<const ObjectAbstractNode*>(node);
+			ObjectAbstractNode* impl = serializer_cast<ObjectAbstractNode*>(clone);
+			impl->bases = objectNode->bases;
+			stats.stringCopies += 2 + impl->bases.size() + objectNode->getVariables().size() * 2;
+
+			impl->overrides.clear();
+			for (AbstractNodeList::const_iterator it = objectNode->overrides.begin(); it != objectNode->overrides.end(); ++it) {
+				impl->overrides.push_back(AbstractNodePtr(cloneTree(it->get(), impl, lineOffset)));
+			}
+
+			const AbstractNodeList* lists[] = { &objectNode->values, &objectNode->children };
+			AbstractNodeList* cloneLists[] = { &impl->values, &impl->children };
+			for (size_t i = 0; i < 2; i++) {
+				AbstractNodeList::iterator cloneIt = cloneLists[i]->begin();
+				for (AbstractNodeList::const_iterator it = lists[i]->begin(); it != lists[i]->end(); ++it, ++cloneIt) {
+					adjustClone(it->get(), cloneIt->get(), lineOffset);
+				}
+			}
+		}
+	}
+
+	void ScriptSerializer::writeSegmentTable(const DataStreamPtr& stream, const SegmentTable& segments, const SegmentDependencyList& dependencies) {
+		ScriptBlockHeader blockHeader;
+		blockHeader.blockID = ++blockIdCounter;
+		blockHeader.blockClass = BC_SegmentTable;
+		blockHeader.blockType = 0;		// Not used
+
+		SegmentTableBlock block;
+		block.count = segments.size();
+		block.dependencyCount = 0;
+		for (SegmentDependencyList::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+			block.dependencyCount += it->size();
+		}
+
+		writeBlockToStream(stream, blockHeader, block);
+		if (!segments.empty()) {
+			stream->write(&segments[0], segments.size() * sizeof(SegmentEntry));
+		}
+
+		// The dependencies of all segments follow in one list, in the order of the segments
+		for (SegmentDependencyList::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+			if (!it->empty()) {
+				stream->write(&(*it)[0], it->size() * sizeof(uint64));
+			}
+		}
+	}
+
+	void ScriptSerializer::readSegmentTable(const DataStreamPtr& stream, SegmentTable& segments, SegmentDependencies& dependencies) {
+		ScriptBlockHeader blockHeader;
+		readBlockFromStream(stream, blockHeader);
+
+		if (blockHeader.blockClass != BC_SegmentTable) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Error reading Segment Table", "ScriptSerializer::readSegmentTable");
+		}
+
+		SegmentTableBlock block;
+		readBlockFromStream(stream, block);
+
+		segments.resize(serializer_cast<size_t>(block.count));
+		if (!segments.empty()) {
+			stream->read(&segments[0], segments.size() * sizeof(SegmentEntry));
+		}
+		dependencies.resize(serializer_cast<size_t>(block.dependencyCount));
+		if (!dependencies.empty()) {
+			stream->read(&dependencies[0], dependencies.size() * sizeof(uint64));
+		}
+	}
+
+	bool ScriptSerializer::isSupported(const ScriptHeader& header) {
+		return header.magic == magicCode && header.version == version;
+	}
+
+	uint16 ScriptSerializer::getFormatVersion() {
+		return version;
+	}
+
+	void ScriptSerializer::readHeader(const DataStreamPtr& stream, ScriptHeader& header) {
+		readFromStream(stream, header);
+
+		if (header.magic != magicCode) {
+			OGRE_EXCEPT(Exception::ERR_INTERNAL_ERROR, "Binary file is not in correct format: " + stream->getName(), "ScriptSerializer::readHeader");
+		}
+		else if (header.version != version) {
+			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Binary script is in an older format.  Please reparse the script", "ScriptSerializer::readHeader");
+		}
+		debugInfo = !(header.flags & SF_Release);
+		compactStrings = (header.flags & SF_CompactStrings) != 0;
+	}
+
+	void ScriptSerializer::writeStringTable(const DataStreamPtr& stream) {
+		ScriptBlockHeader blockHeader;
+		blockHeader.blockID = ++blockIdCounter;
+		blockHeader.blockClass = BC_StringTable;
+		blockHeader.blockType = 0;		// Not used
+
+		StringTableBlock block;
+		StringTable::ResourceTable& table = stringTable->getTable();
+		block.count = table.size();
+		stats.stringBytes = 0;
+
+		writeBlockToStream(stream, blockHeader, block);
+
+		// Written in id order, so strings with small ids lie next to each other when loaded
+		std::vector<StringTable::ResourceTable::const_iterator> byId(stringTable->getIdLimit(), table.end());
+		for (StringTable::ResourceTable::const_iterator it = table.begin(); it != table.end(); ++it) {
+			byId[it->second] = it;
+		}
+
+		for (size_t i = 1; i < byId.size(); i++) {
+			if (byId[i] == table.end()) {
+				continue;
+			}
+			const String& data = byId[i]->first;
+			ResourceID id = byId[i]->second;
 			uint32 length = serializer_cast<uint32>(data.length());
+			uint32 references = stringTable->getReferenceCount(id);
 
 			writeToStream(stream, id);
 			writeToStream(stream, length);
+			writeToStream(stream, references);
 			stream->write(data.c_str(), length);
+			stats.stringBytes += length;
 		}
+		stats.stringCount = table.size();
 	}
 
 	
 	void ScriptSerializer::readStringTable(const DataStreamPtr& stream) {
 		ScriptBlockHeader blockHeader;
-		readFromStream(stream, blockHeader);
+		readBlockFromStream(stream, blockHeader);
 
 		if (blockHeader.blockClass != BC_StringTable) {
 			OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "Error reading String Table", "ScriptSerializer::readStringTable");
 		}
 
 		StringTableBlock block;
-		readFromStream(stream, block);
+		readBlockFromStream(stream, block);
+		stats.stringBytes = 0;
 
-		for (int i = 0; i < block.count; i++) {
+		for (uint64 i = 0; i < block.count; i++) {
 			ResourceID id;
 			uint32 length;
+			uint32 references;
 
 			readFromStream(stream, id);
 			readFromStream(stream, length);
+			readFromStream(stream, references);
+
+			// Ids run from 1 to the number of strings.  Anything above would have the table grow to a size taken from the file
+			if (id == 0 || id > block.count) {
+				OGRE_EXCEPT(Exception::ERR_INVALID_STATE, "String id outside of the String Table", "ScriptSerializer::readStringTable");
+			}
 
-			char *buffer = new char[length + 1];
-			stream->read(buffer, length);
-			buffer[length] = 0;		// String null terminator
-			String value = String(buffer);
-			stringTable->setKeyValue(id, value);
-			delete buffer;
+			// Read the characters straight into the string's final storage
+			String& value = stringTable->loadString(id, references);
+			value.resize(length);
+			if (length) {
+				stream->read(&value[0], length);
+			}
+			stats.stringBytes += length;
 		}
+		stats.stringCount = serializer_cast<size_t>(block.count);
 	}
 
 
-	ScriptBlock::BlockEntry* ScriptSerializer::readBlock(const DataStreamPtr& stream) {
-		
-		return 0;
-	}
-
 	template<typename T> 
 	void ScriptSerializer::writeToStream(const DataStreamPtr& stream, T& t) {
 		stream->write(reinterpret_cast<const char*>(&t), sizeof(T));
@@ -392,38 +1889,200 @@ namespace Ogre {
 	void ScriptSerializer::readFromStream(const DataStreamPtr& stream, T& t) {
 		stream->read(reinterpret_cast<char*>(&t), sizeof(T));
 	}
+
+	template<typename Block>
+	void ScriptSerializer::writeBlockToStream(const DataStreamPtr& stream, const ScriptBlockHeader& header, const Block& block) {
+		uint8 bytes[BlockCodec<ScriptBlockHeader>::maxSize + BlockCodec<Block>::maxSize];
+		NullSink sink;
+		CodecContext context(releaseProfile, header.flags);
+		uint8* end = BlockCodec<ScriptBlockHeader>::encode(header, bytes, context, sink);
+		end = BlockCodec<Block>::encode(block, end, context, sink);
+		stream->write(bytes, end - bytes);
+	}
+
+	template<typename Block>
+	void ScriptSerializer::readBlockFromStream(const DataStreamPtr& stream, Block& block) {
+		// Reads as much as the block may take, and steps back over what it did not
+		uint8 bytes[BlockCodec<Block>::maxSize];
+		size_t available = stream->read(bytes, sizeof(bytes));
+		BlockReader reader(bytes, bytes + available, 0);
+		reader.read(block, readContext(0));
+		stream->skip(static_cast<long>(reader.tell()) - static_cast<long>(available));
+	}
+
+	CodecContext ScriptSerializer::readContext(uint8 blockFlags) const {
+		return CodecContext(!debugInfo, blockFlags, compactStrings);
+	}
+
+	BlockReader ScriptSerializer::loadBlocks(const DataStreamPtr& stream, uint64 offset, uint64 size, ByteBuffer& buffer) {
+		if (offset + size > stream->size()) {
+			OGRE_EXCEPT(Exception::ERR_INVALIDPARAMS, "Blocks lie past the end of " + stream->getName(), "ScriptSerializer::loadBlocks");
+		}
+		size_t length = serializer_cast<size_t>(size);
+		buffer.resize(std::max<size_t>(length, 1));
+		stream->seek(serializer_cast<size_t>(offset));
+		if (stream->read(&buffer[0], length) != length) {
+			OGRE_EXCEPT(Exception::ERR_INVALIDPARAMS, "Cannot read the blocks of " + stream->getName(), "ScriptSerializer::loadBlocks");
+		}
+		return BlockReader(&buffer[0], &buffer[0] + length, serializer_cast<size_t>(offset));
+	}
+
+	template<typename Block>
+	void SegmentWriter::writeBlock(const ScriptBlockHeader& header, const Block& block) {
+		size_t start = data.size();
+		data.resize(start + BlockCodec<ScriptBlockHeader>::maxSize + BlockCodec<Block>::maxSize);
+		CodecContext context(release, header.flags);
+		uint8* end = BlockCodec<ScriptBlockHeader>::encode(header, &data[start], context, *this);
+		end = BlockCodec<Block>::encode(block, end, context, *this);
+		data.resize(end - &data[0]);
+	}
+
+	static bool isBefore(const SegmentWriter::StringFixup& a, const SegmentWriter::StringFixup& b) {
+		return a.position < b.position;
+	}
+
+	void SegmentWriter::compactStrings() {
+		std::sort(stringFixups.begin(), stringFixups.end(), isBefore);
+
+		ByteBuffer compacted;
+		compacted.reserve(data.size());
+		compactedEnds.clear();
+		size_t copied = 0;
+		NullSink sink;
+		for (StringFixupList::iterator fixup = stringFixups.begin(); fixup != stringFixups.end(); ++fixup) {
+			compacted.insert(compacted.end(), data.begin() + copied, data.begin() + fixup->position);
+			copied = fixup->position + sizeof(ResourceID);
+			fixup->position = compacted.size();
+
+			uint8 bytes[FieldCodec<ResourceID, FE_Varint>::maxSize];
+			uint8* end = FieldCodec<ResourceID, FE_Varint>::encode(fixup->id, bytes, sink);
+			compacted.insert(compacted.end(), bytes, end);
+			compactedEnds.push_back(std::make_pair(copied, compacted.size()));
+		}
+		compacted.insert(compacted.end(), data.begin() + copied, data.end());
+		data.swap(compacted);
+
+		for (ReferenceFixupList::iterator fixup = referenceFixups.begin(); fixup != referenceFixups.end(); ++fixup) {
+			fixup->position = compactedPosition(fixup->position);
+		}
+	}
+
+	size_t SegmentWriter::compactedPosition(size_t position) const {
+		// Moves back by what the string ids before the position gave up
+		std::vector<std::pair<size_t, size_t> >::const_iterator after =
+			std::upper_bound(compactedEnds.begin(), compactedEnds.end(), std::make_pair(position, std::numeric_limits<size_t>::max()));
+		if (after == compactedEnds.begin()) {
+			return position;
+		}
+		--after;
+		return after->second + (position - after->first);
+	}
 
 
 	StringTable::StringTable() : idCounter(0) {
 	}
 
 	ResourceID StringTable::registerString(const String& data) {
-		if (table.count(data)) {
-			return table[data];
+		ResourceTable::iterator it = table.lower_bound(data);
+		if (it != table.end() && it->first == data) {
+			strings[it->second].references++;
+			return it->second;
 		}
 
 		ResourceID id = ++idCounter;
-		table[data] = id;
-		reverseLookup[id] = data;
+		table.insert(it, ResourceTable::value_type(data, id));
+		strings.resize(id + 1);
+		strings[id].references = 1;
 		return id;
 	}
 
-	String StringTable::getString(ResourceID id) {
-		if (!reverseLookup.count(id)) {
-			OGRE_EXCEPT(Exception::ERR_ITEM_NOT_FOUND, "Cannot find resource string with specified id", "StringTable::getString");
+	StringTable::StringEntry& StringTable::getEntry(ResourceID id) {
+		if (id >= strings.size()) {
+			OGRE_EXCEPT(Exception::ERR_ITEM_NOT_FOUND, "Cannot find resource string with specified id", "StringTable::getEntry");
 		}
-		return reverseLookup[id];
+		return strings[id];
 	}
 
-	void StringTable::clear() {
+	const String& StringTable::getString(ResourceID id) {
+		return getEntry(id).value;
+	}
+
+	uint32 StringTable::getReferenceCount(ResourceID id) {
+		return getEntry(id).references;
+	}
+
+	String& StringTable::loadString(ResourceID id, uint32 references) {
+		if (id >= strings.size()) {
+			strings.resize(id + 1);
+		}
+		strings[id].references = references;
+		return strings[id].value;
+	}
+
+	bool StringTable::takeString(ResourceID id, String& destination) {
+		StringEntry& entry = getEntry(id);
+		if (entry.references > 1) {
+			entry.references--;
+			destination = entry.value;
+			return true;
+		}
+
+		// Last reference. Nothing else needs the table's copy
+		entry.references = 0;
+		destination.swap(entry.value);
+		return false;
+	}
+
+	void StringTable::indexStrings() {
 		table.clear();
-		reverseLookup.clear();
-		idCounter = 0;
+		for (size_t id = 1; id < strings.size(); id++) {
+			table.insert(ResourceTable::value_type(strings[id].value, serializer_cast<ResourceID>(id)));
+		}
+		idCounter = strings.empty() ? 0 : serializer_cast<ResourceID>(strings.size() - 1);
+	}
+
+	void StringTable::mergeStrings(const StringTable& other, std::vector<ResourceID>& remap) {
+		// Walk the other table in id order, so merged strings keep the order they were first met in
+		std::vector<const String*> values(other.strings.size(), 0);
+		for (ResourceTable::const_iterator it = other.table.begin(); it != other.table.end(); ++it) {
+			values[it->second] = &it->first;
+		}
+
+		remap.assign(values.size(), 0);
+		for (size_t id = 1; id < values.size(); id++) {
+			ResourceID merged = registerString(*values[id]);
+			strings[merged].references += other.strings[id].references - 1;
+			remap[id] = merged;
+		}
 	}
 
-	void StringTable::setKeyValue(ResourceID id, const String& data) {
-		table[data] = id;
-		reverseLookup[id] = data;
+	void StringTable::orderByReferences(std::vector<ResourceID>& remap) {
+		std::vector<std::pair<uint32, ResourceID> > order;
+		for (size_t id = 1; id < strings.size(); id++) {
+			// Negated counts sort the most referenced first.  Ties keep their first seen order
+			order.push_back(std::make_pair(~strings[id].references, serializer_cast<ResourceID>(id)));
+		}
+		std::sort(order.begin(), order.end());
+
+		StringList ordered(strings.size());
+		remap.assign(strings.size(), 0);
+		for (size_t i = 0; i < order.size(); i++) {
+			ResourceID id = serializer_cast<ResourceID>(i + 1);
+			remap[order[i].second] = id;
+			ordered[id].value.swap(strings[order[i].second].value);
+			ordered[id].references = strings[order[i].second].references;
+		}
+		strings.swap(ordered);
+
+		for (ResourceTable::iterator it = table.begin(); it != table.end(); ++it) {
+			it->second = remap[it->second];
+		}
+	}
+
+	void StringTable::clear() {
+		table.clear();
+		strings.clear();
+		idCounter = 0;
 	}
 
 }
\ No newline at end of file
@@ -2,12 +2,32 @@
 #include "ScriptSerializerManager.h"
 #include "ScriptSerializer.h"
 #include "ShaderSerializer.h"
+#include "ScriptAstCache.h"
+#include "ScriptCacheFileTimes.h"
+#include "ScriptCacheListener.h"
+#include "ScriptCachePack.h"
+#include "ScriptCachePipeline.h"
+#include "ScriptCacheReadAhead.h"
+#include "ScriptCacheStore.h"
+#include "MaterialStateSerializer.h"
 #include "OgreScriptTranslator.h"
 #include "OgreZip.h"
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <direct.h>
 #include <sstream>
+#include <fstream>
+#include <climits>
+#include <cctype>
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+#	include <direct.h>
+#	include <io.h>
+#	include <fcntl.h>
+#	define SCRIPTCACHE_MKDIR(path) _mkdir(path)
+#else
+#	include <unistd.h>
+#	define SCRIPTCACHE_MKDIR(path) mkdir(path, 0755)
+#endif
 
 using namespace std;
 
@@ -16,13 +36,186 @@ namespace Ogre {
 	/** The filename of the config file */
 	const String configFileName = "ScriptCache.cfg";
 
-	ScriptSerializerManager::ScriptSerializerManager() : mCompiler(0)
+	/** The file in the cache folder recording when each cached script was last used */
+	const String usageFileName = "ScriptCache.usage";
+
+	/** Appended to the name of a cached script for the state of its materials */
+	const String materialStateExtension = ".state";
+
+	/** How many times each path is run when comparing the text parser with the binary decoder */
+	const size_t comparisonRuns = 3;
+
+	/** A pack holding the same scripts is only rebuilt in the new order once a cold start would seek for more than one in this many */
+	const size_t packReorderDivisor = 10;
+
+	/// Takes the tree the text parser made and stops the compiler before it translates it
+	struct ScriptSerializerManager::ConversionCapture : public ScriptCompilerListener {
+		ConversionCapture() : failed(false) { }
+
+		virtual bool postConversion(ScriptCompiler *compiler, const AbstractNodeListPtr& ast) {
+			this->ast = ast;
+			return false;
+		}
+
+		virtual void handleError(ScriptCompiler *compiler, uint32 code, const String &file, int line, const String &msg) {
+			failed = true;
+		}
+
+		AbstractNodeListPtr ast;
+		bool failed;
+	};
+
+	/// A text script missing from the cache, parsed ahead of its turn
+	struct ScriptSerializerManager::ParseJob {
+		String scriptName;
+		String text;
+		AbstractNodeListPtr ast;		// Stays null if the script has errors.  Ogre then parses it again and reports them
+	};
+
+	/// Parses every step-th job of the list, starting with the first one given.  Each worker has a compiler of its own
+	struct ScriptSerializerManager::ParseWorker {
+		ParseWorker(ParseJobList* jobs, const String* groupName, ScriptCacheListener* listener, size_t first, size_t step)
+			: jobs(jobs), groupName(groupName), listener(listener), first(first), step(step) { }
+
+		void operator()() {
+			ScriptCacheStage stage(listener, "parse", StringUtil::BLANK, first);
+			ConversionCapture capture;
+			ScriptCompiler compiler;
+			compiler.setListener(&capture);
+			for (size_t i = first; i < jobs->size(); i += step) {
+				ParseJob& job = (*jobs)[i];
+				capture.ast.setNull();
+				capture.failed = false;
+				try {
+					compiler.compile(job.text, job.scriptName, *groupName);
+				}
+				catch (Exception&) {
+					// The lexer and parser throw on malformed text.  The tree stays null and Ogre reports the error
+					continue;
+				}
+				if (!capture.failed && !capture.ast.isNull() && !capture.ast->empty()) {
+					job.ast = capture.ast;
+				}
+			}
+		}
+
+		ParseJobList* jobs;
+		const String* groupName;
+		ScriptCacheListener* listener;
+		size_t first;
+		size_t step;
+	};
+
+	/// The pipeline's stages, done the way the manager reads, decodes and writes cached scripts on this thread
+	struct ScriptSerializerManager::PipelineStages : public ScriptCachePipeline::Stages, public ScriptSerializerAlloc {
+		PipelineStages(ScriptSerializerManager* manager) : manager(manager) { }
+
+		virtual DataStreamPtr readScript(const String& binaryFilename, time_t scriptTimestamp, bool cached) {
+			return manager->readFreshScript(binaryFilename, scriptTimestamp, cached);
+		}
+
+		virtual AbstractNodeListPtr decodeScript(const DataStreamPtr& stream) {
+			ScriptSerializer serializer;
+			return serializer.deserialize(stream);
+		}
+
+		virtual void writeScript(const String& binaryFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+			manager->saveAstToDisk(binaryFilename, scriptTimestamp, ast, ScriptCachePipeline::WriteThread);
+		}
+
+		ScriptSerializerManager* manager;
+	};
+
+	/// Whether the text has an import statement.  Only the word on its own counts, split the way the lexer splits words
+	static bool hasImport(const String& text) {
+		static const String keyword = "import";
+		for (size_t pos = text.find(keyword); pos != String::npos; pos = text.find(keyword, pos + 1)) {
+			size_t end = pos + keyword.length();
+			bool starts = pos == 0 || isspace(static_cast<unsigned char>(text[pos - 1])) || text[pos - 1] == '{' || text[pos - 1] == '}';
+			bool ends = end == text.length() || isspace(static_cast<unsigned char>(text[end])) || text[end] == '{' || text[end] == '}' || text[end] == '"';
+			if (starts && ends) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool isMaterial(const AbstractNodePtr& node) {
+		if (node->type != ANT_OBJECT) {
+			return false;
+		}
+		const ObjectAbstractNode* objectNode = static_cast<const ObjectAbstractNode*>(node.get());
+		return objectNode->cls == "material" && !objectNode->abstract;
+	}
+
+	/// Cuts the file at path to the given size
+	static bool truncateFile(const String& path, size_t size) {
+#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
+		int file = _open(path.c_str(), _O_RDWR | _O_BINARY);
+		if (file == -1) {
+			return false;
+		}
+		bool truncated = _chsize_s(file, size) == 0;
+		_close(file);
+		return truncated;
+#else
+		return truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+	}
+
+	static void listMaterials(const AbstractNodeListPtr& ast, StringVector& names) {
+		for (AbstractNodeList::iterator it = ast->begin(); it != ast->end(); ++it) {
+			if (isMaterial(*it)) {
+				names.push_back(static_cast<ObjectAbstractNode*>(it->get())->name);
+			}
+		}
+	}
+
+	static size_t countNodes(const AbstractNodeList& nodes) {
+		size_t count = 0;
+		for (AbstractNodeList::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+			count++;
+			if ((*it)->type == ANT_PROPERTY) {
+				count += countNodes(static_cast<const PropertyAbstractNode*>(it->get())->values);
+			}
+			else if ((*it)->type == ANT_OBJECT) {
+				const ObjectAbstractNode* objectNode = static_cast<const ObjectAbstractNode*>(it->get());
+				count += countNodes(objectNode->children) + countNodes(objectNode->values) + countNodes(objectNode->overrides);
+			}
+		}
+		return count;
+	}
+
+	/// A size given in megabytes, in bytes.  Sizes past what size_t holds are clamped instead of wrapping around
+	static size_t parseMegabytes(const String& setting) {
+		size_t megabytes = StringConverter::parseUnsignedInt(setting);
+		size_t limit = static_cast<size_t>(-1) / (1024 * 1024);
+		return std::min(megabytes, limit) * 1024 * 1024;
+	}
+
+	ScriptSerializerManager::ScriptSerializerManager() : mCompiler(0), compressShaders(true), rebuildPack(false), cacheModified(false), mPack(0), mScriptTimes(0), mCacheTimes(0), mReadAhead(0), readAhead(false),
+		mAstCache(0), astCacheBudget(0), usageModified(false), maxCacheSize(0), collectionPending(false), mCacheListener(0),
+		pendingScriptCount(0), compileBatchSize(0), batchCompile(false), encodeThreadCount(1), columnarLayout(false), releaseProfile(false), frequencyOrder(false),
+		parseThreadCount(1), mPipeline(0), mPipelineStages(0), pipeline(false), pipelineQueueSize(0), mStore(0), materialState(false)
 	{
 		initializeConfig(configFileName);
-		bool pluginEnabled = initializeArchive(scriptCacheLocation);
+		pluginEnabled = initializeArchive(scriptCacheLocation);
 		if (pluginEnabled) {
 			mCompiler = OGRE_NEW ScriptCompiler();
 			initializeShaderCache();
+			initializePack();
+			initializeStore();
+			mScriptTimes = OGRE_NEW ScriptCacheFileTimes();
+			mCacheTimes = OGRE_NEW ScriptCacheFileTimes();
+			mReadAhead = OGRE_NEW ScriptCacheReadAhead();
+			loadUsage();
+			if (astCacheBudget) {
+				mAstCache = OGRE_NEW ScriptAstCache(astCacheBudget);
+			}
+			if (pipeline) {
+				mPipelineStages = OGRE_NEW PipelineStages(this);
+				mPipeline = OGRE_NEW ScriptCachePipeline(mPipelineStages, pipelineQueueSize);
+			}
 			ResourceGroupManager::getSingleton().addResourceGroupListener(this);
 			ScriptCompilerManager::getSingleton().setListener(this);
 		}
@@ -35,18 +228,45 @@ namespace Ogre {
 			if (this == Ogre::ScriptCompilerManager::getSingleton().getListener()) {
 				Ogre::ScriptCompilerManager::getSingleton().setListener(0);
 			}
+			saveShaderCache();
+
+			// Stops the pipeline's threads once the trees still queued are written
+			OGRE_DELETE mPipeline;
+			OGRE_DELETE mPipelineStages;
+#ifdef USE_MICROCODE_SHADERCACHE
+			OGRE_DELETE mShaderSerializer;
+#endif
+			OGRE_DELETE mReadAhead;
+			OGRE_DELETE mCacheTimes;
+			OGRE_DELETE mScriptTimes;
+			OGRE_DELETE mAstCache;
+			saveUsage();
+			savePack();
+			OGRE_DELETE mPack;
+			OGRE_DELETE mStore;
 			mCacheArchive->unload();
 			OGRE_DELETE mCompiler;
 		}
 	}
 
+	ScriptSerializerMemoryStats ScriptSerializerManager::getMemoryStats() const {
+		return ScriptSerializerTrackingAllocPolicy::getStats();
+	}
+
+	void ScriptSerializerManager::setCacheListener(ScriptCacheListener* listener) {
+		mCacheListener = listener;
+		if (mPipeline) {
+			mPipeline->setListener(listener);
+		}
+	}
+
 	bool ScriptSerializerManager::initializeArchive(const String& archiveName) {
 		// Check if the directory exists
 		struct stat dirInfo;
 		int status = stat(archiveName.c_str(), &dirInfo);
 		if (status) {
 			// Directory does not exist. Create one
-			int error = mkdir(archiveName.c_str());
+			int error = SCRIPTCACHE_MKDIR(archiveName.c_str());
 			if (error) {
 				LogManager::getSingleton().logMessage("WARNING: Failed to create Script Cache directory.  Script cache plugin disabled");
 				return false;
@@ -65,15 +285,9 @@ namespace Ogre {
 	
 	void ScriptSerializerManager::initializeShaderCache() {
 #ifdef USE_MICROCODE_SHADERCACHE
-		mShaderSerializer = OGRE_NEW ShaderSerializer();
-
-		// Check if we the shaders have previously been cached
-		if (mCacheArchive->exists(shaderCacheFilename)) {
-			// A previously cached shader file exists.  load it
-			DataStreamPtr shaderCache = mCacheArchive->open(shaderCacheFilename);
-			mShaderSerializer->loadCache(shaderCache);
-			shaderCache->close();
-		}
+		// Only the index is read here.  The microcode is handed to Ogre as the scripts declare its programs
+		mShaderSerializer = OGRE_NEW ShaderSerializer(mCacheArchive->getName() + "/" + shaderCacheFilename, compressShaders);
+		mShaderSerializer->loadIndex();
 
 		// Start cache new shader code
 		mShaderSerializer->setCaching(true);
@@ -82,26 +296,538 @@ namespace Ogre {
 
 	void ScriptSerializerManager::saveShaderCache() {
 #ifdef USE_MICROCODE_SHADERCACHE
-		// A previously cached shader file exists.  load it
-		DataStreamPtr shaderCache = mCacheArchive->create(shaderCacheFilename);
-		mShaderSerializer->saveCache(shaderCache);
-		shaderCache->close();
+		size_t appended = mShaderSerializer->saveCache();
+		if (appended) {
+			stringstream message;
+			message << "Shader cache: " << appended << " programs appended to " << shaderCacheFilename;
+			LogManager::getSingleton().logMessage(message.str());
+		}
 #endif
 	}
 	
+	void ScriptSerializerManager::initializePack() {
+		mPack = OGRE_NEW ScriptCachePack();
+		if (!packFilename.empty()) {
+			String packPath = mCacheArchive->getName() + "/" + packFilename;
+			if (mPack->load(packPath)) {
+				LogManager::getSingleton().logMessage("Mapped script cache pack: " + packPath);
+			}
+		}
+	}
+
+	void ScriptSerializerManager::initializeStore() {
+		if (storeLocation.empty()) {
+			return;
+		}
+
+		struct stat dirInfo;
+		if (stat(storeLocation.c_str(), &dirInfo) && SCRIPTCACHE_MKDIR(storeLocation.c_str())) {
+			LogManager::getSingleton().logMessage("WARNING: Failed to create the shared script cache " + storeLocation + ".  Scripts are only cached locally");
+			return;
+		}
+		mStore = OGRE_NEW ScriptCacheStore(storeLocation);
+		LogManager::getSingleton().logMessage("Sharing cached scripts through " + storeLocation);
+	}
+
+	/**
+	 * The key hashes the script's own text only.  The tree of a script that imports holds the objects it inherits from
+	 * the imported scripts, which may differ between branches with the same text, so such scripts get no key
+	 */
+	static String makeStoreKey(const String& scriptName, const String& text, bool releaseProfile) {
+		if (hasImport(text)) {
+			return StringUtil::BLANK;
+		}
+		return ScriptCacheStore::makeKey(scriptName, text, releaseProfile);
+	}
+
+	const String& ScriptSerializerManager::getStoreKey(const String& scriptName) {
+		StoreKeyMap::iterator it = mStoreKeys.find(scriptName);
+		if (it == mStoreKeys.end()) {
+			DataStreamPtr textStream = ResourceGroupManager::getSingleton().openResource(scriptName, mActiveResourceGroup);
+			it = mStoreKeys.insert(StoreKeyMap::value_type(scriptName, makeStoreKey(scriptName, textStream->getAsString(), releaseProfile))).first;
+			textStream->close();
+		}
+		return it->second;
+	}
+
+	bool ScriptSerializerManager::fetchFromStore(const String& scriptName, const String& binaryFilename, time_t scriptTimestamp) {
+		// Another branch may have cached the same text.  The copy becomes the local cached script
+		const String& key = getStoreKey(scriptName);
+		if (key.empty()) {
+			return false;
+		}
+		ScriptCacheStage stage(mCacheListener, "shared store", binaryFilename);
+		if (!mStore->fetch(key, mCacheArchive->getName() + "/" + binaryFilename, scriptTimestamp)) {
+			return false;
+		}
+		LogManager::getSingleton().logMessage("Fetched cached script from the shared store: " + binaryFilename);
+		mCacheTimes->update(binaryFilename, true, time(0));
+		cacheModified = true;
+		return true;
+	}
+
+	void ScriptSerializerManager::savePack() {
+		if (packFilename.empty() || !rebuildPack) {
+			return;
+		}
+
+		// Ogre asks for the scripts in the same order every run.  Store them in that order so a cold start reads the pack 
+		// from front to back.  Scripts not asked for this run keep their place from the previous pack, new ones go last
+		StringVector currentLayout = mPack->getLayout();
+		StringVectorPtr names = mCacheArchive->find("*" + binaryScriptExtension, false);
+		std::set<String> remaining(names->begin(), names->end());
+		bool sameScripts = (remaining == std::set<String>(currentLayout.begin(), currentLayout.end()));
+		StringVector layout;
+		for (StringVector::iterator it = accessOrder.begin(); it != accessOrder.end(); ++it) {
+			if (remaining.erase(*it)) {
+				layout.push_back(*it);
+			}
+		}
+		for (StringVector::iterator it = currentLayout.begin(); it != currentLayout.end(); ++it) {
+			if (remaining.erase(*it)) {
+				layout.push_back(*it);
+			}
+		}
+		layout.insert(layout.end(), remaining.begin(), remaining.end());
+
+		// Only rebuild when scripts were re-serialized, the pack is missing, or it holds the same scripts in an order that
+		// makes a cold start seek too often.  A pack shipped without the loose files it was built from is left alone
+		bool reordered = false;
+		if (sameScripts && layout != currentLayout) {
+			map<String, size_t>::type packed;
+			for (size_t i = 0; i < currentLayout.size(); i++) {
+				packed[currentLayout[i]] = i;
+			}
+			size_t seeks = 0;
+			for (size_t i = 1; i < layout.size(); i++) {
+				if (packed[layout[i]] != packed[layout[i - 1]] + 1) {
+					seeks++;
+				}
+			}
+			reordered = seeks * packReorderDivisor > layout.size();
+		}
+		if (!cacheModified && mPack->isLoaded() && !reordered) {
+			return;
+		}
+
+		// Release our own view first. Windows cannot replace a file that is still mapped
+		mPack->unload();
+		ScriptCachePack::build(mCacheArchive->getName() + "/" + packFilename, mCacheArchive, layout);
+	}
+
+	void ScriptSerializerManager::recordAccess(const String& filename) {
+		if (!packFilename.empty() && accessedScripts.insert(filename).second) {
+			accessOrder.push_back(filename);
+		}
+	}
+
 	void ScriptSerializerManager::resourceGroupScriptingStarted(const String& groupName, size_t scriptCount) {
 		mActiveResourceGroup = groupName;
+
+		// The resource locations are known by the time the first group parses its scripts
+		if (collectionPending) {
+			collectionPending = false;
+			collectGarbage();
+		}
+
+		scanFileTimes(groupName);
+		if (readAhead) {
+			readAheadGroup(groupName);
+		}
+		if (parseThreadCount > 1) {
+			parseMissesAhead(groupName);
+		}
+		if (mPipeline) {
+			startPipeline(groupName);
+		}
+	}
+
+	void ScriptSerializerManager::readAheadGroup(const String& groupName) {
+		// Ask for the cached version of every text script in the group, so the files are already in memory
+		// by the time scriptParseStarted opens them one after the other
+		StringVector paths;
+		size_t packed = 0;
+		for (StringVector::iterator extension = scriptExtensions.begin(); extension != scriptExtensions.end(); ++extension) {
+			StringVectorPtr names = ResourceGroupManager::getSingleton().findResourceNames(groupName, "*." + *extension);
+			for (StringVector::iterator it = names->begin(); it != names->end(); ++it) {
+				String binaryFilename = *it + binaryScriptExtension;
+				if (mPack->prefetch(binaryFilename)) {
+					packed++;
+				}
+				else if (cachedScriptExists(binaryFilename)) {
+					paths.push_back(mCacheArchive->getName() + "/" + binaryFilename);
+				}
+			}
+		}
+
+		if (!paths.empty() || packed) {
+			stringstream message;
+			message << "Reading ahead " << paths.size() << " cached scripts and " << packed << " packed scripts of group " << groupName;
+			LogManager::getSingleton().logMessage(message.str());
+		}
+		mReadAhead->start(paths);
+	}
+
+	void ScriptSerializerManager::scanFileTimes(const String& groupName) {
+		// Checking a script against its cached version takes a stat of each and an open of the cached one.  
+		// List each folder holding the group's scripts and the cache folder once instead, and answer those from the listings
+		ScriptCacheStage stage(mCacheListener, "file times", groupName);
+		mScriptTimes->clear();
+		mCacheTimes->clear();
+		for (StringVector::iterator extension = scriptExtensions.begin(); extension != scriptExtensions.end(); ++extension) {
+			FileInfoListPtr files = ResourceGroupManager::getSingleton().findResourceFileInfo(groupName, "*." + *extension);
+			for (FileInfoList::iterator it = files->begin(); it != files->end(); ++it) {
+				// Other archives, zips among them, have no folder to list.  Their scripts are checked one by one as before
+				if (it->archive->getType() == "FileSystem") {
+					mScriptTimes->request(it->archive->getName() + "/" + it->path, it->basename, it->filename);
+				}
+
+				String binaryFilename = it->filename + binaryScriptExtension;
+				String& location = scriptLocations[binaryFilename];
+				if (location != it->archive->getName()) {
+					location = it->archive->getName();
+					usageModified = true;
+				}
+
+				String binaryBasename, binaryPath;
+				StringUtil::splitFilename(binaryFilename, binaryBasename, binaryPath);
+				mCacheTimes->request(mCacheArchive->getName() + "/" + binaryPath, binaryBasename, binaryFilename);
+				if (materialState) {
+					mCacheTimes->request(mCacheArchive->getName() + "/" + binaryPath, binaryBasename + materialStateExtension, binaryFilename + materialStateExtension);
+				}
+			}
+		}
+		mScriptTimes->scan();
+		mCacheTimes->scan();
+	}
+
+	time_t ScriptSerializerManager::getScriptTimestamp(const String& scriptName) {
+		bool exists;
+		time_t timestamp;
+		if (mScriptTimes->find(scriptName, exists, timestamp) && exists) {
+			return timestamp;
+		}
+		return ResourceGroupManager::getSingleton().resourceModifiedTime(mActiveResourceGroup, scriptName);
+	}
+
+	bool ScriptSerializerManager::cachedScriptExists(const String& filename) {
+		bool exists;
+		time_t timestamp;
+		if (mCacheTimes->find(filename, exists, timestamp)) {
+			return exists;
+		}
+		return mCacheArchive->exists(filename);
+	}
+
+	void ScriptSerializerManager::parseMissesAhead(const String& groupName) {
+		// Ogre parses the text scripts one after the other on this thread.  Parse the ones missing from the cache 
+		// on several threads instead, and hand the trees over when Ogre reaches each script
+		ScriptCacheStage stage(mCacheListener, "parse ahead", groupName);
+		ResourceGroupManager& resourceManager = ResourceGroupManager::getSingleton();
+		ParseJobList jobs;
+		for (StringVector::iterator extension = scriptExtensions.begin(); extension != scriptExtensions.end(); ++extension) {
+			StringVectorPtr names = resourceManager.findResourceNames(groupName, "*." + *extension);
+			for (StringVector::iterator it = names->begin(); it != names->end(); ++it) {
+				time_t scriptTimestamp = getScriptTimestamp(*it);
+				DataStreamPtr binaryStream = openFreshBinaryScript(*it + binaryScriptExtension, scriptTimestamp);
+				if (!binaryStream.isNull()) {
+					binaryStream->close();
+					continue;
+				}
+
+				ParseJob job;
+				job.scriptName = *it;
+				DataStreamPtr textStream = resourceManager.openResource(*it, groupName);
+				job.text = textStream->getAsString();
+				textStream->close();
+				if (mStore) {
+					mStoreKeys[*it] = makeStoreKey(*it, job.text, releaseProfile);
+					if (fetchFromStore(*it, *it + binaryScriptExtension, scriptTimestamp)) {
+						continue;
+					}
+				}
+
+				// The compiler opens imported scripts through the resource group manager, which this thread keeps locked 
+				// while the group is parsed.  Leave the scripts that may import to Ogre
+				if (!hasImport(job.text)) {
+					jobs.push_back(job);
+				}
+			}
+		}
+		if (jobs.empty()) {
+			return;
+		}
+
+		size_t threads = std::min(parseThreadCount, jobs.size());
+#if OGRE_THREAD_SUPPORT
+		std::vector<OGRE_THREAD_TYPE*> workers;
+		for (size_t t = 1; t < threads; t++) {
+			OGRE_THREAD_CREATE(worker, ParseWorker(&jobs, &groupName, mCacheListener, t, threads));
+			workers.push_back(worker);
+		}
+		ParseWorker(&jobs, &groupName, mCacheListener, 0, threads)();
+		for (size_t t = 0; t < workers.size(); t++) {
+			workers[t]->join();
+			OGRE_THREAD_DESTROY(workers[t]);
+		}
+#else
+		ParseWorker(&jobs, &groupName, mCacheListener, 0, 1)();
+#endif
+
+		// Cache the trees in script order, the same as if Ogre had parsed them
+		size_t parsed = 0;
+		for (ParseJobList::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+			if (!it->ast.isNull()) {
+				cacheParsedScript(it->scriptName, getScriptTimestamp(it->scriptName), it->ast);
+				mParsedAst[it->scriptName] = it->ast;
+				parsed++;
+			}
+		}
+
+		stringstream message;
+		message << "Parsed " << parsed << " of " << jobs.size() << " uncached scripts of group " << groupName << " on " << threads << " threads";
+		LogManager::getSingleton().logMessage(message.str());
+	}
+
+	void ScriptSerializerManager::startPipeline(const String& groupName) {
+		// Queue the group's cached scripts in the order Ogre asks for them, so the pipeline reads and decodes each one
+		// while the scripts before it are compiled.  Scripts handled from memory or parsed ahead are left out
+		size_t queued = 0;
+		for (StringVector::iterator extension = scriptExtensions.begin(); extension != scriptExtensions.end(); ++extension) {
+			StringVectorPtr names = ResourceGroupManager::getSingleton().findResourceNames(groupName, "*." + *extension);
+			for (StringVector::iterator it = names->begin(); it != names->end(); ++it) {
+				if (mParsedAst.count(*it)) {
+					continue;
+				}
+				String binaryFilename = *it + binaryScriptExtension;
+				time_t scriptTimestamp = getScriptTimestamp(*it);
+				if (mAstCache && mAstCache->contains(binaryFilename, scriptTimestamp)) {
+					continue;
+				}
+
+				// The listing only says whether a loose file exists.  Its header decides on the read thread whether it is fresh
+				bool cached = cachedScriptExists(binaryFilename);
+				if (cached || mPack->exists(binaryFilename)) {
+					mPipeline->add(binaryFilename, scriptTimestamp, cached);
+					queued++;
+				}
+			}
+		}
+
+		if (queued) {
+			stringstream message;
+			message << "Loading " << queued << " cached scripts of group " << groupName << " through the pipeline";
+			LogManager::getSingleton().logMessage(message.str());
+		}
+	}
+
+	void ScriptSerializerManager::finishPipeline(const String& groupName) {
+		ScriptPipelineStats stats;
+		mPipeline->finish(stats);
+		completeWrites();
+
+		// A listener reports the stages in more detail
+		if (mCacheListener) {
+			mCacheListener->pipelineFinished(groupName, stats);
+			return;
+		}
+
+		stringstream message;
+		message << "Script pipeline of group " << groupName << ":";
+		for (size_t stage = 0; stage < ScriptPipelineStats::PS_Count; stage++) {
+			message << " " << stats.stages[stage].scripts << " " << ScriptPipelineStats::getStageName(stage) << (stage + 1 < ScriptPipelineStats::PS_Count ? "," : "");
+		}
+		message << " in " << stats.elapsedTime / 1000 << " ms, " << stats.dropped << " read ahead in vain";
+		LogManager::getSingleton().logMessage(message.str());
+	}
+
+	void ScriptSerializerManager::completeWrites() {
+		// The write thread only creates the files.  Their bookkeeping is not shared with it
+		StringVector written = mPipeline->takeWritten();
+		for (StringVector::iterator it = written.begin(); it != written.end(); ++it) {
+			scriptCached(it->substr(0, it->length() - binaryScriptExtension.length()));
+		}
+	}
+
+	void ScriptSerializerManager::collectGarbage() {
+		if (!pluginEnabled) {
+			return;
+		}
+
+		ResourceGroupManager& resourceManager = ResourceGroupManager::getSingleton();
+		FileInfoListPtr files = mCacheArchive->findFileInfo("*" + binaryScriptExtension, false);
+
+		typedef std::multimap<time_t, const FileInfo*> UsageOrder;
+		UsageOrder order;
+		size_t cacheSize = 0;
+		size_t removedSize = 0;
+		size_t orphanCount = 0;
+		for (FileInfoList::const_iterator it = files->begin(); it != files->end(); ++it) {
+			const String& filename = it->filename;
+			String scriptName = filename.substr(0, filename.length() - binaryScriptExtension.length());
+			// A script whose location is not registered yet is not gone.  Only scripts missing from a location registered now are removed
+			if (!resourceManager.resourceExistsInAnyGroup(scriptName) && !resourceManager.resourceExistsInAnyGroup(filename) && isLocationRegistered(filename)) {
+				removeCachedScript(filename);
+				removedSize += it->uncompressedSize;
+				orphanCount++;
+				continue;
+			}
+
+			// Scripts never used since the usage was first recorded fall back to the time they were written
+			UsageMap::iterator usage = scriptUsage.find(filename);
+			time_t lastUsed = usage != scriptUsage.end() ? usage->second : mCacheArchive->getModifiedTime(filename);
+			order.insert(UsageOrder::value_type(lastUsed, &*it));
+			cacheSize += it->uncompressedSize;
+		}
+
+		size_t evictedCount = 0;
+		for (UsageOrder::iterator it = order.begin(); maxCacheSize && cacheSize > maxCacheSize && it != order.end(); ++it) {
+			removeCachedScript(it->second->filename);
+			cacheSize -= it->second->uncompressedSize;
+			removedSize += it->second->uncompressedSize;
+			evictedCount++;
+		}
+
+		if (orphanCount || evictedCount) {
+			stringstream message;
+			message << "Script cache collection removed " << orphanCount << " orphaned and " << evictedCount 
+				<< " least recently used scripts (" << removedSize / 1024 << " KB)";
+			LogManager::getSingleton().logMessage(message.str());
+		}
+	}
+
+	void ScriptSerializerManager::removeCachedScript(const String& filename) {
+		mCacheArchive->remove(filename);
+		mCacheTimes->update(filename, false, 0);
+		if (mCacheArchive->exists(filename + materialStateExtension)) {
+			mCacheArchive->remove(filename + materialStateExtension);
+		}
+		scriptUsage.erase(filename);
+		scriptLocations.erase(filename);
+		usageModified = true;
+		cacheModified = true;
+	}
+
+	bool ScriptSerializerManager::isLocationRegistered(const String& filename) {
+		LocationMap::iterator location = scriptLocations.find(filename);
+		if (location == scriptLocations.end()) {
+			return false;
+		}
+
+		ResourceGroupManager& resourceManager = ResourceGroupManager::getSingleton();
+		StringVector groups = resourceManager.getResourceGroups();
+		for (StringVector::iterator group = groups.begin(); group != groups.end(); ++group) {
+			if (resourceManager.resourceLocationExists(location->second, *group)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void ScriptSerializerManager::touchScript(const String& filename) {
+		scriptUsage[filename] = time(0);
+		usageModified = true;
+	}
+
+	void ScriptSerializerManager::loadUsage() {
+		if (!mCacheArchive->exists(usageFileName)) {
+			return;
+		}
+
+		// One script per line: the time it was last used, a space and its name, then a tab and the location of its text if known
+		DataStreamPtr stream = mCacheArchive->open(usageFileName);
+		while (!stream->eof()) {
+			String line = stream->getLine();
+			size_t separator = line.find(' ');
+			if (separator != String::npos) {
+				size_t locationSeparator = line.find('\t', separator + 1);
+				String filename = line.substr(separator + 1, locationSeparator == String::npos ? String::npos : locationSeparator - separator - 1);
+				scriptUsage[filename] = static_cast<time_t>(StringConverter::parseUnsignedLong(line.substr(0, separator)));
+				if (locationSeparator != String::npos) {
+					scriptLocations[filename] = line.substr(locationSeparator + 1);
+				}
+			}
+		}
+		stream->close();
+	}
+
+	void ScriptSerializerManager::saveUsage() {
+		if (!usageModified) {
+			return;
+		}
+
+		stringstream usage;
+		for (UsageMap::iterator it = scriptUsage.begin(); it != scriptUsage.end(); ++it) {
+			usage << static_cast<unsigned long>(it->second) << " " << it->first;
+			LocationMap::iterator location = scriptLocations.find(it->first);
+			if (location != scriptLocations.end()) {
+				usage << "\t" << location->second;
+			}
+			usage << "\n";
+		}
+		String data = usage.str();
+		DataStreamPtr stream = mCacheArchive->create(usageFileName);
+		stream->write(data.c_str(), data.length());
+		stream->close();
 	}
 
 	void ScriptSerializerManager::resourceGroupScriptingEnded(const String& groupName) {
-		// Scripts for this resource group where just parsed.  save the shader cache to disk
-		saveShaderCache();
+		// Compile whatever is left of the cached scripts before the group is considered loaded
+		flushPendingAst();
+		mReadAhead->wait();
+		if (mPipeline) {
+			finishPipeline(groupName);
+		}
+		mParsedAst.clear();
+		mScriptTimes->clear();
+		mCacheTimes->clear();
+		mMaterialCapture.scriptName.clear();
+		mStoreKeys.clear();
+
+#ifdef USE_MICROCODE_SHADERCACHE
+		// The group's programs are declared now and compiled when the group is loaded
+		mShaderSerializer->loadGroup(groupName);
+#endif
+
+		if (mAstCache) {
+			stringstream message;
+			message << "Script memory cache: " << mAstCache->getHitCount() << " hits, " << mAstCache->getMissCount() << " misses, " 
+				<< mAstCache->getMemoryUsage() / 1024 << " KB in use";
+			LogManager::getSingleton().logMessage(message.str());
+		}
 	}
 
 
+	void ScriptSerializerManager::resourceGroupLoadStarted(const String& groupName, size_t resourceCount) {
+#ifdef USE_MICROCODE_SHADERCACHE
+		// Linked programs are named after no program.  Groups declared after this point have their microcode read now
+		// rather than with the group, which costs the read but changes nothing Ogre compiles
+		mShaderSerializer->loadUnclaimed();
+#endif
+	}
+
+	void ScriptSerializerManager::resourceGroupLoadEnded(const String& groupName) {
+		// The group's programs were just compiled.  Only the new ones are written
+		saveShaderCache();
+	}
+
 	void ScriptSerializerManager::scriptParseStarted(const String& scriptName, bool& skipThisScript) {
+		if (mPipeline) {
+			completeWrites();
+		}
+		recordAccess(isBinaryScript(scriptName) ? scriptName : scriptName + binaryScriptExtension);
+		mCurrentScript = scriptName;
+		if (mCacheListener) {
+			mCacheListener->scriptStarted(scriptName);
+			if (mCacheListener->isComparingScripts() && !isBinaryScript(scriptName)) {
+				compareScript(scriptName);
+			}
+		}
+
 		// Check if the binary version is being requested for parsing
 		String binaryFilename;
+		DataStreamPtr binaryStream;
+		time_t scriptTimestamp = getScriptTimestamp(scriptName);
 		if (isBinaryScript(scriptName)) {
 			// The script ends with the binary extension. fetch it from the cache folder
 			binaryFilename = scriptName;
@@ -109,30 +835,88 @@ namespace Ogre {
 		else {
 			// Clear compilation error flags, if any.  This script might have been re-parsed after corrections
 			invalidScripts.erase(scriptName);
-
-			// This is a text based script.  Check if the compiled version is unavailable
 			binaryFilename = scriptName + binaryScriptExtension;
-			if (!mCacheArchive->exists(binaryFilename)) {
-				// A compiled version of this script doesn't exist in the cache.  Continue with regular text parsing
-				skipThisScript = false;
+
+			// The script was missing from the cache and already parsed on a worker thread when the group started
+			ParsedAstMap::iterator parsed = mParsedAst.find(scriptName);
+			if (parsed != mParsedAst.end()) {
+				AbstractNodeListPtr ast = parsed->second;
+				mParsedAst.erase(parsed);
+				LogManager::getSingleton().logMessage("Processing script parsed ahead: " + scriptName);
+				flushPendingAst();
+				// Batched compiles take the nodes out of the tree, so the materials are listed first
+				queueMaterialCapture(scriptName, binaryFilename + materialStateExtension, scriptTimestamp, ast);
+				compileAst(ast);
+				skipThisScript = true;
 				return;
 			}
+		}
 
-			// Check if this script was modified it was last compiled
-			size_t binaryTimestamp = getBinaryTimeStamp(binaryFilename);
-			size_t scriptTimestamp = ResourceGroupManager::getSingleton().resourceModifiedTime(mActiveResourceGroup, scriptName);
+		// A group loaded before may have left the decoded tree in memory
+		if (mAstCache) {
+			AbstractNodeListPtr ast;
+			{
+				ScriptCacheStage stage(mCacheListener, "memory cache", binaryFilename);
+				ast = mAstCache->find(binaryFilename, scriptTimestamp);
+			}
+			if (!ast.isNull()) {
+				LogManager::getSingleton().logMessage("Processing binary script from memory: " + binaryFilename);
+				touchScript(binaryFilename);
+				compileCachedScript(scriptName, binaryFilename, scriptTimestamp, ast);
+				skipThisScript = true;
+				return;
+			}
+		}
+
+		// The pipeline read and decoded the cached script while the scripts before it were compiled
+		if (mPipeline && !isBinaryScript(scriptName)) {
+			AbstractNodeListPtr ast = mPipeline->take(binaryFilename);
+			if (!ast.isNull()) {
+				if (mAstCache) {
+					mAstCache->insert(binaryFilename, scriptTimestamp, ast);
+				}
+				LogManager::getSingleton().logMessage("Processing binary script: " + binaryFilename);
+				touchScript(binaryFilename);
+				Timer timer;
+				compileCachedScript(scriptName, binaryFilename, scriptTimestamp, ast);
+				mPipeline->compiled(timer.getMicroseconds());
+				skipThisScript = true;
+				return;
+			}
+		}
+
+		if (!isBinaryScript(scriptName)) {
+			// This is a text based script.  Check if an up to date compiled version is available
+			{
+				ScriptCacheStage stage(mCacheListener, "cache check", binaryFilename);
+				binaryStream = openFreshBinaryScript(binaryFilename, scriptTimestamp);
+			}
+			if (binaryStream.isNull() && mStore && fetchFromStore(scriptName, binaryFilename, scriptTimestamp)) {
+				binaryStream = openFreshBinaryScript(binaryFilename, scriptTimestamp);
+			}
+			if (binaryStream.isNull()) {
+				// Ogre compiles the text script right after this call. Send the earlier cached scripts to the compiler 
+				// first so the resources are still created in script loading order
+				flushPendingAst();
 
-			if (scriptTimestamp > binaryTimestamp) {
-				LogManager::getSingleton().logMessage("File Changed. Re-parsing file: " + scriptName);
+				// Continue with regular text parsing
 				skipThisScript = false;
 				return;
 			}
 		}
 
+		if (binaryStream.isNull()) {
+			binaryStream = openBinaryScript(binaryFilename);
+		}
+
 		// Load the compiled AST from the binary script file
-		AbstractNodeListPtr ast = loadAstFromDisk(binaryFilename);
+		AbstractNodeListPtr ast = loadAstFromDisk(binaryStream);
+		if (mAstCache) {
+			mAstCache->insert(binaryFilename, scriptTimestamp, ast);
+		}
 		LogManager::getSingleton().logMessage("Processing binary script: " + binaryFilename);
-		mCompiler->_compile(ast, mActiveResourceGroup, false, false, false);
+		touchScript(binaryFilename);
+		compileCachedScript(scriptName, binaryFilename, scriptTimestamp, ast);
 
 		// Skip further parsing of this script since its already been compiled
 		skipThisScript = true;
@@ -146,9 +930,9 @@ namespace Ogre {
 		if (isValid) {
 			if (!isBinaryScript(scriptName)) {
 				// A text script was just parsed. Save the compiled AST to disk
-				String binaryFilename = scriptName + binaryScriptExtension;
-				size_t scriptTimestamp = ResourceGroupManager::getSingleton().resourceModifiedTime(mActiveResourceGroup, scriptName);
-				saveAstToDisk(binaryFilename, scriptTimestamp, ast);
+				size_t scriptTimestamp = getScriptTimestamp(scriptName);
+				cacheParsedScript(scriptName, scriptTimestamp, ast);
+				queueMaterialCapture(scriptName, scriptName + binaryScriptExtension + materialStateExtension, scriptTimestamp, ast);
 			}
 		}
 
@@ -161,25 +945,398 @@ namespace Ogre {
 		invalidScripts.insert(file);
 	}
 
-	time_t ScriptSerializerManager::getBinaryTimeStamp(const String& filename) {
-		DataStreamPtr stream = mCacheArchive->open(filename);
+	void ScriptSerializerManager::compileAst(const AbstractNodeListPtr& ast) {
+		if (!batchCompile) {
+			ScriptCacheStage stage(mCacheListener, "compile", StringUtil::BLANK);
+			mCompiler->_compile(ast, mActiveResourceGroup, false, false, false);
+			return;
+		}
+
+		// The trees were fully processed before they were cached, so they can be translated together 
+		// in one call instead of setting up the compiler once per script
+		if (mPendingAst.isNull()) {
+			mPendingAst = AbstractNodeListPtr(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+		}
+		mPendingAst->splice(mPendingAst->end(), *ast);
+		pendingScriptCount++;
+
+		if (compileBatchSize && pendingScriptCount >= compileBatchSize) {
+			flushPendingAst();
+		}
+	}
+
+	void ScriptSerializerManager::compileCachedScript(const String& scriptName, const String& binaryFilename, time_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+		if (!materialState) {
+			compileAst(ast);
+			return;
+		}
+
+		// Only the materials have a saved state.  The other objects of the script still go to the translators
+		AbstractNodeListPtr materials(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+		AbstractNodeListPtr others(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+		for (AbstractNodeList::iterator it = ast->begin(); it != ast->end(); ++it) {
+			(isMaterial(*it) ? materials : others)->push_back(*it);
+		}
+		if (materials->empty()) {
+			compileAst(ast);
+			return;
+		}
+
+		// The materials may use programs defined by this script or a batched one, so those are created first.  Rather
+		// than compile the batch early, the materials wait for it.  They are then created after the batched objects of
+		// the scripts that follow, which only matters to objects that look materials up while being translated
+		if (!others->empty()) {
+			compileAst(others);
+		}
+		String stateFilename = binaryFilename + materialStateExtension;
+		if (!mPendingAst.isNull() && !mPendingAst->empty()) {
+			PendingRestore restore;
+			restore.capture.scriptName = scriptName;
+			restore.capture.stateFilename = stateFilename;
+			restore.capture.scriptTimestamp = scriptTimestamp;
+			listMaterials(materials, restore.capture.materials);
+			restore.materials = materials;
+			mPendingRestores.push_back(restore);
+			return;
+		}
+		if (!restoreMaterials(scriptName, stateFilename, scriptTimestamp)) {
+			queueMaterialCapture(scriptName, stateFilename, scriptTimestamp, materials);
+			compileAst(materials);
+		}
+	}
+
+	bool ScriptSerializerManager::restoreMaterials(const String& scriptName, const String& stateFilename, time_t scriptTimestamp) {
+		if (!cachedScriptExists(stateFilename)) {
+			return false;
+		}
+
+		ScriptCacheStage stage(mCacheListener, "restore materials", stateFilename);
+		DataStreamPtr stream = mCacheArchive->open(stateFilename);
+		time_t stateTimestamp;
+		if (!MaterialStateSerializer::readTimestamp(stream, stateTimestamp) || scriptTimestamp > stateTimestamp) {
+			stream->close();
+			return false;
+		}
+
+		// The state is read value by value, so it is read from memory
+		DataStreamPtr stateStream(OGRE_NEW MemoryDataStream(stream));
+		stream->close();
+		MaterialStateSerializer serializer;
+		size_t count;
+		if (!serializer.load(stateStream, mActiveResourceGroup, scriptName, count)) {
+			return false;
+		}
+		LogManager::getSingleton().logMessage("Restored " + StringConverter::toString(count) + " materials of " + scriptName + " from their saved state");
+		return true;
+	}
+
+	void ScriptSerializerManager::queueMaterialCapture(const String& scriptName, const String& stateFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+		if (!materialState) {
+			return;
+		}
+
+		mMaterialCapture.scriptName = scriptName;
+		mMaterialCapture.stateFilename = stateFilename;
+		mMaterialCapture.scriptTimestamp = scriptTimestamp;
+		mMaterialCapture.materials.clear();
+		listMaterials(ast, mMaterialCapture.materials);
+	}
+
+	void ScriptSerializerManager::scriptParseEnded(const String& scriptName, bool skipped) {
+		mCurrentScript.clear();
+
+		// The translators have created the script's materials by now, unless they are still batched
+		if (mMaterialCapture.scriptName == scriptName) {
+			if (!mMaterialCapture.materials.empty() && invalidScripts.count(scriptName) == 0) {
+				flushPendingAst();
+				saveMaterialState(mMaterialCapture);
+			}
+			mMaterialCapture.scriptName.clear();
+		}
+	}
+
+	void ScriptSerializerManager::saveMaterialState(const MaterialCapture& capture) {
+		const String& stateFilename = capture.stateFilename;
+		ScriptCacheStage stage(mCacheListener, "save materials", stateFilename);
+		MaterialStateSerializer::MaterialList materials;
+		for (StringVector::const_iterator it = capture.materials.begin(); it != capture.materials.end(); ++it) {
+			MaterialPtr material = MaterialManager::getSingleton().getByName(*it);
+			String reason = "it was not created";
+			if (material.isNull() || !MaterialStateSerializer::isSaveable(material, reason)) {
+				LogManager::getSingleton().logMessage("Materials of " + capture.scriptName + " are translated every time. " + *it + " is not saveable: " + reason);
+				return;
+			}
+			materials.push_back(material);
+		}
+
+		MaterialStateSerializer serializer;
+		DataStreamPtr stream = mCacheArchive->create(stateFilename);
+		serializer.save(stream, materials, capture.scriptTimestamp);
+		stream->close();
+		mCacheTimes->update(stateFilename, true, time(0));
+	}
+
+	void ScriptSerializerManager::flushPendingAst() {
+		if (mPendingAst.isNull() || mPendingAst->empty()) {
+			return;
+		}
+
+		stringstream message;
+		message << "Compiling " << pendingScriptCount << " binary scripts";
+		LogManager::getSingleton().logMessage(message.str());
+
+		// The batch is mostly made of the scripts before the one Ogre is handing over, so it is reported outside of that script
+		bool suspended = mCacheListener && !mCurrentScript.empty();
+		if (suspended) {
+			mCacheListener->scriptSuspended(mCurrentScript);
+		}
+		{
+			ScriptCacheStage stage(mCacheListener, "compile", message.str());
+			mCompiler->_compile(mPendingAst, mActiveResourceGroup, false, false, false);
+		}
+		mPendingAst->clear();
+		pendingScriptCount = 0;
+		restorePendingMaterials();
+		if (suspended) {
+			mCacheListener->scriptStarted(mCurrentScript);
+		}
+	}
+
+	void ScriptSerializerManager::restorePendingMaterials() {
+		// Materials are only queued while the batch has scripts, so there are none left once it is compiled
+		PendingRestoreList restores;
+		restores.swap(mPendingRestores);
+		for (PendingRestoreList::iterator it = restores.begin(); it != restores.end(); ++it) {
+			const MaterialCapture& capture = it->capture;
+			if (restoreMaterials(capture.scriptName, capture.stateFilename, capture.scriptTimestamp)) {
+				continue;
+			}
+
+			// The script's parse ended long ago, so the state is saved right after the materials are translated
+			{
+				ScriptCacheStage stage(mCacheListener, "compile", capture.scriptName);
+				mCompiler->_compile(it->materials, mActiveResourceGroup, false, false, false);
+			}
+			if (invalidScripts.count(capture.scriptName) == 0) {
+				saveMaterialState(capture);
+			}
+		}
+	}
+
+	void ScriptSerializerManager::compareScript(const String& scriptName) {
+		// Both paths start from memory and end with the processed tree the translators get, so only the formats are compared
+		ScriptCacheStage stage(mCacheListener, "compare", scriptName);
+		DataStreamPtr textStream = ResourceGroupManager::getSingleton().openResource(scriptName, mActiveResourceGroup);
+		String text = textStream->getAsString();
+		textStream->close();
+
+		ScriptComparison comparison;
+		comparison.scriptName = scriptName;
+		comparison.textSize = text.size();
+		comparison.textTime = ULONG_MAX;
+		comparison.binaryTime = ULONG_MAX;
+
+		ConversionCapture capture;
+		ScriptCompiler compiler;
+		compiler.setListener(&capture);
+		Timer timer;
+		for (size_t run = 0; run < comparisonRuns; run++) {
+			timer.reset();
+			compiler.compile(text, scriptName, mActiveResourceGroup);
+			comparison.textTime = std::min(comparison.textTime, timer.getMicroseconds());
+		}
+		if (capture.failed || capture.ast.isNull() || capture.ast->empty()) {
+			return;
+		}
+		comparison.nodeCount = countNodes(*capture.ast);
+
+		// The encoded script goes through a scratch file in the cache folder, since its size is not known up front
+		String scratchFilename = scriptName + binaryScriptExtension + ".compare";
+		ScriptSerializer* serializer = OGRE_NEW ScriptSerializer();
+		serializer->setThreadCount(encodeThreadCount);
+		serializer->setColumnarLayout(columnarLayout);
+		serializer->setReleaseProfile(releaseProfile);
+		serializer->setFrequencyOrderedStrings(frequencyOrder);
+		DataStreamPtr scratchStream = mCacheArchive->create(scratchFilename);
+		serializer->serialize(scratchStream, capture.ast, 0);
+		scratchStream->close();
+
+		scratchStream = mCacheArchive->open(scratchFilename);
+		DataStreamPtr binaryStream(OGRE_NEW MemoryDataStream(scratchStream));
+		scratchStream->close();
+		mCacheArchive->remove(scratchFilename);
+		comparison.binarySize = binaryStream->size();
+
+		for (size_t run = 0; run < comparisonRuns; run++) {
+			binaryStream->seek(0);
+			timer.reset();
+			serializer->deserialize(binaryStream);
+			comparison.binaryTime = std::min(comparison.binaryTime, timer.getMicroseconds());
+		}
+		OGRE_DELETE serializer;
+
+		mCacheListener->scriptCompared(comparison);
+	}
+
+	bool ScriptSerializerManager::getBinaryTimeStamp(const DataStreamPtr& stream, time_t& timestamp) {
 		ScriptBlock::ScriptHeader header;
-		stream->read(reinterpret_cast<char*>(&header), sizeof(ScriptBlock::ScriptHeader));
+		size_t bytesRead = stream->read(reinterpret_cast<char*>(&header), sizeof(ScriptBlock::ScriptHeader));
+		stream->seek(0);
+
+		// Binaries written in another format version or profile are out of date, so their scripts get re-parsed
+		if (bytesRead != sizeof(header) || !ScriptSerializer::isSupported(header) || ((header.flags & ScriptBlock::SF_Release) != 0) != releaseProfile) {
+			return false;
+		}
+		timestamp = header.lastModifiedTime;
+		return true;
+	}
+
+	DataStreamPtr ScriptSerializerManager::openBinaryScript(const String& filename) {
+		DataStreamPtr stream = mPack->open(filename);
+		if (stream.isNull()) {
+			stream = mCacheArchive->open(filename);
+		}
+		return stream;
+	}
+
+	DataStreamPtr ScriptSerializerManager::readFreshScript(const String& filename, time_t scriptTimestamp, bool cached) {
+		// Runs on the pipeline's read thread, so the listings this thread keeps are not used.  The caller checked them
+		time_t binaryTimestamp;
+		DataStreamPtr stream = mPack->open(filename);
+		if (stream.isNull() || !getBinaryTimeStamp(stream, binaryTimestamp) || binaryTimestamp < scriptTimestamp) {
+			if (!cached) {
+				if (!stream.isNull()) {
+					LogManager::getSingleton().logMessage("File Changed. Re-parsing file: " + filename);
+				}
+				return DataStreamPtr();
+			}
+			stream = mCacheArchive->open(filename);
+			if (!getBinaryTimeStamp(stream, binaryTimestamp) || scriptTimestamp > binaryTimestamp) {
+				LogManager::getSingleton().logMessage("File Changed. Re-parsing file: " + filename);
+				stream->close();
+				return DataStreamPtr();
+			}
+		}
+
+		// The pack is mapped already.  A loose file is read whole, so the decode thread never waits on the disk
+		DataStreamPtr data(OGRE_NEW MemoryDataStream(stream));
 		stream->close();
-		return header.lastModifiedTime;
+		return data;
+	}
+
+	DataStreamPtr ScriptSerializerManager::openFreshBinaryScript(const String& filename, time_t scriptTimestamp) {
+		// Prefer the shared pack.  A loose file in the cache folder may still be newer if the script was edited since the pack was built
+		time_t binaryTimestamp;
+		DataStreamPtr stream = mPack->open(filename);
+		if (!stream.isNull() && getBinaryTimeStamp(stream, binaryTimestamp) && binaryTimestamp >= scriptTimestamp) {
+			return stream;
+		}
+
+		if (!cachedScriptExists(filename)) {
+			// A compiled version of this script doesn't exist in the cache, or only the pack's, which is out of date
+			if (!stream.isNull()) {
+				LogManager::getSingleton().logMessage("File Changed. Re-parsing file: " + filename);
+			}
+			return DataStreamPtr();
+		}
+
+		// Check if this script was modified since it was last compiled.  The header's timestamp is compared, not the file's
+		// modification time, which is not ordered with the script's if either was copied or its clock was off
+		stream = mCacheArchive->open(filename);
+		if (!getBinaryTimeStamp(stream, binaryTimestamp) || scriptTimestamp > binaryTimestamp) {
+			LogManager::getSingleton().logMessage("File Changed. Re-parsing file: " + filename);
+			stream->close();
+			return DataStreamPtr();
+		}
+		return stream;
+	}
+
+	void ScriptSerializerManager::cacheParsedScript(const String& scriptName, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+		String binaryFilename = scriptName + binaryScriptExtension;
+		if (mPipeline) {
+			// The translators take the tree apart while the write thread encodes it, so that gets a copy.  
+			// completeWrites() does the rest once the file is written
+			mPipeline->write(binaryFilename, scriptTimestamp, ScriptAstCache::copyTrees(*ast));
+		}
+		else {
+			saveAstToDisk(binaryFilename, scriptTimestamp, ast, 0);
+			scriptCached(scriptName);
+		}
+		if (mAstCache) {
+			mAstCache->insert(binaryFilename, scriptTimestamp, ast);
+		}
 	}
 
-	void ScriptSerializerManager::saveAstToDisk(const String& filename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+	void ScriptSerializerManager::scriptCached(const String& scriptName) {
+		String binaryFilename = scriptName + binaryScriptExtension;
+		cacheModified = true;
+		mCacheTimes->update(binaryFilename, true, time(0));
+		touchScript(binaryFilename);
+		if (mStore && !getStoreKey(scriptName).empty()) {
+			mStore->publish(getStoreKey(scriptName), mCacheArchive->getName() + "/" + binaryFilename);
+		}
+	}
+
+	void ScriptSerializerManager::saveAstToDisk(const String& filename, size_t scriptTimestamp, const AbstractNodeListPtr& ast, size_t thread) {
 		// A text script was just parsed. Save the compiled AST to disk
-		DataStreamPtr stream = mCacheArchive->create(filename);
+		ScriptCacheStage stage(mCacheListener, "save", filename, thread);
 		ScriptSerializer* serializer = OGRE_NEW ScriptSerializer();
-		serializer->serialize(stream, ast, scriptTimestamp);
+		serializer->setThreadCount(encodeThreadCount);
+		serializer->setColumnarLayout(columnarLayout);
+		serializer->setReleaseProfile(releaseProfile);
+		serializer->setFrequencyOrderedStrings(frequencyOrder);
+		if (thread == 0) {
+			// The serializer reports its own stages as this thread's
+			serializer->setListener(mCacheListener);
+		}
+		if (!updateAstOnDisk(serializer, filename, scriptTimestamp, ast)) {
+			DataStreamPtr stream = mCacheArchive->create(filename);
+			serializer->serialize(stream, ast, scriptTimestamp);
+			stream->close();
+		}
+
+		const ScriptSerializer::Statistics& stats = serializer->getStatistics();
+		if (stats.nodesShared) {
+			LogManager::getSingleton().logMessage("Cached script " + filename + ": " + StringConverter::toString(stats.nodesShared) + 
+				" repeated nodes stored as references (dedup ratio " + StringConverter::toString(stats.dedupRatio, 3) + ")");
+		}
+		if (frequencyOrder && !columnarLayout && stats.segmentsReused == 0) {
+			LogManager::getSingleton().logMessage("Cached script " + filename + ": string references take " + StringConverter::toString(stats.referenceBytes) +
+				" bytes as varints with ids ordered by frequency, " + StringConverter::toString(stats.referenceBytesSaved) + " less than in first seen order");
+		}
 		OGRE_DELETE serializer;
+	}
+
+	bool ScriptSerializerManager::updateAstOnDisk(ScriptSerializer* serializer, const String& filename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+		// A reloaded script usually changes only a few of its objects. Rewrite just those in the existing binary file
+		if (!mCacheArchive->exists(filename)) {
+			return false;
+		}
+
+		String fullPath = mCacheArchive->getName() + "/" + filename;
+		std::fstream* file = OGRE_NEW_T(std::fstream, MEMCATEGORY_GENERAL)();
+		file->open(fullPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		if (file->fail()) {
+			OGRE_DELETE_T(file, basic_fstream, MEMCATEGORY_GENERAL);
+			return false;
+		}
+
+		DataStreamPtr stream(OGRE_NEW FileStreamDataStream(filename, file, true));
+		bool updated = false;
+		try {
+			updated = serializer->update(stream, ast, scriptTimestamp);
+		}
+		catch (Exception&) {
+			updated = false;
+		}
 		stream->close();
+
+		// The new tables may end before the old ones did.  If the rest cannot be cut off, the script is written again
+		return updated && truncateFile(fullPath, serializer->getStatistics().fileSize);
 	}
 
-	AbstractNodeListPtr ScriptSerializerManager::loadAstFromDisk(const String& filename) {
-		DataStreamPtr stream = mCacheArchive->open(filename);
+	AbstractNodeListPtr ScriptSerializerManager::loadAstFromDisk(const DataStreamPtr& stream) {
+		ScriptCacheStage stage(mCacheListener, "decode", stream->getName());
 		ScriptSerializer* serializer = OGRE_NEW ScriptSerializer();
 		AbstractNodeListPtr ast = serializer->deserialize(stream);
 		OGRE_DELETE serializer;
@@ -214,11 +1371,41 @@ namespace Ogre {
 		binaryScriptExtension = configFile.getSetting("extension", "ScriptCache", ".sbin");
 		scriptCacheLocation = configFile.getSetting("location", "ScriptCache", ".scriptCache");
 		shaderCacheFilename = configFile.getSetting("filename", "ShaderCache", "ShaderCache");
+		compressShaders = StringConverter::parseBool(configFile.getSetting("compress", "ShaderCache", "true"));
+		packFilename = configFile.getSetting("filename", "PackedCache", "");
+		storeLocation = configFile.getSetting("location", "SharedCache", "");
+		rebuildPack = StringConverter::parseBool(configFile.getSetting("rebuild", "PackedCache", "false"));
+		batchCompile = StringConverter::parseBool(configFile.getSetting("batchCompile", "ScriptCache", "false"));
+		compileBatchSize = StringConverter::parseUnsignedInt(configFile.getSetting("batchSize", "ScriptCache", "0"));
+		encodeThreadCount = StringConverter::parseUnsignedInt(configFile.getSetting("encodeThreads", "ScriptCache", "1"));
+		parseThreadCount = StringConverter::parseUnsignedInt(configFile.getSetting("parseThreads", "ScriptCache", "1"));
+#if OGRE_THREAD_SUPPORT
+		if (parseThreadCount == 0) {
+			parseThreadCount = OGRE_THREAD_HARDWARE_CONCURRENCY;
+		}
+#else
+		parseThreadCount = 1;
+#endif
+		parseThreadCount = std::max<size_t>(parseThreadCount, 1);
+		pipeline = StringConverter::parseBool(configFile.getSetting("pipeline", "ScriptCache", "false"));
+		pipelineQueueSize = StringConverter::parseUnsignedInt(configFile.getSetting("pipelineQueue", "ScriptCache", "8"));
+#if !OGRE_THREAD_SUPPORT
+		pipeline = false;
+#endif
+		columnarLayout = StringConverter::parseBool(configFile.getSetting("columnar", "ScriptCache", "false"));
+		releaseProfile = configFile.getSetting("profile", "ScriptCache", "debug") == "release";
+		frequencyOrder = StringConverter::parseBool(configFile.getSetting("frequencyOrder", "ScriptCache", "false"));
+		materialState = StringConverter::parseBool(configFile.getSetting("materialState", "ScriptCache", "false"));
+		readAhead = StringConverter::parseBool(configFile.getSetting("readAhead", "ScriptCache", "false"));
+		astCacheBudget = parseMegabytes(configFile.getSetting("memoryCacheMB", "ScriptCache", "0"));
+		maxCacheSize = parseMegabytes(configFile.getSetting("maxSizeMB", "ScriptCache", "0"));
+		collectionPending = StringConverter::parseBool(configFile.getSetting("collectGarbage", "ScriptCache", "false"));
 		String searchExtensions = configFile.getSetting("searchExtensions", "ScriptCache", "program material particle compositor os pu");
 
 		istringstream extensions(searchExtensions);
 		String extension;
 		while (extensions >> extension) {
+			scriptExtensions.push_back(extension);
 			stringstream pattern;
 			pattern << "*." << extension << binaryScriptExtension;
 			ScriptCompilerManager::getSingleton().addScriptPattern(pattern.str());
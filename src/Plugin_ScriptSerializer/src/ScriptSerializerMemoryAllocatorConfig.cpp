@@ -0,0 +1,53 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptSerializerMemoryAllocatorConfig.h"
+
+namespace Ogre {
+
+	typedef CategorisedAllocPolicy<MEMCATEGORY_SCRIPTING> ScriptingAllocPolicy;
+
+	/// Large enough for the size and keeps the blocks as aligned as the ones the scripting category hands out
+	const size_t blockHeaderSize = 16;
+
+	ScriptSerializerMemoryStats ScriptSerializerTrackingAllocPolicy::stats = { 0, 0, 0, { 0 } };
+	OGRE_STATIC_MUTEX_INSTANCE(ScriptSerializerTrackingAllocPolicy::statsMutex)
+
+	void* ScriptSerializerTrackingAllocPolicy::allocateBytes(size_t count, const char* file, int line, const char* func) {
+		uint8* block = static_cast<uint8*>(ScriptingAllocPolicy::allocateBytes(count + blockHeaderSize, file, line, func));
+		*reinterpret_cast<size_t*>(block) = count;
+
+		size_t bucket = 0;
+		while (bucket + 1 < ScriptSerializerMemoryStats::HistogramBuckets && count > (static_cast<size_t>(16) << bucket)) {
+			bucket++;
+		}
+
+		OGRE_LOCK_MUTEX(statsMutex)
+		stats.currentBytes += count;
+		stats.peakBytes = std::max(stats.peakBytes, stats.currentBytes);
+		stats.allocationCount++;
+		stats.histogram[bucket]++;
+		return block + blockHeaderSize;
+	}
+
+	void ScriptSerializerTrackingAllocPolicy::deallocateBytes(void* ptr) {
+		if (!ptr) {
+			return;
+		}
+
+		uint8* block = static_cast<uint8*>(ptr) - blockHeaderSize;
+		{
+			OGRE_LOCK_MUTEX(statsMutex)
+			stats.currentBytes -= *reinterpret_cast<size_t*>(block);
+		}
+		ScriptingAllocPolicy::deallocateBytes(block);
+	}
+
+	size_t ScriptSerializerTrackingAllocPolicy::getMaxAllocationSize() {
+		return ScriptingAllocPolicy::getMaxAllocationSize() - blockHeaderSize;
+	}
+
+	ScriptSerializerMemoryStats ScriptSerializerTrackingAllocPolicy::getStats() {
+		OGRE_LOCK_MUTEX(statsMutex)
+		return stats;
+	}
+
+}
@@ -8,7 +8,7 @@ namespace Ogre {
 	
 	const String sPluginName = "ScriptSerializer";
 	
-	ScriptSerializerPlugin::ScriptSerializerPlugin() {
+	ScriptSerializerPlugin::ScriptSerializerPlugin() : mSerializeManager(0) {
 	}
 
 	/// @copydoc Plugin::getName
@@ -28,6 +28,7 @@ namespace Ogre {
 	/// @copydoc Plugin::shutdown
 	void ScriptSerializerPlugin::shutdown() {
 		OGRE_DELETE mSerializeManager;
+		mSerializeManager = 0;
 	}
 	
 	/// @copydoc Plugin::uninstall
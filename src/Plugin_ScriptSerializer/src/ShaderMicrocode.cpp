@@ -0,0 +1,199 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ShaderMicrocode.h"
+using namespace std;
+
+
+
+#ifdef USE_MICROCODE_SHADERCACHE
+
+namespace Ogre {
+
+	const size_t minMatchLength = 4;
+	const size_t lastLiterals = 5;
+	const size_t matchHashBits = 12;
+
+	static void writeLength(MicrocodeBuffer& out, size_t length) {
+		for (; length >= 255; length -= 255) {
+			out.push_back(255);
+		}
+		out.push_back(static_cast<uint8>(length));
+	}
+
+	static void writeSequence(MicrocodeBuffer& out, const uint8* literals, size_t literalLength, size_t distance, size_t matchLength) {
+		size_t matchCode = matchLength ? matchLength - minMatchLength : 0;
+		out.push_back(static_cast<uint8>(std::min<size_t>(literalLength, 15) << 4 | std::min<size_t>(matchCode, 15)));
+		if (literalLength >= 15) {
+			writeLength(out, literalLength - 15);
+		}
+		out.insert(out.end(), literals, literals + literalLength);
+		if (matchLength) {
+			out.push_back(static_cast<uint8>(distance));
+			out.push_back(static_cast<uint8>(distance >> 8));
+			if (matchCode >= 15) {
+				writeLength(out, matchCode - 15);
+			}
+		}
+	}
+
+	bool MicrocodeCodec::compress(const uint8* in, size_t size, MicrocodeBuffer& out) {
+		out.clear();
+		if (size <= minMatchLength + lastLiterals) {
+			return false;
+		}
+
+		vector<uint32>::type table(1 << matchHashBits, 0);		// Last position + 1 of each hashed 4 byte sequence
+		size_t limit = size - lastLiterals;
+		size_t anchor = 0;
+		size_t pos = 0;
+		while (pos + minMatchLength <= limit) {
+			uint32 sequence;
+			memcpy(&sequence, in + pos, sizeof(sequence));
+			uint32 hash = (sequence * 2654435761U) >> (32 - matchHashBits);
+			size_t candidate = table[hash];
+			table[hash] = static_cast<uint32>(pos + 1);
+
+			if (!candidate || pos - (candidate - 1) > 0xffff || memcmp(in + candidate - 1, in + pos, minMatchLength) != 0) {
+				pos++;
+				continue;
+			}
+
+			size_t match = candidate - 1;
+			size_t length = minMatchLength;
+			while (pos + length < limit && in[match + length] == in[pos + length]) {
+				length++;
+			}
+			writeSequence(out, in + anchor, pos - anchor, pos - match, length);
+			pos += length;
+			anchor = pos;
+			if (out.size() >= size) {
+				return false;
+			}
+		}
+		writeSequence(out, in + anchor, size - anchor, 0, 0);
+		return out.size() < size;
+	}
+
+	static bool readLength(const uint8*& in, const uint8* end, size_t& length) {
+		uint8 byte;
+		do {
+			if (in == end) {
+				return false;
+			}
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	bool MicrocodeCodec::decompress(const uint8* in, size_t storedSize, uint8* out, size_t size) {
+		const uint8* end = in + storedSize;
+		uint8* outStart = out;
+		uint8* outEnd = out + size;
+		while (in != end) {
+			uint8 token = *in++;
+			size_t literalLength = token >> 4;
+			if (literalLength == 15 && !readLength(in, end, literalLength)) {
+				return false;
+			}
+			if (literalLength > static_cast<size_t>(end - in) || literalLength > static_cast<size_t>(outEnd - out)) {
+				return false;
+			}
+			memcpy(out, in, literalLength);
+			in += literalLength;
+			out += literalLength;
+			if (in == end) {
+				break;
+			}
+
+			if (end - in < 2) {
+				return false;
+			}
+			size_t distance = in[0] | in[1] << 8;
+			in += 2;
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !readLength(in, end, matchLength)) {
+				return false;
+			}
+			matchLength += minMatchLength;
+			if (!distance || distance > static_cast<size_t>(out - outStart) || matchLength > static_cast<size_t>(outEnd - out)) {
+				return false;
+			}
+			// The match may overlap the bytes it produces
+			const uint8* match = out - distance;
+			for (size_t i = 0; i < matchLength; i++) {
+				*out++ = *match++;
+			}
+		}
+		return out == outEnd;
+	}
+
+
+	MicrocodeCapture::MicrocodeCapture(const ShaderCacheIndex& index) : DataStream(WRITE), mIndex(index), mPosition(0) {
+		startField(F_Count, sizeof(uint32), true);
+	}
+
+	size_t MicrocodeCapture::write(const void* buf, size_t count) {
+		const uint8* in = static_cast<const uint8*>(buf);
+		const uint8* end = in + count;
+		for (;;) {
+			// A field is completed as soon as it is filled.  Empty names and microcode are filled when they start, so
+			// an empty microcode at the end of the cache is taken before Ogre stops writing
+			while (mFilled == mNeeded) {
+				completeField();
+			}
+			if (in == end) {
+				break;
+			}
+			size_t take = std::min<size_t>(mNeeded - mFilled, end - in);
+			if (mKeep) {
+				mData.insert(mData.end(), in, in + take);
+			}
+			in += take;
+			mFilled += take;
+		}
+		mPosition += count;
+		return count;
+	}
+
+	void MicrocodeCapture::startField(Field field, size_t size, bool keep) {
+		mField = field;
+		mNeeded = size;
+		mFilled = 0;
+		mKeep = keep;
+		mData.clear();
+	}
+
+	uint32 MicrocodeCapture::getLength() const {
+		uint32 length;
+		memcpy(&length, &mData[0], sizeof(length));
+		return length;
+	}
+
+	void MicrocodeCapture::completeField() {
+		switch (mField) {
+		case F_Count:
+			startField(F_NameLength, sizeof(uint32), true);
+			break;
+		case F_NameLength:
+			startField(F_Name, getLength(), true);
+			break;
+		case F_Name:
+			mName.assign(mData.begin(), mData.end());
+			startField(F_CodeLength, sizeof(uint32), true);
+			break;
+		case F_CodeLength:
+			startField(F_Code, getLength(), mIndex.find(mName) == mIndex.end());
+			break;
+		case F_Code:
+			if (mKeep) {
+				mEntries.push_back(std::make_pair(mName, MicrocodeBuffer()));
+				mEntries.back().second.swap(mData);
+			}
+			startField(F_NameLength, sizeof(uint32), true);
+			break;
+		}
+	}
+
+}
+
+#endif	//USE_MICROCODE_SHADERCACHE
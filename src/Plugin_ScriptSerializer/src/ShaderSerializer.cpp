@@ -1,5 +1,6 @@
 #include "ScriptSerializerPreCompiled.h"
 #include "ShaderSerializer.h"
+#include <set>
 using namespace std;
 
 
@@ -8,7 +9,23 @@ using namespace std;
 
 namespace Ogre {
 
-	ShaderSerializer::ShaderSerializer() {
+	const uint32 shaderCacheMagicCode = ('S' | 'S' << 8 | 'H' << 16 | 'C' << 24 );
+	const uint32 shaderCacheVersion = 0x0001;
+
+	struct ShaderCacheHeader {
+		uint32 magic;
+		uint32 version;
+	};
+
+	/// Precedes the name and the stored microcode of each program
+	struct ShaderEntryHeader {
+		uint32 nameLength;
+		uint32 size;
+		uint32 storedSize;
+	};
+
+	ShaderSerializer::ShaderSerializer(const String& filename, bool compress)
+		: mFilename(filename), mCompress(compress), mEnd(0), mRewrite(true), mUnclaimedLoaded(false) {
 	}
 
 	ShaderSerializer::~ShaderSerializer() {
@@ -19,12 +36,198 @@ namespace Ogre {
 		GpuProgramManager::getSingleton().setSaveMicrocodesToCache(cache);
 	}
 
-	void ShaderSerializer::saveCache(const DataStreamPtr& stream) {
-		GpuProgramManager::getSingleton().saveMicrocodeCache(stream);
+	void ShaderSerializer::loadIndex() {
+		mIndex.clear();
+		mEnd = 0;
+		mRewrite = true;
+
+		ifstream file(mFilename.c_str(), ios::binary);
+		if (!file) {
+			return;
+		}
+
+		ShaderCacheHeader header;
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != shaderCacheMagicCode || header.version != shaderCacheVersion) {
+			LogManager::getSingleton().logMessage("Shader cache " + mFilename + " has another format.  It is written again");
+			return;
+		}
+		file.seekg(0, ios::end);
+		uint64 fileSize = static_cast<uint64>(file.tellg());
+		mEnd = sizeof(header);
+		mRewrite = false;
+
+		// Only the entry headers are read.  An entry cut short by a crash ends the index, and the next save overwrites it
+		for (;;) {
+			ShaderEntryHeader entryHeader;
+			file.seekg(static_cast<streamoff>(mEnd));
+			if (!file.read(reinterpret_cast<char*>(&entryHeader), sizeof(entryHeader))) {
+				break;
+			}
+			uint64 offset = mEnd + sizeof(entryHeader) + entryHeader.nameLength;
+			if (entryHeader.storedSize > entryHeader.size || (entryHeader.size && !entryHeader.storedSize) || offset + entryHeader.storedSize > fileSize) {
+				break;
+			}
+
+			String name(entryHeader.nameLength, '\0');
+			if (entryHeader.nameLength && !file.read(&name[0], entryHeader.nameLength)) {
+				break;
+			}
+			CacheEntry entry = { offset, entryHeader.size, entryHeader.storedSize, false };
+			mIndex[name] = entry;
+			mEnd = offset + entryHeader.storedSize;
+		}
 	}
 
-	void ShaderSerializer::loadCache(const DataStreamPtr& stream) {
-		GpuProgramManager::getSingleton().loadMicrocodeCache(stream);
+	void ShaderSerializer::loadGroup(const String& groupName) {
+		String prefix;
+		if (mIndex.empty() || !getRenderSystemPrefix(prefix)) {
+			return;
+		}
+
+		ifstream file(mFilename.c_str(), ios::binary);
+		loadPrograms(GpuProgramManager::getSingleton().getResourceIterator(), groupName, prefix, file);
+		loadPrograms(HighLevelGpuProgramManager::getSingleton().getResourceIterator(), groupName, prefix, file);
+	}
+
+	void ShaderSerializer::loadUnclaimed() {
+		String prefix;
+		if (mUnclaimedLoaded || mIndex.empty() || !getRenderSystemPrefix(prefix)) {
+			return;
+		}
+		mUnclaimedLoaded = true;
+
+		std::set<String> declared;
+		ResourceManager::ResourceMapIterator programs = GpuProgramManager::getSingleton().getResourceIterator();
+		while (programs.hasMoreElements()) {
+			declared.insert(prefix + programs.getNext()->getName());
+		}
+		programs = HighLevelGpuProgramManager::getSingleton().getResourceIterator();
+		while (programs.hasMoreElements()) {
+			declared.insert(prefix + programs.getNext()->getName());
+		}
+
+		// The microcode of other render systems stays in the file
+		ifstream file(mFilename.c_str(), ios::binary);
+		for (CacheIndex::iterator it = mIndex.begin(); it != mIndex.end(); ) {
+			if (!it->second.loaded && it->first.compare(0, prefix.length(), prefix) == 0 && declared.find(it->first) == declared.end() &&
+				!loadEntry(file, it->first.substr(prefix.length()), it->second)) {
+				mIndex.erase(it++);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	size_t ShaderSerializer::saveCache() {
+		GpuProgramManager* programManager = GpuProgramManager::getSingletonPtr();
+		if (!programManager) {
+			return 0;
+		}
+
+		MicrocodeCapture* capture = OGRE_NEW MicrocodeCapture(mIndex);
+		DataStreamPtr stream(capture);
+		programManager->saveMicrocodeCache(stream);
+		MicrocodeCapture::EntryList& entries = capture->getEntries();
+		if (entries.empty()) {
+			return 0;
+		}
+
+		fstream file;
+		if (mRewrite) {
+			file.open(mFilename.c_str(), ios::in | ios::out | ios::binary | ios::trunc);
+			ShaderCacheHeader header = { shaderCacheMagicCode, shaderCacheVersion };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			mEnd = sizeof(header);
+		}
+		else {
+			file.open(mFilename.c_str(), ios::in | ios::out | ios::binary);
+			file.seekp(static_cast<streamoff>(mEnd));
+		}
+
+		// The index only takes the new entries once they are all written.  Otherwise the next save writes them again from the same place
+		CacheIndex added;
+		uint64 end = mEnd;
+		MicrocodeBuffer compressed;
+		for (MicrocodeCapture::EntryList::iterator it = entries.begin(); it != entries.end(); ++it) {
+			const String& name = it->first;
+			const MicrocodeBuffer& microcode = it->second;
+			const uint8* data = microcode.empty() ? 0 : &microcode[0];
+			ShaderEntryHeader entryHeader = { static_cast<uint32>(name.length()), static_cast<uint32>(microcode.size()), static_cast<uint32>(microcode.size()) };
+			if (mCompress && MicrocodeCodec::compress(data, microcode.size(), compressed)) {
+				data = &compressed[0];
+				entryHeader.storedSize = static_cast<uint32>(compressed.size());
+			}
+
+			file.write(reinterpret_cast<const char*>(&entryHeader), sizeof(entryHeader));
+			file.write(name.c_str(), name.length());
+			file.write(reinterpret_cast<const char*>(data), entryHeader.storedSize);
+
+			CacheEntry entry = { end + sizeof(entryHeader) + entryHeader.nameLength, entryHeader.size, entryHeader.storedSize, true };
+			added[name] = entry;
+			end = entry.offset + entry.storedSize;
+		}
+		file.close();
+		if (file.fail()) {
+			LogManager::getSingleton().logMessage("WARNING: Cannot write to the shader cache: " + mFilename);
+			return 0;
+		}
+
+		mIndex.insert(added.begin(), added.end());
+		mEnd = end;
+		mRewrite = false;
+		return entries.size();
+	}
+
+	void ShaderSerializer::loadPrograms(ResourceManager::ResourceMapIterator programs, const String& groupName, const String& prefix, ifstream& file) {
+		while (programs.hasMoreElements()) {
+			ResourcePtr program = programs.getNext();
+			if (program->getGroup() != groupName) {
+				continue;
+			}
+			CacheIndex::iterator it = mIndex.find(prefix + program->getName());
+			if (it != mIndex.end() && !it->second.loaded && !loadEntry(file, program->getName(), it->second)) {
+				mIndex.erase(it);
+			}
+		}
+	}
+
+	bool ShaderSerializer::loadEntry(ifstream& file, const String& name, CacheEntry& entry) {
+		// Not tried again either way.  A bad entry is left out of the index by the caller, so the program Ogre compiles
+		// instead is appended by the next save and replaces it when the index is read
+		entry.loaded = true;
+
+		GpuProgramManager& programManager = GpuProgramManager::getSingleton();
+		GpuProgramManager::Microcode microcode = programManager.createMicrocode(entry.size);
+		file.clear();
+		file.seekg(static_cast<streamoff>(entry.offset));
+		bool valid;
+		if (entry.storedSize == entry.size) {
+			valid = file.read(reinterpret_cast<char*>(microcode->getPtr()), entry.size).good();
+		}
+		else {
+			MicrocodeBuffer stored(entry.storedSize);
+			valid = file.read(reinterpret_cast<char*>(&stored[0]), entry.storedSize) && MicrocodeCodec::decompress(&stored[0], entry.storedSize, microcode->getPtr(), entry.size);
+		}
+
+		if (!valid) {
+			LogManager::getSingleton().logMessage("WARNING: Cannot read the cached microcode of " + name + " from " + mFilename);
+			return false;
+		}
+		programManager.addMicrocodeToCache(name, microcode);
+		return true;
+	}
+
+	bool ShaderSerializer::getRenderSystemPrefix(String& prefix) {
+		// Headless runs may have no render system.  Nothing is compiled then, and nothing is handed to Ogre
+		RenderSystem* renderSystem = Root::getSingleton().getRenderSystem();
+		if (!renderSystem) {
+			return false;
+		}
+
+		// Ogre names the microcode of each render system this way, see GpuProgramManager::addMicrocodeToCache
+		prefix = renderSystem->getName() + "_";
+		return true;
 	}
 
 }
@@ -0,0 +1,199 @@
+#include "ScriptSerializerTests.h"
+#include "ScriptCachePipeline.h"
+
+using namespace Ogre;
+
+#if OGRE_THREAD_SUPPORT
+
+/// Cached scripts whose tree holds their own name.  Names starting with "stale" have no fresh cached version
+class FakeStages : public ScriptCachePipeline::Stages
+{
+public:
+	FakeStages() : writesBlocked(false) { }
+
+	virtual DataStreamPtr readScript(const String& binaryFilename, time_t scriptTimestamp, bool cached) {
+		if (StringUtil::startsWith(binaryFilename, "stale", false)) {
+			return DataStreamPtr();
+		}
+		return DataStreamPtr(OGRE_NEW MemoryDataStream(binaryFilename, 1));
+	}
+
+	virtual AbstractNodeListPtr decodeScript(const DataStreamPtr& stream) {
+		AbstractNodeListPtr ast(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+		AtomAbstractNode* atom = OGRE_NEW AtomAbstractNode(0);
+		atom->value = stream->getName();
+		ast->push_back(AbstractNodePtr(atom));
+		return ast;
+	}
+
+	virtual void writeScript(const String& binaryFilename, size_t scriptTimestamp, const AbstractNodeListPtr& ast) {
+		OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+		while (writesBlocked) {
+			OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+		}
+	}
+
+	void blockWrites(bool blocked) {
+		OGRE_LOCK_MUTEX(mMutex)
+		writesBlocked = blocked;
+		OGRE_THREAD_NOTIFY_ALL(mCondition)
+	}
+
+private:
+	bool writesBlocked;
+	OGRE_MUTEX(mMutex)
+	OGRE_THREAD_SYNCHRONISER(mCondition)
+};
+
+/// Lets a test wait until a queue of the pipeline has reached a depth
+class QueueWatcher : public ScriptCacheListener
+{
+public:
+	QueueWatcher(const String& queue) : queue(queue), maxDepth(0) { }
+
+	virtual void queueChanged(const char* name, size_t depth) {
+		if (queue == name) {
+			OGRE_LOCK_MUTEX(mMutex)
+			maxDepth = std::max(maxDepth, depth);
+			OGRE_THREAD_NOTIFY_ALL(mCondition)
+		}
+	}
+
+	void waitFor(size_t expected) {
+		OGRE_LOCK_MUTEX_NAMED(mMutex, lock)
+		while (maxDepth < expected) {
+			OGRE_THREAD_WAIT(mCondition, mMutex, lock)
+		}
+	}
+
+private:
+	String queue;
+	size_t maxDepth;
+	OGRE_MUTEX(mMutex)
+	OGRE_THREAD_SYNCHRONISER(mCondition)
+};
+
+/// Writes the given number of trees, waiting whenever the write queue is full
+struct WriteMany {
+	WriteMany(ScriptCachePipeline* pipeline, size_t count) : pipeline(pipeline), count(count) { }
+
+	void operator()() {
+		for (size_t i = 0; i < count; i++) {
+			AbstractNodeListPtr ast(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+			pipeline->write("written" + StringConverter::toString(i) + ".sbin", 1, ast);
+		}
+	}
+
+	ScriptCachePipeline* pipeline;
+	size_t count;
+};
+
+static String treeName(const AbstractNodeListPtr& ast) {
+	if (ast.isNull() || ast->empty()) {
+		return StringUtil::BLANK;
+	}
+	return static_cast<AtomAbstractNode*>(ast->front().get())->value;
+}
+
+/// Ogre skips scripts the cache expected.  take() drops the trees in front of the one asked for
+static void testOutOfOrderTake() {
+	String test = "testOutOfOrderTake";
+	FakeStages stages;
+	ScriptCachePipeline pipeline(&stages, 2);
+	const char* names[] = { "a.sbin", "b.sbin", "stale.sbin", "c.sbin", "d.sbin" };
+	for (size_t i = 0; i < 5; i++) {
+		pipeline.add(names[i], 1, true);
+	}
+
+	check(pipeline.take("unknown.sbin").isNull(), test, "a script never added has a tree");
+	check(treeName(pipeline.take("b.sbin")) == "b.sbin", test, "the tree of b was not handed out");
+	check(pipeline.take("stale.sbin").isNull(), test, "a stale script has a tree");
+	check(treeName(pipeline.take("d.sbin")) == "d.sbin", test, "the tree of d was not handed out");
+	check(pipeline.take("c.sbin").isNull(), test, "a dropped script is still handed out");
+
+	ScriptPipelineStats stats;
+	pipeline.finish(stats);
+	check(stats.dropped == 2, test, "expected a and c dropped, counted " + StringConverter::toString(stats.dropped));
+	check(stats.stages[ScriptPipelineStats::PS_Read].scripts == 5 && stats.stages[ScriptPipelineStats::PS_Decode].scripts == 5, test,
+		"every script added should have been read and decoded");
+}
+
+/// Scripts added and not taken are dropped by finish, and the next group starts from empty queues
+static void testFinishDropsUntaken() {
+	String test = "testFinishDropsUntaken";
+	FakeStages stages;
+	ScriptCachePipeline pipeline(&stages, 1);
+	for (size_t i = 0; i < 10; i++) {
+		pipeline.add("group1_" + StringConverter::toString(i) + ".sbin", 1, true);
+	}
+	ScriptPipelineStats stats;
+	pipeline.finish(stats);
+	check(pipeline.take("group1_0.sbin").isNull(), test, "a script of the finished group is still handed out");
+	check(stats.dropped <= 10, test, "more scripts dropped than added");
+
+	pipeline.add("group2.sbin", 1, true);
+	check(treeName(pipeline.take("group2.sbin")) == "group2.sbin", test, "the next group did not get its tree");
+	pipeline.finish(stats);
+	check(stats.dropped == 0, test, "the counters were not started again by finish");
+}
+
+/// A blocked writer holds the caller back once the write queue is full, and finish waits until every tree is written
+static void testWriteBackPressure() {
+	String test = "testWriteBackPressure";
+	const size_t queueSize = 3;
+	const size_t writes = queueSize + 5;
+	FakeStages stages;
+	QueueWatcher watcher("write");
+	ScriptCachePipeline pipeline(&stages, queueSize);
+	pipeline.setListener(&watcher);
+
+	stages.blockWrites(true);
+	OGRE_THREAD_CREATE(writer, WriteMany(&pipeline, writes));
+	watcher.waitFor(queueSize);
+	stages.blockWrites(false);
+	writer->join();
+	OGRE_THREAD_DESTROY(writer);
+
+	ScriptPipelineStats stats;
+	pipeline.finish(stats);
+	pipeline.setListener(0);
+	check(stats.stages[ScriptPipelineStats::PS_Write].maxQueueDepth == queueSize, test,
+		"the write queue grew to " + StringConverter::toString(stats.stages[ScriptPipelineStats::PS_Write].maxQueueDepth) + " trees");
+	check(stats.stages[ScriptPipelineStats::PS_Write].scripts == writes, test, "finish returned before every tree was written");
+	check(pipeline.takeWritten().size() == writes, test, "not every written script was reported");
+}
+
+/// Reading stops a queue ahead of the compiler, so the trees in flight stay bounded
+static void testReadBackPressure() {
+	String test = "testReadBackPressure";
+	const size_t queueSize = 2;
+	FakeStages stages;
+	ScriptCachePipeline pipeline(&stages, queueSize);
+	for (size_t i = 0; i < 20; i++) {
+		pipeline.add(StringConverter::toString(i) + ".sbin", 1, true);
+	}
+	for (size_t i = 0; i < 20; i++) {
+		pipeline.take(StringConverter::toString(i) + ".sbin");
+	}
+
+	ScriptPipelineStats stats;
+	pipeline.finish(stats);
+	check(stats.stages[ScriptPipelineStats::PS_Decode].maxQueueDepth <= queueSize && stats.stages[ScriptPipelineStats::PS_Compile].maxQueueDepth <= queueSize,
+		test, "the decode or compile queue grew past its bound");
+	check(stats.dropped == 0, test, "scripts taken in order were dropped");
+}
+
+void runPipelineTests() {
+	testOutOfOrderTake();
+	testFinishDropsUntaken();
+	testWriteBackPressure();
+	testReadBackPressure();
+}
+
+#else
+
+// The pipeline has no threads to run on without thread support in Ogre
+void runPipelineTests() {
+}
+
+#endif
@@ -0,0 +1,424 @@
+#include "ScriptSerializerTests.h"
+#include "ScriptSerializer.h"
+#include <iostream>
+
+using namespace Ogre;
+using namespace std;
+
+static int failures = 0;
+
+void check(bool condition, const String& test, const String& message) {
+	if (!condition) {
+		cerr << test << ": " << message << "\n";
+		failures++;
+	}
+}
+
+static AbstractNodePtr makeAtom(AbstractNode* parent, const String& value, int line) {
+	AtomAbstractNode* atom = OGRE_NEW AtomAbstractNode(parent);
+	atom->file = "test.material";
+	atom->line = line;
+	atom->value = value;
+	return AbstractNodePtr(atom);
+}
+
+/**
+ * Materials with a technique and a diffuse property each.  Every material has a name of its own, and the classes, the
+ * property name and the empty technique name repeat.  The values repeat every few materials if asked to, otherwise
+ * no two subtrees are alike and none is stored as a reference
+ */
+static AbstractNodeListPtr makeMaterials(size_t count, size_t distinctValues = 0) {
+	AbstractNodeListPtr trees(OGRE_NEW_T(AbstractNodeList, MEMCATEGORY_GENERAL)(), SPFM_DELETE_T);
+	for (size_t i = 0; i < count; i++) {
+		int line = static_cast<int>(i * 10 + 1);
+		ObjectAbstractNode* material = OGRE_NEW ObjectAbstractNode(0);
+		material->file = "test.material";
+		material->line = line;
+		material->cls = "material";
+		material->name = "Material" + StringConverter::toString(i);
+
+		ObjectAbstractNode* technique = OGRE_NEW ObjectAbstractNode(material);
+		technique->file = "test.material";
+		technique->line = line + 1;
+		technique->cls = "technique";
+
+		PropertyAbstractNode* diffuse = OGRE_NEW PropertyAbstractNode(technique);
+		diffuse->file = "test.material";
+		diffuse->line = line + 2;
+		diffuse->name = "diffuse";
+		size_t value = distinctValues ? i % distinctValues : i;
+		diffuse->values.push_back(makeAtom(diffuse, StringConverter::toString(value) + ".5", line + 2));
+
+		technique->children.push_back(AbstractNodePtr(diffuse));
+		material->children.push_back(AbstractNodePtr(technique));
+		trees->push_back(AbstractNodePtr(material));
+	}
+	return trees;
+}
+
+static DataStreamPtr serializeTrees(ScriptSerializer& serializer, const AbstractNodeListPtr& trees) {
+	// Cleared, so whole buffers can be compared
+	MemoryDataStream* memory = OGRE_NEW MemoryDataStream("test.material.sbin", static_cast<size_t>(1 << 20));
+	memset(memory->getPtr(), 0, memory->size());
+	DataStreamPtr stream(memory);
+	serializer.serialize(stream, trees, 1);
+	stream->seek(0);
+	return stream;
+}
+
+/// Repeated techniques are restored at their own lines with their bases, and reading and visiting count the same nodes
+static void testSharedSubtrees() {
+	String test = "testSharedSubtrees";
+	AbstractNodeListPtr trees = makeMaterials(40, 4);
+	for (AbstractNodeList::iterator it = trees->begin(); it != trees->end(); ++it) {
+		ObjectAbstractNode* technique = static_cast<ObjectAbstractNode*>(static_cast<ObjectAbstractNode*>(it->get())->children.front().get());
+		technique->bases.push_back("base_technique");
+	}
+	ScriptSerializer serializer;
+	DataStreamPtr stream = serializeTrees(serializer, trees);
+	ScriptSerializer::Statistics written = serializer.getStatistics();
+	AbstractNodeListPtr read = serializer.deserialize(stream);
+	ScriptSerializer::Statistics restored = serializer.getStatistics();
+	stream->seek(0);
+	ScriptSerializerVisitor visitor;
+	serializer.visit(stream, visitor);
+	const ScriptSerializer::Statistics& visited = serializer.getStatistics();
+
+	check(restored.nodesShared > 0 && restored.nodesShared == written.nodesShared && restored.nodeBlocks == written.nodeBlocks, test,
+		"deserialize restored " + StringConverter::toString(restored.nodesShared) + " shared nodes, " + StringConverter::toString(written.nodesShared) + " were written");
+	check(visited.nodesShared == restored.nodesShared && visited.nodeBlocks == restored.nodeBlocks && visited.stringCopies == 0, test,
+		"visit counted " + StringConverter::toString(visited.nodesShared) + " shared nodes, deserialize " + StringConverter::toString(restored.nodesShared));
+
+	AbstractNodeList::iterator original = trees->begin();
+	for (AbstractNodeList::iterator it = read->begin(); it != read->end(); ++it, ++original) {
+		ObjectAbstractNode* technique = static_cast<ObjectAbstractNode*>(static_cast<ObjectAbstractNode*>(it->get())->children.front().get());
+		AbstractNode* diffuse = technique->children.front().get();
+		if (technique->parent != it->get() || technique->bases.size() != 1 || diffuse->parent != technique ||
+			diffuse->line != (*original)->line + 2 || static_cast<PropertyAbstractNode*>(diffuse)->values.front()->line != diffuse->line) {
+			check(false, test, "the technique of " + static_cast<ObjectAbstractNode*>(it->get())->name + " was not restored in place");
+			return;
+		}
+	}
+}
+
+/// Each string is copied out of the table once per reference but the last, which is moved into its node
+static void testStringCopies(bool columnar) {
+	String test = columnar ? "testStringCopies (columnar)" : "testStringCopies";
+	const size_t materials = 50;
+	ScriptSerializer serializer;
+	serializer.setColumnarLayout(columnar);
+	DataStreamPtr stream = serializeTrees(serializer, makeMaterials(materials));
+	AbstractNodeListPtr trees = serializer.deserialize(stream);
+	const ScriptSerializer::Statistics& stats = serializer.getStatistics();
+
+	// Six strings per material: the two classes, the two names, the property name and the value
+	size_t references = materials * 6;
+	size_t uniqueStrings = 4 + materials * 2;
+	check(trees->size() == materials, test, "the materials did not survive the round trip");
+	check(stats.stringCount == uniqueStrings, test, "expected " + StringConverter::toString(uniqueStrings) + " unique strings, read " + StringConverter::toString(stats.stringCount));
+	check(stats.stringCopies == references - uniqueStrings, test, "expected " + StringConverter::toString(references - uniqueStrings) + " string copies, made " + StringConverter::toString(stats.stringCopies));
+}
+
+/// The segments are encoded on several threads but merged in script order, so the file does not depend on the thread count
+static void testDeterministicEncoding(bool columnar) {
+	String test = columnar ? "testDeterministicEncoding (columnar)" : "testDeterministicEncoding";
+	AbstractNodeListPtr trees = makeMaterials(200, 7);
+	ScriptSerializer serial;
+	serial.setColumnarLayout(columnar);
+	serial.setThreadCount(1);
+	DataStreamPtr expected = serializeTrees(serial, trees);
+	check(columnar || serial.getStatistics().nodesShared > 0, test, "the repeated subtrees were not stored as references");
+
+	for (size_t run = 0; run < 5; run++) {
+		ScriptSerializer parallel;
+		parallel.setColumnarLayout(columnar);
+		parallel.setThreadCount(4);
+		DataStreamPtr actual = serializeTrees(parallel, trees);
+		const uint8* expectedBytes = static_cast<MemoryDataStream*>(expected.get())->getPtr();
+		const uint8* actualBytes = static_cast<MemoryDataStream*>(actual.get())->getPtr();
+		if (memcmp(expectedBytes, actualBytes, expected->size()) != 0) {
+			check(false, test, "four threads wrote other bytes than one thread in run " + StringConverter::toString(run));
+			return;
+		}
+	}
+}
+
+/// A node the columnar encoder cannot store fails the serialization on the calling thread, whichever thread encoded it
+static void testEncodeFailure() {
+	String test = "testEncodeFailure";
+	AbstractNodeListPtr trees = makeMaterials(16);
+	AbstractNodeList::iterator broken = trees->begin();
+	std::advance(broken, 9);
+	*broken = makeAtom(0, "broken", 1);
+	(*broken)->type = ANT_UNKNOWN;
+
+	ScriptSerializer parallel;
+	parallel.setColumnarLayout(true);
+	parallel.setThreadCount(4);
+	bool thrown = false;
+	try {
+		serializeTrees(parallel, trees);
+	}
+	catch (Exception&) {
+		thrown = true;
+	}
+	check(thrown, test, "the encoding error did not reach the caller");
+}
+
+/// An atom stored as a property would own a list the shape does not have, which fails reading and visiting alike
+static void testCorruptColumns() {
+	String test = "testCorruptColumns";
+	ScriptSerializer serializer;
+	serializer.setColumnarLayout(true);
+	DataStreamPtr stream = serializeTrees(serializer, makeMaterials(1));
+
+	// The type and abstract columns of the one segment end where the string table starts.  The types are those of
+	// the material, the technique, the property and its value
+	ScriptBlock::ScriptHeader header;
+	stream->read(&header, sizeof(header));
+	uint8* types = static_cast<MemoryDataStream*>(stream.get())->getPtr() + static_cast<size_t>(header.stringTableOffset) - 2 - 4;
+	uint8* atom = std::find(types, types + 4, static_cast<uint8>(ANT_ATOM));
+	if (atom == types + 4) {
+		check(false, test, "the type column was not found");
+		return;
+	}
+	*atom = ANT_PROPERTY;
+
+	bool readFailed = false, visitFailed = false;
+	try {
+		stream->seek(0);
+		ScriptSerializer().deserialize(stream);
+	}
+	catch (Exception&) {
+		readFailed = true;
+	}
+	try {
+		stream->seek(0);
+		ScriptSerializerVisitor visitor;
+		ScriptSerializer().visit(stream, visitor);
+	}
+	catch (Exception&) {
+		visitFailed = true;
+	}
+	check(readFailed && visitFailed, test, "a property without a list was read");
+}
+
+/// Counts the lists of the objects and the atoms handed to it
+class ListCounter : public ScriptSerializerVisitor
+{
+public:
+	ListCounter() : bases(0), variables(0), atoms(0) { }
+
+	virtual void objectBase(const String& base) { bases++; }
+	virtual void objectVariable(const String& key, const String& value) { variables++; }
+	virtual void atom(const String& value, const ScriptBlock::AtomAbstractNodeBlock& block) { atoms++; }
+
+	size_t bases;
+	size_t variables;
+	size_t atoms;
+};
+
+/// Frequency ordered ids are stored as varints, which shrinks the segments and reads back to the same trees
+static void testCompactStrings() {
+	String test = "testCompactStrings";
+	AbstractNodeListPtr trees = makeMaterials(200, 7);
+	size_t objects = 0;
+	for (AbstractNodeList::iterator it = trees->begin(); it != trees->end(); ++it, ++objects) {
+		ObjectAbstractNode* material = static_cast<ObjectAbstractNode*>(it->get());
+		material->bases.push_back("BaseMaterial");
+		material->setVariable("$colour", "1 0 0");
+	}
+
+	// Strings seen once come first, so the repeated ones need two bytes unless their ids are handed out by frequency
+	ObjectAbstractNode* firstMaterial = static_cast<ObjectAbstractNode*>(trees->front().get());
+	const size_t uniqueBases = 150;
+	for (size_t i = 0; i < uniqueBases; i++) {
+		firstMaterial->bases.push_back("Unique" + StringConverter::toString(i));
+	}
+
+	ScriptSerializer fixed;
+	DataStreamPtr fixedStream = serializeTrees(fixed, trees);
+	ScriptSerializer compact;
+	compact.setFrequencyOrderedStrings(true);
+	DataStreamPtr compactStream = serializeTrees(compact, trees);
+
+	ScriptBlock::ScriptHeader fixedHeader, compactHeader;
+	fixedStream->read(&fixedHeader, sizeof(fixedHeader));
+	compactStream->read(&compactHeader, sizeof(compactHeader));
+	check(!(fixedHeader.flags & ScriptBlock::SF_CompactStrings) && (compactHeader.flags & ScriptBlock::SF_CompactStrings), test, "the header does not tell the string encodings apart");
+	check(compactHeader.stringTableOffset < fixedHeader.stringTableOffset, test, "the varint ids did not shrink the segments");
+	const ScriptSerializer::Statistics& stats = compact.getStatistics();
+	check(stats.referenceBytes == fixed.getStatistics().referenceBytes - (fixedHeader.stringTableOffset - compactHeader.stringTableOffset), test,
+		"the reference bytes reported do not match the bytes written");
+	check(stats.referenceBytesSaved > 0, test, "ordering the ids by frequency saved nothing");
+
+	// Written again with 32 bit ids, the trees read back give the same file as the original ones
+	fixedStream->seek(0);
+	compactStream->seek(0);
+	AbstractNodeListPtr fixedTrees = ScriptSerializer().deserialize(fixedStream);
+	AbstractNodeListPtr compactTrees = ScriptSerializer().deserialize(compactStream);
+	ScriptSerializer first, second;
+	DataStreamPtr fromFixed = serializeTrees(first, fixedTrees);
+	DataStreamPtr fromCompact = serializeTrees(second, compactTrees);
+	check(memcmp(static_cast<MemoryDataStream*>(fromFixed.get())->getPtr(), static_cast<MemoryDataStream*>(fromCompact.get())->getPtr(), fromFixed->size()) == 0,
+		test, "the trees read from varint ids differ from those read from 32 bit ids");
+
+	compactStream->seek(0);
+	ListCounter counter;
+	ScriptSerializer().visit(compactStream, counter);
+	check(counter.bases == objects + uniqueBases && counter.variables == objects && counter.atoms == objects, test, "the visitor did not get every list entry and atom");
+
+	// A file holding the other encoding is written again rather than updated
+	compactStream->seek(0);
+	check(!ScriptSerializer().update(compactStream, trees, 2), test, "a file with varint ids was updated with 32 bit ones");
+}
+
+/// Takes the file name and line off every node of the trees
+static void stripLines(AbstractNodeList& nodes) {
+	for (AbstractNodeList::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+		AbstractNode* node = it->get();
+		node->file.clear();
+		node->line = 0;
+		if (node->type == ANT_PROPERTY) {
+			stripLines(static_cast<PropertyAbstractNode*>(node)->values);
+		}
+		else if (node->type == ANT_OBJECT) {
+			ObjectAbstractNode* objectNode = static_cast<ObjectAbstractNode*>(node);
+			stripLines(objectNode->children);
+			stripLines(objectNode->values);
+			stripLines(objectNode->overrides);
+		}
+	}
+}
+
+/// Checks that no node of the trees has a file name or a line
+static bool hasNoLines(const AbstractNodeList& nodes) {
+	for (AbstractNodeList::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+		const AbstractNode* node = it->get();
+		if (!node->file.empty() || node->line != 0) {
+			return false;
+		}
+		if (node->type == ANT_PROPERTY && !hasNoLines(static_cast<const PropertyAbstractNode*>(node)->values)) {
+			return false;
+		}
+		if (node->type == ANT_OBJECT) {
+			const ObjectAbstractNode* objectNode = static_cast<const ObjectAbstractNode*>(node);
+			if (!hasNoLines(objectNode->children) || !hasNoLines(objectNode->values) || !hasNoLines(objectNode->overrides)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/// A release script reads back without lines and file names, and otherwise holds the trees it was written from
+static void testReleaseProfile(bool columnar) {
+	String test = columnar ? "testReleaseProfile (columnar)" : "testReleaseProfile";
+	AbstractNodeListPtr trees = makeMaterials(200, 7);
+	ObjectAbstractNode* firstMaterial = static_cast<ObjectAbstractNode*>(trees->front().get());
+	firstMaterial->bases.push_back("BaseMaterial");
+	firstMaterial->setVariable("$colour", "1 0 0");
+
+	ScriptSerializer debug;
+	debug.setColumnarLayout(columnar);
+	DataStreamPtr debugStream = serializeTrees(debug, trees);
+	ScriptSerializer release;
+	release.setColumnarLayout(columnar);
+	release.setReleaseProfile(true);
+	DataStreamPtr releaseStream = serializeTrees(release, trees);
+
+	ScriptBlock::ScriptHeader debugHeader, releaseHeader;
+	debugStream->read(&debugHeader, sizeof(debugHeader));
+	releaseStream->read(&releaseHeader, sizeof(releaseHeader));
+	check(!(debugHeader.flags & ScriptBlock::SF_Release) && (releaseHeader.flags & ScriptBlock::SF_Release), test, "the header does not tell the profiles apart");
+	check(releaseHeader.stringTableOffset < debugHeader.stringTableOffset, test, "leaving out the lines did not shrink the segments");
+
+	releaseStream->seek(0);
+	AbstractNodeListPtr releaseTrees = ScriptSerializer().deserialize(releaseStream);
+	check(releaseTrees->size() == trees->size(), test, "the release script did not read back every material");
+	check(hasNoLines(*releaseTrees), test, "nodes read from the release script have a file name or a line");
+
+	// Lines and file names are all the release profile leaves out.  Without them, the trees written and the trees
+	// read back give the same bytes.  The segment hashes cover the lines, so they are taken off the written trees as well
+	stripLines(*trees);
+	ScriptSerializer expected, actual;
+	expected.setColumnarLayout(columnar);
+	expected.setReleaseProfile(true);
+	actual.setColumnarLayout(columnar);
+	actual.setReleaseProfile(true);
+	DataStreamPtr expectedStream = serializeTrees(expected, trees);
+	DataStreamPtr actualStream = serializeTrees(actual, releaseTrees);
+	check(memcmp(static_cast<MemoryDataStream*>(expectedStream.get())->getPtr(), static_cast<MemoryDataStream*>(actualStream.get())->getPtr(), expectedStream->size()) == 0,
+		test, "the trees read back differ from those written");
+}
+
+/// Gives the first materials another name and diffuse value, both strings no other material uses
+static void changeMaterials(const AbstractNodeListPtr& trees, size_t count) {
+	AbstractNodeList::iterator it = trees->begin();
+	for (size_t i = 0; i < count && it != trees->end(); i++, ++it) {
+		ObjectAbstractNode* material = static_cast<ObjectAbstractNode*>(it->get());
+		material->name = "Changed" + StringConverter::toString(i);
+		ObjectAbstractNode* technique = static_cast<ObjectAbstractNode*>(material->children.front().get());
+		PropertyAbstractNode* diffuse = static_cast<PropertyAbstractNode*>(technique->children.front().get());
+		static_cast<AtomAbstractNode*>(diffuse->values.front().get())->value = "0." + StringConverter::toString(i);
+	}
+}
+
+/// An update keeps the unchanged segments, reports where the file now ends, and gives up once the table holds too many dead strings
+static void testUpdate() {
+	String test = "testUpdate";
+	const size_t materials = 40;
+	ScriptSerializer serializer;
+	DataStreamPtr stream = serializeTrees(serializer, makeMaterials(materials));
+
+	AbstractNodeListPtr changed = makeMaterials(materials);
+	changeMaterials(changed, 10);
+	check(serializer.update(stream, changed, 2), test, "a script with a quarter of its materials changed was not updated");
+	const ScriptSerializer::Statistics& stats = serializer.getStatistics();
+	check(stats.segmentsReused == materials - 10, test, "expected " + StringConverter::toString(materials - 10) + " segments kept, kept " + StringConverter::toString(stats.segmentsReused));
+
+	// Whatever lies past the reported size is left over from before
+	MemoryDataStream* cut = OGRE_NEW MemoryDataStream("cut.material.sbin", stats.fileSize);
+	memcpy(cut->getPtr(), static_cast<MemoryDataStream*>(stream.get())->getPtr(), stats.fileSize);
+	AbstractNodeListPtr trees = ScriptSerializer().deserialize(DataStreamPtr(cut));
+	ScriptSerializer expected, actual;
+	DataStreamPtr expectedStream = serializeTrees(expected, changed);
+	DataStreamPtr actualStream = serializeTrees(actual, trees);
+	check(memcmp(static_cast<MemoryDataStream*>(expectedStream.get())->getPtr(), static_cast<MemoryDataStream*>(actualStream.get())->getPtr(), expectedStream->size()) == 0,
+		test, "the updated script cut to its reported size does not read back as the new trees");
+
+	// Nearly half the materials renamed leaves more than a quarter of the strings unused
+	ScriptSerializer other;
+	stream = serializeTrees(other, makeMaterials(materials));
+	changed = makeMaterials(materials);
+	changeMaterials(changed, 19);
+	check(!other.update(stream, changed, 2), test, "a script whose string table would be mostly dead strings was updated");
+}
+
+int main(int argc, char** argv) {
+	// The serializer logs through Ogre.  Keep it off the console
+	LogManager* logManager = OGRE_NEW LogManager();
+	logManager->createLog("ScriptSerializerTests.log", true, false, true);
+
+	testStringCopies(false);
+	testStringCopies(true);
+	testSharedSubtrees();
+	testDeterministicEncoding(false);
+	testDeterministicEncoding(true);
+	testEncodeFailure();
+	testCorruptColumns();
+	testCompactStrings();
+	testReleaseProfile(false);
+	testReleaseProfile(true);
+	testUpdate();
+	runPipelineTests();
+	runShaderTests();
+
+	OGRE_DELETE logManager;
+	if (failures) {
+		cerr << failures << " checks failed\n";
+		return 1;
+	}
+	cout << "All checks passed\n";
+	return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "ScriptSerializerPreCompiled.h"
+
+/// Reports the message and counts a failure unless the condition holds
+void check(bool condition, const Ogre::String& test, const Ogre::String& message);
+
+/// The tests of each source file, run by main
+void runPipelineTests();
+void runShaderTests();
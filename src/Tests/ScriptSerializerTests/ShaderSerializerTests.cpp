@@ -0,0 +1,194 @@
+#include "ScriptSerializerTests.h"
+#include "ShaderSerializer.h"
+#include <cstdio>
+#include <fstream>
+
+using namespace Ogre;
+using namespace std;
+
+#ifdef USE_MICROCODE_SHADERCACHE
+
+/// Bytes that do not repeat in any way the compressor could find
+static MicrocodeBuffer makeNoise(size_t size, uint32 seed) {
+	MicrocodeBuffer noise(size);
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1664525 + 1013904223;
+		noise[i] = static_cast<uint8>(seed >> 24);
+	}
+	return noise;
+}
+
+/// Compresses the microcode, then checks that it decodes to the same bytes and not one byte further
+static bool roundTrip(const String& test, const MicrocodeBuffer& microcode, MicrocodeBuffer& compressed) {
+	if (!MicrocodeCodec::compress(&microcode[0], microcode.size(), compressed)) {
+		check(false, test, "repeated microcode of " + StringConverter::toString(microcode.size()) + " bytes was not compressed");
+		return false;
+	}
+	MicrocodeBuffer decoded(microcode.size() + 16, 0xcd);
+	bool valid = MicrocodeCodec::decompress(&compressed[0], compressed.size(), &decoded[0], microcode.size());
+	if (!valid || !equal(microcode.begin(), microcode.end(), decoded.begin()) || decoded.back() != 0xcd) {
+		check(false, test, "microcode of " + StringConverter::toString(microcode.size()) + " bytes did not decode to itself");
+		return false;
+	}
+	return true;
+}
+
+/// Noise is stored as it is
+static void testIncompressible() {
+	MicrocodeBuffer noise = makeNoise(4096, 1);
+	MicrocodeBuffer compressed;
+	check(!MicrocodeCodec::compress(&noise[0], noise.size(), compressed), "testIncompressible", "noise was compressed");
+}
+
+/// Matches of every length around the ones whose length takes extra bytes, 15 + 4 and 15 + 4 + 255
+static void testLongMatches() {
+	MicrocodeBuffer noise = makeNoise(600, 2);
+	MicrocodeBuffer compressed;
+	for (size_t length = 16; length < 560; length++) {
+		MicrocodeBuffer microcode(noise.begin(), noise.begin() + length);
+		microcode.insert(microcode.end(), noise.begin(), noise.begin() + length);
+		microcode.insert(microcode.end(), noise.begin() + 500, noise.end());
+		if (!roundTrip("testLongMatches", microcode, compressed)) {
+			return;
+		}
+	}
+}
+
+/// Runs are stored as matches that overlap the bytes they produce
+static void testOverlappingMatches() {
+	MicrocodeBuffer compressed;
+	for (size_t period = 1; period <= 4; period++) {
+		MicrocodeBuffer microcode = makeNoise(32, 3);
+		for (size_t i = 0; i < 1000; i++) {
+			microcode.push_back(microcode[32 - period + i % period]);
+		}
+		MicrocodeBuffer tail = makeNoise(32, 4);
+		microcode.insert(microcode.end(), tail.begin(), tail.end());
+		if (!roundTrip("testOverlappingMatches", microcode, compressed)) {
+			return;
+		}
+		check(compressed.size() < 100, "testOverlappingMatches", "a run was not stored as one match");
+	}
+}
+
+/// Stored microcode that was cut short or damaged is refused, and never decoded past the size it claims
+static void testDamagedMicrocode() {
+	String test = "testDamagedMicrocode";
+	MicrocodeBuffer noise = makeNoise(300, 5);
+	MicrocodeBuffer microcode(noise);
+	microcode.insert(microcode.end(), noise.begin(), noise.end());
+	microcode.insert(microcode.end(), 400, 7);
+	MicrocodeBuffer compressed;
+	if (!roundTrip(test, microcode, compressed)) {
+		return;
+	}
+
+	MicrocodeBuffer decoded(microcode.size() + 16);
+	for (size_t cut = 0; cut < compressed.size(); cut++) {
+		if (MicrocodeCodec::decompress(&compressed[0], cut, &decoded[0], microcode.size())) {
+			check(false, test, "microcode cut to " + StringConverter::toString(cut) + " bytes was decoded");
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < compressed.size(); i++) {
+		MicrocodeBuffer damaged(compressed);
+		damaged[i] ^= 0xff;
+		fill(decoded.begin(), decoded.end(), 0xcd);
+		MicrocodeCodec::decompress(&damaged[0], damaged.size(), &decoded[0], microcode.size());
+		if (decoded.back() != 0xcd) {
+			check(false, test, "damaged microcode was decoded past its size");
+			return;
+		}
+	}
+}
+
+/// Writes a program the way Ogre saves its cache, a field at a time or a byte at a time
+static void writeProgram(DataStream& stream, const String& name, const MicrocodeBuffer& microcode, bool byBytes) {
+	uint32 nameLength = static_cast<uint32>(name.length());
+	uint32 size = static_cast<uint32>(microcode.size());
+	MicrocodeBuffer bytes(reinterpret_cast<const uint8*>(&nameLength), reinterpret_cast<const uint8*>(&nameLength + 1));
+	bytes.insert(bytes.end(), name.begin(), name.end());
+	bytes.insert(bytes.end(), reinterpret_cast<const uint8*>(&size), reinterpret_cast<const uint8*>(&size + 1));
+	if (!byBytes) {
+		stream.write(&bytes[0], bytes.size());
+		if (size) {
+			stream.write(&microcode[0], size);
+		}
+		return;
+	}
+	bytes.insert(bytes.end(), microcode.begin(), microcode.end());
+	for (size_t i = 0; i < bytes.size(); i++) {
+		stream.write(&bytes[i], 1);
+	}
+}
+
+/// Programs already in the file are skipped, and an empty microcode is taken even when Ogre saves it last
+static void testCapture(bool byBytes) {
+	String test = byBytes ? "testCapture (by bytes)" : "testCapture";
+	ShaderCacheIndex index;
+	ShaderCacheEntry stored = { 0, 3, 3, true };
+	index["D3D9_stored"] = stored;
+
+	MicrocodeCapture capture(index);
+	uint32 count = 3;
+	capture.write(&count, sizeof(count));
+	writeProgram(capture, "D3D9_new", makeNoise(5, 6), byBytes);
+	writeProgram(capture, "D3D9_stored", makeNoise(3, 7), byBytes);
+	writeProgram(capture, "D3D9_empty", MicrocodeBuffer(), byBytes);
+
+	MicrocodeCapture::EntryList& entries = capture.getEntries();
+	check(entries.size() == 2, test, StringConverter::toString(entries.size()) + " programs were captured instead of 2");
+	if (entries.size() == 2) {
+		check(entries[0].first == "D3D9_new" && entries[0].second == makeNoise(5, 6), test, "the new program was not captured whole");
+		check(entries[1].first == "D3D9_empty" && entries[1].second.empty(), test, "the empty program saved last was lost");
+	}
+}
+
+/// Without a render system nothing is handed to Ogre, and the cache file is left as it is
+static void testHeadless() {
+	String test = "testHeadless";
+	Root* root = Root::getSingletonPtr() ? 0 : OGRE_NEW Root("", "", "");
+	check(!Root::getSingleton().getRenderSystem(), test, "a render system was set up");
+
+	// A cache holding one uncompressed program, in the layout of ShaderSerializer
+	String filename = "ShaderSerializerTests.cache";
+	{
+		ofstream file(filename.c_str(), ios::binary | ios::trunc);
+		uint32 header[] = { 'S' | 'S' << 8 | 'H' << 16 | 'C' << 24, 0x0001, 9, 4, 4 };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write("D3D9_prog", 9);
+		file.write("code", 4);
+	}
+
+	ShaderSerializer serializer(filename, true);
+	serializer.loadIndex();
+	serializer.loadGroup(ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+	serializer.loadUnclaimed();
+	check(serializer.saveCache() == 0, test, "programs were saved without a render system");
+
+	ifstream file(filename.c_str(), ios::binary | ios::ate);
+	check(file && file.tellg() == static_cast<streamoff>(5 * sizeof(uint32) + 13), test, "the cache file was changed");
+	file.close();
+	remove(filename.c_str());
+
+	OGRE_DELETE root;
+}
+
+void runShaderTests() {
+	testIncompressible();
+	testLongMatches();
+	testOverlappingMatches();
+	testDamagedMicrocode();
+	testCapture(false);
+	testCapture(true);
+	testHeadless();
+}
+
+#else
+
+// Ogre keeps no microcode cache before 1.8
+void runShaderTests() {
+}
+
+#endif
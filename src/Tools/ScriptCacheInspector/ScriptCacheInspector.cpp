@@ -0,0 +1,322 @@
+#include "ScriptSerializerPreCompiled.h"
+#include "ScriptSerializer.h"
+#include "ScriptCachePack.h"
+#include "ScriptCacheJson.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <climits>
+
+using namespace Ogre;
+using namespace Ogre::ScriptBlock;
+using namespace std;
+
+const char* blockClassNames[ScriptLayout::BlockClassCount] = { "unknown", "node", "transition", "string table", "segment table", "reference", "columns" };
+const char* nodeTypeNames[ScriptLayout::NodeTypeCount] = { "unknown", "atom", "object", "property", "import", "variable set", "variable access" };
+
+/// Measures the shape of the trees.  Bases and variables are part of their object, every other node counts
+class TreeStatistics : public ScriptSerializerVisitor
+{
+public:
+	TreeStatistics() : nodeCount(0), rootCount(0), maxDepth(0), depthSum(0), parentCount(0), childSum(0), maxFanOut(0) { }
+
+	virtual bool enterObject(const String& cls, const String& name, const ObjectAbstractNodeBlock& block) {
+		enterNode();
+		return true;
+	}
+	virtual void exitObject() { exitNode(); }
+
+	virtual bool enterProperty(const String& name, const PropertyAbstractNodeBlock& block) {
+		enterNode();
+		return true;
+	}
+	virtual void exitProperty() { exitNode(); }
+
+	virtual void atom(const String& value, const AtomAbstractNodeBlock& block) {
+		addNode();
+	}
+
+	size_t nodeCount;
+	size_t rootCount;
+	size_t maxDepth;
+	size_t depthSum;
+	size_t parentCount;		// Nodes with at least one child
+	size_t childSum;
+	size_t maxFanOut;
+
+private:
+	void addNode() {
+		size_t depth = childCounts.size() + 1;
+		nodeCount++;
+		maxDepth = std::max(maxDepth, depth);
+		depthSum += depth;
+		if (childCounts.empty()) {
+			rootCount++;
+		}
+		else {
+			childCounts.back()++;
+		}
+	}
+
+	void enterNode() {
+		addNode();
+		childCounts.push_back(0);
+	}
+
+	void exitNode() {
+		size_t fanOut = childCounts.back();
+		childCounts.pop_back();
+		if (fanOut) {
+			parentCount++;
+			childSum += fanOut;
+			maxFanOut = std::max(maxFanOut, fanOut);
+		}
+	}
+
+private:
+	std::vector<size_t> childCounts;	// Children met so far by each node being visited
+};
+
+struct ScriptReport {
+	String name;
+	ScriptLayout layout;
+	TreeStatistics tree;
+	ScriptSerializer::Statistics stats;
+	unsigned long decodeTime;		// Best of the runs, in microseconds
+	std::vector<std::pair<String, uint32> > topStrings;
+};
+
+struct Options {
+	Options() : json(false), topStrings(10), decodeRuns(3) { }
+
+	bool json;
+	size_t topStrings;
+	size_t decodeRuns;
+	String path;
+	StringVector entries;
+};
+
+static bool moreReferenced(const std::pair<String, uint32>& a, const std::pair<String, uint32>& b) {
+	return a.second > b.second || (a.second == b.second && a.first < b.first);
+}
+
+static void inspectScript(const DataStreamPtr& stream, const Options& options, ScriptReport& report) {
+	ScriptSerializer serializer;
+	serializer.describe(stream, report.layout);
+
+	stream->seek(0);
+	serializer.visit(stream, report.tree);
+
+	report.decodeTime = ULONG_MAX;
+	Timer timer;
+	for (size_t run = 0; run < options.decodeRuns; run++) {
+		stream->seek(0);
+		timer.reset();
+		serializer.deserialize(stream);
+		report.decodeTime = std::min(report.decodeTime, timer.getMicroseconds());
+	}
+	report.stats = serializer.getStatistics();
+
+	report.topStrings = report.layout.strings;
+	std::sort(report.topStrings.begin(), report.topStrings.end(), moreReferenced);
+	if (report.topStrings.size() > options.topStrings) {
+		report.topStrings.resize(options.topStrings);
+	}
+}
+
+static double average(size_t sum, size_t count) {
+	return count ? static_cast<double>(sum) / count : 0.0;
+}
+
+static void printText(ostream& out, const ScriptReport& report) {
+	const ScriptLayout& layout = report.layout;
+	out << report.name << "\n";
+	out << "  header: version " << layout.header.version << (layout.header.flags & SF_Release ? " release" : " debug")
+		<< (layout.header.flags & SF_CompactStrings ? ", varint string ids" : "") << ", modified " << layout.header.lastModifiedTime << ", string table at "
+		<< layout.header.stringTableOffset << ", segment table at " << layout.header.segmentTableOffset << ", " << layout.fileSize << " bytes\n";
+	out << "  segments: " << layout.segmentCount << " (" << layout.columnSegments << " columnar)\n";
+
+	out << "  blocks:\n";
+	for (size_t i = 0; i < ScriptLayout::BlockClassCount; i++) {
+		if (layout.blockCounts[i]) {
+			out << "    " << blockClassNames[i] << ": " << layout.blockCounts[i] << " blocks, " << layout.blockBytes[i] << " bytes ("
+				<< 100.0 * layout.blockBytes[i] / layout.fileSize << "%)\n";
+		}
+	}
+	out << "  nodes:\n";
+	for (size_t i = 0; i < ScriptLayout::NodeTypeCount; i++) {
+		if (layout.nodeCounts[i]) {
+			out << "    " << nodeTypeNames[i] << ": " << layout.nodeCounts[i] << " stored, " << layout.nodeBytes[i] << " bytes in node blocks\n";
+		}
+	}
+
+	out << "  strings: " << report.stats.stringCount << " strings, " << report.stats.stringBytes << " bytes of text\n";
+	for (size_t i = 0; i < report.topStrings.size(); i++) {
+		out << "    " << report.topStrings[i].second << "x \"" << report.topStrings[i].first << "\"\n";
+	}
+
+	const TreeStatistics& tree = report.tree;
+	out << "  tree: " << tree.nodeCount << " nodes (" << report.stats.nodesShared << " from references), " << tree.rootCount << " roots, depth "
+		<< tree.maxDepth << " max " << average(tree.depthSum, tree.nodeCount) << " average, fan-out " << tree.maxFanOut << " max "
+		<< average(tree.childSum, tree.parentCount) << " average\n";
+	out << "  decode: " << report.decodeTime << " us\n";
+}
+
+static void printJson(ostream& out, const ScriptReport& report) {
+	const ScriptLayout& layout = report.layout;
+	out << "{\"name\":";
+	writeJsonString(out, report.name);
+	out << ",\"header\":{\"version\":" << layout.header.version << ",\"release\":" << (layout.header.flags & SF_Release ? "true" : "false")
+		<< ",\"compactStrings\":" << (layout.header.flags & SF_CompactStrings ? "true" : "false") << ",\"lastModifiedTime\":" << layout.header.lastModifiedTime
+		<< ",\"stringTableOffset\":" << layout.header.stringTableOffset << ",\"segmentTableOffset\":" << layout.header.segmentTableOffset << "}";
+	out << ",\"fileSize\":" << layout.fileSize << ",\"segments\":" << layout.segmentCount << ",\"columnarSegments\":" << layout.columnSegments;
+
+	out << ",\"blocks\":{";
+	bool first = true;
+	for (size_t i = 0; i < ScriptLayout::BlockClassCount; i++) {
+		if (layout.blockCounts[i]) {
+			out << (first ? "" : ",") << "\"" << blockClassNames[i] << "\":{\"count\":" << layout.blockCounts[i] << ",\"bytes\":" << layout.blockBytes[i] << "}";
+			first = false;
+		}
+	}
+	out << "},\"nodes\":{";
+	first = true;
+	for (size_t i = 0; i < ScriptLayout::NodeTypeCount; i++) {
+		if (layout.nodeCounts[i]) {
+			out << (first ? "" : ",") << "\"" << nodeTypeNames[i] << "\":{\"count\":" << layout.nodeCounts[i] << ",\"bytes\":" << layout.nodeBytes[i] << "}";
+			first = false;
+		}
+	}
+
+	out << "},\"strings\":{\"count\":" << report.stats.stringCount << ",\"bytes\":" << report.stats.stringBytes << ",\"top\":[";
+	for (size_t i = 0; i < report.topStrings.size(); i++) {
+		out << (i ? "," : "") << "{\"value\":";
+		writeJsonString(out, report.topStrings[i].first);
+		out << ",\"references\":" << report.topStrings[i].second << "}";
+	}
+
+	const TreeStatistics& tree = report.tree;
+	out << "]},\"tree\":{\"nodes\":" << tree.nodeCount << ",\"sharedNodes\":" << report.stats.nodesShared << ",\"roots\":" << tree.rootCount
+		<< ",\"maxDepth\":" << tree.maxDepth << ",\"averageDepth\":" << average(tree.depthSum, tree.nodeCount) << ",\"maxFanOut\":" << tree.maxFanOut
+		<< ",\"averageFanOut\":" << average(tree.childSum, tree.parentCount) << "}";
+	out << ",\"decodeMicroseconds\":" << report.decodeTime << "}";
+}
+
+static DataStreamPtr openFile(const String& path) {
+	std::ifstream* file = OGRE_NEW_T(std::ifstream, MEMCATEGORY_GENERAL)(path.c_str(), std::ios::binary);
+	if (file->fail()) {
+		OGRE_DELETE_T(file, basic_ifstream, MEMCATEGORY_GENERAL);
+		return DataStreamPtr();
+	}
+	return DataStreamPtr(OGRE_NEW FileStreamDataStream(path, file, true));
+}
+
+static bool isBinaryScript(const DataStreamPtr& stream) {
+	ScriptHeader header;
+	size_t bytesRead = stream->read(&header, sizeof(header));
+	stream->seek(0);
+	return bytesRead == sizeof(header) && ScriptSerializer::isSupported(header);
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; i++) {
+		String arg = argv[i];
+		if (arg == "--json") {
+			options.json = true;
+		}
+		else if ((arg == "--top" || arg == "--runs") && i + 1 < argc) {
+			size_t value = StringConverter::parseUnsignedInt(argv[++i]);
+			if (arg == "--top") options.topStrings = value;
+			else options.decodeRuns = std::max(value, static_cast<size_t>(1));
+		}
+		else if (options.path.empty()) {
+			options.path = arg;
+		}
+		else {
+			options.entries.push_back(arg);
+		}
+	}
+	return !options.path.empty();
+}
+
+/**
+ * Prints what a binary script, or every script of a cache pack, is made of: the header, the blocks and bytes by block class
+ * and node type, the string table with its most referenced strings, the depth and fan-out of the trees and the time
+ * taken to decode the script
+ */
+int main(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		cerr << "Usage: ScriptCacheInspector [--json] [--top count] [--runs count] <script.sbin | cache pack> [pack entry...]\n";
+		return 2;
+	}
+
+	// The serializer and the pack log through Ogre.  Keep it off the console and out of files
+	LogManager* logManager = OGRE_NEW LogManager();
+	logManager->createLog("ScriptCacheInspector.log", true, false, true);
+
+	DataStreamPtr stream = openFile(options.path);
+	if (stream.isNull()) {
+		cerr << "Cannot open " << options.path << "\n";
+		OGRE_DELETE logManager;
+		return 1;
+	}
+
+	ScriptCachePack pack;
+	StringVector names;
+	if (isBinaryScript(stream)) {
+		names.push_back(options.path);
+	}
+	else {
+		stream->close();
+		stream.setNull();
+		if (!pack.load(options.path)) {
+			cerr << options.path << " is neither a cache pack nor a binary script of the current format version\n";
+			OGRE_DELETE logManager;
+			return 1;
+		}
+		names = options.entries.empty() ? pack.getNames() : options.entries;
+	}
+
+	int result = 0;
+	if (options.json) {
+		cout << "{\"scripts\":[";
+	}
+	bool first = true;
+	for (StringVector::iterator it = names.begin(); it != names.end(); ++it) {
+		DataStreamPtr script = stream.isNull() ? pack.open(*it) : stream;
+		if (script.isNull()) {
+			cerr << "The pack holds no entry named " << *it << "\n";
+			result = 1;
+			continue;
+		}
+
+		ScriptReport report;
+		report.name = *it;
+		try {
+			inspectScript(script, options, report);
+		}
+		catch (Exception& e) {
+			cerr << *it << ": " << e.getDescription() << "\n";
+			result = 1;
+			continue;
+		}
+
+		if (options.json) {
+			cout << (first ? "\n" : ",\n");
+			printJson(cout, report);
+		}
+		else {
+			printText(cout, report);
+		}
+		first = false;
+	}
+	if (options.json) {
+		cout << "\n]}\n";
+	}
+
+	stream.setNull();
+	pack.unload();
+	OGRE_DELETE logManager;
+	return result;
+}